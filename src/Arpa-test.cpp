@@ -0,0 +1,267 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Checks that refreshing ARPA targets in parallel (ArpaThreads > 1) gives exactly what the serial
+ * refresh gives. The same synthetic rotations, with targets spread around the radar so that they
+ * fall in separate clusters, are fed through both and the TTM sentences sent to OpenCPN are
+ * compared: same order, same positions and status, and ids that were handed out in the same order.
+ *
+ * The plugin itself cannot be created outside OpenCPN, so this links RadarMarpa.cpp on its own and
+ * defines below the few functions of the plugin and of OpenCPN that it refers to.
+ */
+
+#include "RadarMarpa.h"
+#include "br24radar_pi.h"
+#include "GuardZone.h"
+#include "spokeutil.h"
+
+#include <new>
+#include <wx/init.h>
+#include <wx/tokenzr.h>
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define TEST_TARGETS (8)
+#define TEST_ROTATIONS (16)
+#define TEST_ACQUIRE_ROTATION (1)  // Targets are acquired at the end of this rotation
+#define TEST_LOST_TARGET (3)       // This target disappears ...
+#define TEST_LOST_ROTATION (10)    // ... from this rotation on
+#define TEST_BLOB_SIZE (3)         // Targets are 2 * TEST_BLOB_SIZE + 1 spokes and returns
+#define TEST_RANGE_METERS (1852)
+#define TEST_ROTATION_MILLIS (2500)
+#define TEST_START_MILLIS (100000)
+#define TEST_THREADS (4)
+#define TEST_LAT (52.)
+#define TEST_LON (4.)
+
+static wxArrayString *test_sentences = 0;  // Receives what RadarArpa sends to OpenCPN
+
+// Where target k is in the given rotation; the odd ones move outwards, most of them turn
+static void TestTargetPosition(int k, int rotation, int *angle, int *r) {
+  *angle = MOD_ROTATION2048(k * LINES_PER_ROTATION / TEST_TARGETS + 64 + rotation * (k % 3));
+  *r = 120 + 40 * k + rotation * (k % 2);
+}
+
+static void TestMakeSpoke(int rotation, int angle, UINT8 *data) {
+  memset(data, 0, RETURNS_PER_LINE);
+  for (int k = 0; k < TEST_TARGETS; k++) {
+    if (k == TEST_LOST_TARGET && rotation >= TEST_LOST_ROTATION) {
+      continue;
+    }
+    int a, r;
+    TestTargetPosition(k, rotation, &a, &r);
+    if (MOD_ROTATION2048(angle - a + TEST_BLOB_SIZE) <= 2 * TEST_BLOB_SIZE) {
+      memset(data + r - TEST_BLOB_SIZE, 255, 2 * TEST_BLOB_SIZE + 1);
+    }
+  }
+}
+
+// Feeds all rotations to the ARPA of a new radar that refreshes with the given number of threads
+static bool TestRunArpa(int threads, wxArrayString *sentences) {
+  // Only the settings and the own ship position are used by the ARPA code
+  br24radar_pi *pi = (br24radar_pi *)calloc(1, sizeof(br24radar_pi));
+  new (&pi->m_settings) PersistentSettings();
+  pi->m_settings.verbose = 0;
+  pi->m_settings.threshold_blue = 50;
+  pi->m_settings.AISatARPAoffset = 0;
+  pi->m_settings.guard_zone_on_overlay = false;
+  pi->m_settings.arpa_max_targets = MAX_NUMBER_OF_TARGETS;
+  pi->m_settings.arpa_threads = threads;
+  pi->m_context_menu_delete_marpa_target = 1;  // as if the context menu was already added
+  pi->m_ownship_lat = TEST_LAT;
+  pi->m_ownship_lon = TEST_LON;
+
+  RadarInfo *ri = new RadarInfo(pi, 0);
+  ri->m_range_meters = TEST_RANGE_METERS;
+  ri->m_arpa = new RadarArpa(pi, ri);
+  test_sentences = sentences;
+
+  bool ok = true;
+  UINT8 data[RETURNS_PER_LINE];
+  for (int rotation = 0; rotation < TEST_ROTATIONS; rotation++) {
+    for (int angle = 0; angle < LINES_PER_ROTATION; angle++) {
+      RadarInfo::line_history &history = ri->m_history[angle];
+
+      // As RadarInfo::ProcessRadarSpoke does it
+      TestMakeSpoke(rotation, angle, data);
+      history.time = wxLongLong(TEST_START_MILLIS) + rotation * TEST_ROTATION_MILLIS +
+                     angle * TEST_ROTATION_MILLIS / LINES_PER_ROTATION;
+      history.lat = TEST_LAT;
+      history.lon = TEST_LON;
+      SpokeShiftHistory(history.line, data, RETURNS_PER_LINE, pi->m_settings.threshold_blue);
+      ri->m_blobs->AddSpoke(angle, history.line, RETURNS_PER_LINE, 128);
+      ri->m_plane->SetSpoke(angle, history.line, RETURNS_PER_LINE, 128);
+
+      if ((angle + 1) % ARPA_SECTOR_SPOKES != 0) {
+        continue;
+      }
+      if (rotation == TEST_ACQUIRE_ROTATION && angle == LINES_PER_ROTATION - 1) {
+        for (int k = 0; k < TEST_TARGETS; k++) {
+          Polar pol;
+          TestTargetPosition(k, rotation, &pol.angle, &pol.r);
+          pol.time = history.time;
+          if (ri->m_arpa->AcquireNewARPATarget(pol, ACQUIRE0) < 0) {
+            cout << "ERROR: Cannot acquire target " << k << "\n";
+            ok = false;
+          }
+        }
+      }
+      ri->m_arpa->RefreshArpaTargets();
+      ri->m_arpa->SendReports();
+    }
+  }
+
+  test_sentences = 0;
+  delete ri->m_arpa;
+  ri->m_arpa = 0;
+  delete ri;
+  pi->m_settings.~PersistentSettings();
+  free(pi);
+  return ok;
+}
+
+// Splits a TTM sentence in its target id and the other fields, leaving out the name and checksum that hold the id
+static wxString TestSplitSentence(const wxString &sentence, long *id) {
+  wxStringTokenizer fields(sentence.BeforeLast('*'), wxT(","), wxTOKEN_RET_EMPTY_ALL);
+  wxString rest;
+
+  *id = 0;
+  for (int f = 0; fields.HasMoreTokens(); f++) {
+    wxString field = fields.GetNextToken();
+    if (f == 1) {
+      field.Trim(false).ToLong(id);
+    } else if (f != 11) {
+      rest << field << wxT(",");
+    }
+  }
+  return rest;
+}
+
+static bool TestCompareReports(const wxArrayString &serial, const wxArrayString &parallel) {
+  if (serial.GetCount() != parallel.GetCount()) {
+    cout << "ERROR: " << serial.GetCount() << " reports sent serially but " << parallel.GetCount() << " in parallel\n";
+    return false;
+  }
+
+  // Target ids are not reset between runs, but they must have been given in the same order
+  long offset = 0;
+  for (size_t i = 0; i < serial.GetCount(); i++) {
+    long serial_id, parallel_id;
+    wxString serial_rest = TestSplitSentence(serial[i], &serial_id);
+    wxString parallel_rest = TestSplitSentence(parallel[i], &parallel_id);
+
+    if (i == 0) {
+      offset = parallel_id - serial_id;
+    }
+    if (parallel_id - serial_id != offset || serial_rest != parallel_rest) {
+      cout << "INFO: serial   " << serial[i].mb_str() << "\n";
+      cout << "INFO: parallel " << parallel[i].mb_str() << "\n";
+      cout << "ERROR: Report " << i << " differs\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  wxInitializer initializer;
+  int ret = 0;
+  wxArrayString serial, parallel;
+
+  if (!TestRunArpa(0, &serial) || !TestRunArpa(TEST_THREADS, &parallel)) {
+    ret = 1;
+  } else if (serial.GetCount() == 0) {
+    cout << "ERROR: No ARPA reports were sent\n";
+    ret = 1;
+  } else if (TestCompareReports(serial, parallel)) {
+    cout << "INFO: " << serial.GetCount() << " ARPA reports match with " << TEST_THREADS << " threads\n";
+  } else {
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+// Only what RadarArpa refers to of the radar and the plugin, the rest is in RadarInfo.cpp and br24radar_pi.cpp
+
+BEGIN_EVENT_TABLE(RadarInfo, wxEvtHandler)
+END_EVENT_TABLE()
+
+RadarInfo::RadarInfo(br24radar_pi *pi, int radar) : m_arpa_wake(0, 1) {
+  m_pi = pi;
+  m_radar = radar;
+  m_name = wxT("Radar");
+  m_arpa = 0;
+  m_blobs = new SpokeBlobs;
+  m_plane = new OccupancyPlane;
+  m_range_meters = 0;
+  m_timer = 0;
+  for (size_t z = 0; z < GUARD_ZONES; z++) {
+    m_guard_zone[z] = 0;
+  }
+  for (int a = 0; a < LINES_PER_ROTATION; a++) {
+    memset(m_history[a].line, 0, sizeof(m_history[a].line));
+    m_history[a].time = 0;
+    m_history[a].lat = 0.;
+    m_history[a].lon = 0.;
+  }
+}
+
+RadarInfo::~RadarInfo() {
+  delete m_blobs;
+  delete m_plane;
+}
+
+void GuardZone::SearchTargets() {}
+
+bool br24radar_pi::FindAIS_at_arpaPos(const double &lat, const double &lon, const double &dist) { return false; }
+
+PLUGIN_END_NAMESPACE
+
+int AddCanvasContextMenuItem(wxMenuItem *pitem, opencpn_plugin *pplugin) { return 1; }
+
+#ifdef __WXMSW__
+wxFont *OCPNGetFont(wxString TextElement, int default_size) { return 0; }
+#endif
+
+void PushNMEABuffer(wxString str) {
+  if (br24::test_sentences) {
+    br24::test_sentences->Add(str);
+  }
+}
+
+int main() { br24::main(); }
@@ -0,0 +1,298 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "DrawList.h"
+#include "shaderutil.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define ROUNDING_POINT_COUNT 8  // Points per corner of a round rect
+
+DrawList::DrawList() {
+  for (int i = 0; i < DRAWLIST_MAX_BATCHES; i++) {
+    m_batch[i].vertices = 0;
+    m_batch[i].size = 0;
+  }
+  m_batches = 0;
+  m_vertices = 0;
+  m_size = 0;
+  m_count = 0;
+  m_uploaded = false;
+  m_vbo = 0;
+  m_vbo_checked = false;
+  SetColour(255, 255, 255);
+}
+
+DrawList::~DrawList() {
+  for (int i = 0; i < DRAWLIST_MAX_BATCHES; i++) {
+    free(m_batch[i].vertices);
+  }
+  free(m_vertices);
+  if (m_vbo) {
+    DeleteBuffers(1, &m_vbo);
+    m_vbo = 0;
+  }
+}
+
+// Empty the list but keep the memory, as it will be filled again with about the same shapes.
+void DrawList::Clear() {
+  m_batches = 0;
+  m_count = 0;
+  m_uploaded = false;
+}
+
+void DrawList::SetColour(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha) {
+  m_colour[0] = red;
+  m_colour[1] = green;
+  m_colour[2] = blue;
+  m_colour[3] = alpha;
+}
+
+// Returns room for count vertices in the batch for this mode and texture, or 0 when out of memory or batches.
+DrawListVertex *DrawList::AddVertices(GLenum mode, GLuint texture, int count) {
+  Batch *batch = 0;
+
+  for (int i = 0; i < m_batches; i++) {
+    if (m_batch[i].mode == mode && m_batch[i].texture == texture) {
+      batch = &m_batch[i];
+      break;
+    }
+  }
+  if (!batch) {
+    if (m_batches == DRAWLIST_MAX_BATCHES) {
+      return 0;
+    }
+    batch = &m_batch[m_batches++];
+    batch->mode = mode;
+    batch->texture = texture;
+    batch->count = 0;
+  }
+
+  if (batch->count + count > batch->size) {
+    int size = wxMax(batch->size * 2, batch->count + count + 256);
+    DrawListVertex *vertices = (DrawListVertex *)realloc(batch->vertices, size * sizeof(DrawListVertex));
+    if (!vertices) {
+      wxLogError(wxT("BR24radar_pi: Out of memory for draw list"));
+      return 0;
+    }
+    batch->vertices = vertices;
+    batch->size = size;
+  }
+
+  DrawListVertex *v = batch->vertices + batch->count;
+  batch->count += count;
+  m_count += count;
+  m_uploaded = false;
+  return v;
+}
+
+void DrawList::AddVertex(DrawListVertex *v, float x, float y, float s, float t) {
+  v->x = x;
+  v->y = y;
+  v->s = s;
+  v->t = t;
+  memcpy(v->colour, m_colour, sizeof(m_colour));
+}
+
+void DrawList::AddLine(float x1, float y1, float x2, float y2) {
+  DrawListVertex *v = AddVertices(GL_LINES, 0, 2);
+
+  if (v) {
+    AddVertex(v + 0, x1, y1);
+    AddVertex(v + 1, x2, y2);
+  }
+}
+
+// Same as DrawArc() in drawutil.cpp, but as separate lines so all lines can be drawn at once.
+void DrawList::AddArc(float cx, float cy, float r, float start_angle, float arc_angle, int num_segments) {
+  if (num_segments < 2) {
+    return;
+  }
+  DrawListVertex *v = AddVertices(GL_LINES, 0, (num_segments - 1) * 2);
+  if (!v) {
+    return;
+  }
+
+  float theta = arc_angle / float(num_segments - 1);  // - 1 comes from the fact that the arc is open
+
+  float tangential_factor = tanf(theta);
+  float radial_factor = cosf(theta);
+
+  float x = r * cosf(start_angle);
+  float y = r * sinf(start_angle);
+
+  for (int ii = 0; ii < num_segments; ii++) {
+    if (ii > 0) {
+      AddVertex(v++, x + cx, y + cy);
+    }
+    if (ii < num_segments - 1) {
+      AddVertex(v++, x + cx, y + cy);
+    }
+
+    float tx = -y;
+    float ty = x;
+
+    x += tx * tangential_factor;
+    y += ty * tangential_factor;
+
+    x *= radial_factor;
+    y *= radial_factor;
+  }
+}
+
+// A filled rectangle with rounded corners, like DrawRoundRect() in drawutil.cpp, as a fan of triangles
+// around its center.
+void DrawList::AddRoundRect(float x, float y, float width, float height, float radius) {
+  static const int points = ROUNDING_POINT_COUNT * 4;
+  DrawListVertex *v = AddVertices(GL_TRIANGLES, 0, points * 3);
+  if (!v) {
+    return;
+  }
+
+  if (radius == 0.0) {
+    radius = wxMin(width, height) * 0.10f;  // 10%
+  }
+
+  float corner_x[4] = {x + width - radius, x + radius, x + radius, x + width - radius};
+  float corner_y[4] = {y + height - radius, y + height - radius, y + radius, y + radius};
+  float perimeter_x[points];
+  float perimeter_y[points];
+  float step = (float)(PI / 2.0) / (ROUNDING_POINT_COUNT - 1);
+
+  for (int c = 0; c < 4; c++) {
+    for (int i = 0; i < ROUNDING_POINT_COUNT; i++) {
+      float angle = c * (float)(PI / 2.0) + i * step;
+      perimeter_x[c * ROUNDING_POINT_COUNT + i] = corner_x[c] + cosf(angle) * radius;
+      perimeter_y[c * ROUNDING_POINT_COUNT + i] = corner_y[c] + sinf(angle) * radius;
+    }
+  }
+
+  float center_x = x + width / 2.0f;
+  float center_y = y + height / 2.0f;
+  for (int i = 0; i < points; i++) {
+    int j = (i + 1) % points;
+    AddVertex(v++, center_x, center_y);
+    AddVertex(v++, perimeter_x[i], perimeter_y[i]);
+    AddVertex(v++, perimeter_x[j], perimeter_y[j]);
+  }
+}
+
+void DrawList::AddQuad(GLuint texture, float x1, float y1, float x2, float y2, float s1, float t1, float s2, float t2) {
+  DrawListVertex *v = AddVertices(GL_TRIANGLES, texture, 6);
+
+  if (v) {
+    AddVertex(v + 0, x1, y1, s1, t1);
+    AddVertex(v + 1, x2, y1, s2, t1);
+    AddVertex(v + 2, x2, y2, s2, t2);
+    AddVertex(v + 3, x1, y1, s1, t1);
+    AddVertex(v + 4, x2, y2, s2, t2);
+    AddVertex(v + 5, x1, y2, s1, t2);
+  }
+}
+
+// Put all batches after each other, in the vertex buffer object when there is one.
+bool DrawList::Upload() {
+  if (m_count > m_size) {
+    DrawListVertex *vertices = (DrawListVertex *)realloc(m_vertices, m_count * sizeof(DrawListVertex));
+    if (!vertices) {
+      wxLogError(wxT("BR24radar_pi: Out of memory for draw list"));
+      return false;
+    }
+    m_vertices = vertices;
+    m_size = m_count;
+  }
+
+  int first = 0;
+  for (int i = 0; i < m_batches; i++) {
+    m_batch[i].first = first;
+    memcpy(m_vertices + first, m_batch[i].vertices, m_batch[i].count * sizeof(DrawListVertex));
+    first += m_batch[i].count;
+  }
+
+  if (!m_vbo_checked) {
+    if (BuffersSupported()) {
+      GenBuffers(1, &m_vbo);
+    }
+    m_vbo_checked = true;
+  }
+  if (m_vbo) {
+    BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    BufferData(GL_ARRAY_BUFFER, m_count * sizeof(DrawListVertex), m_vertices, GL_DYNAMIC_DRAW);
+    BindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+  m_uploaded = true;
+  return true;
+}
+
+void DrawList::Draw() {
+  if (!m_count) {
+    return;
+  }
+  if (!m_uploaded && !Upload()) {
+    return;
+  }
+
+  const GLubyte *base = (const GLubyte *)m_vertices;
+  if (m_vbo) {
+    BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    base = 0;
+  }
+
+  glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+  glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(DrawListVertex), base + offsetof(DrawListVertex, x));
+  glTexCoordPointer(2, GL_FLOAT, sizeof(DrawListVertex), base + offsetof(DrawListVertex, s));
+  glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(DrawListVertex), base + offsetof(DrawListVertex, colour));
+
+  for (int i = 0; i < m_batches; i++) {
+    Batch &batch = m_batch[i];
+
+    if (batch.texture) {
+      glEnable(GL_TEXTURE_2D);
+      glBindTexture(GL_TEXTURE_2D, batch.texture);
+      glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    } else {
+      glDisable(GL_TEXTURE_2D);
+      glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    }
+    glDrawArrays(batch.mode, batch.first, batch.count);
+  }
+
+  glPopClientAttrib();
+  glPopAttrib();
+  if (m_vbo) {
+    BindBuffer(GL_ARRAY_BUFFER, 0);
+  }
+}
+
+PLUGIN_END_NAMESPACE
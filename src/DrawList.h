@@ -0,0 +1,95 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _DRAWLIST_H_
+#define _DRAWLIST_H_
+
+#include "pi_common.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+/*
+ * A list of 2D lines, filled shapes and textured quads that is built once
+ * and then drawn as often as needed. All vertices go into one vertex buffer, and everything with
+ * the same primitive type and texture is drawn with one glDrawArrays. These batches are drawn in
+ * the order in which they were first used.
+ */
+#define DRAWLIST_MAX_BATCHES (16)
+
+struct DrawListVertex {
+  GLfloat x, y;
+  GLfloat s, t;
+  GLubyte colour[4];
+};
+
+class DrawList {
+ public:
+  DrawList();
+  ~DrawList();
+
+  void Clear();
+  void SetColour(GLubyte red, GLubyte green, GLubyte blue, GLubyte alpha = 255);
+  void AddLine(float x1, float y1, float x2, float y2);
+  void AddArc(float cx, float cy, float r, float start_angle, float arc_angle, int num_segments);
+  void AddRoundRect(float x, float y, float width, float height, float radius = 0.0);
+  void AddQuad(GLuint texture, float x1, float y1, float x2, float y2, float s1, float t1, float s2, float t2);
+  void Draw();
+
+ private:
+  struct Batch {
+    GLenum mode;     // GL_LINES or GL_TRIANGLES
+    GLuint texture;  // 0 when not textured
+    DrawListVertex *vertices;
+    int count;
+    int size;
+    int first;  // Position in the vertex buffer
+  };
+
+  DrawListVertex *AddVertices(GLenum mode, GLuint texture, int count);
+  void AddVertex(DrawListVertex *v, float x, float y, float s = 0.0, float t = 0.0);
+  bool Upload();
+
+  Batch m_batch[DRAWLIST_MAX_BATCHES];
+  int m_batches;
+  GLubyte m_colour[4];
+
+  DrawListVertex *m_vertices;  // All batches after each other, when there are no buffer objects
+  int m_size;
+  int m_count;
+  bool m_uploaded;  // Nothing was added since the last upload
+
+  GLuint m_vbo;
+  bool m_vbo_checked;  // BuffersSupported() was called
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _DRAWLIST_H_ */
@@ -30,11 +30,26 @@
 
 #include "RadarMarpa.h"
 #include "br24radar_pi.h"
+#include "spokeutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
 #undef TEST_GUARD_ZONE_LOCATION
 
+#define GUARD_ZONE_MAX_BLOBS (64)  // Blobs looked at per pair of spokes in SearchTargets
+
+#ifdef TEST_GUARD_ZONE_LOCATION
+// Zap guard zone computation location to green so this is visible on screen
+static void ZapGuardZone(UINT8* data, UINT8* hist, size_t r_begin, size_t r_end, bool multi_sweep_filter, UINT8 blue,
+                         UINT8 green) {
+  for (size_t r = r_begin; r < r_end; r++) {
+    if ((!multi_sweep_filter || HISTORY_FILTER_ALLOW(hist[r])) && data[r] < blue) {
+      data[r] = green;
+    }
+  }
+}
+#endif
+
 void GuardZone::ProcessSpoke(SpokeBearing angle, UINT8* data, UINT8* hist, size_t len, int range) {
   size_t range_start = m_inner_range * RETURNS_PER_LINE / range;  // Convert from meters to 0..511
   size_t range_end = m_outer_range * RETURNS_PER_LINE / range;    // Convert from meters to 0..511
@@ -45,23 +60,16 @@ void GuardZone::ProcessSpoke(SpokeBearing angle, UINT8* data, UINT8* hist, size_
       if ((angle >= m_start_bearing && angle < m_end_bearing) ||
           (m_start_bearing >= m_end_bearing && (angle >= m_start_bearing || angle < m_end_bearing))) {
         if (range_start < RETURNS_PER_LINE) {
-          if (range_end > RETURNS_PER_LINE) {
-            range_end = RETURNS_PER_LINE;
+          if (range_end >= len) {
+            range_end = len - 1;  // range_end is inclusive
           }
 
-          for (size_t r = range_start; r <= range_end; r++) {
-            if (!m_multi_sweep_filter || HISTORY_FILTER_ALLOW(hist[r])) {
-              if (data[r] >= m_pi->m_settings.threshold_blue) {
-                m_running_count++;
-              }
+          m_running_count +=
+              SpokeCountReturns(data, hist, range_start, range_end + 1, m_pi->m_settings.threshold_blue, m_multi_sweep_filter);
 #ifdef TEST_GUARD_ZONE_LOCATION
-              // Zap guard zone computation location to green so this is visible on screen
-              else {
-                data[r] = m_pi->m_settings.threshold_green;
-              }
+          ZapGuardZone(data, hist, range_start, range_end + 1, m_multi_sweep_filter, m_pi->m_settings.threshold_blue,
+                       m_pi->m_settings.threshold_green);
 #endif
-            }
-          }
         }
         in_guard_zone = true;
       }
@@ -69,23 +77,16 @@ void GuardZone::ProcessSpoke(SpokeBearing angle, UINT8* data, UINT8* hist, size_
 
     case GZ_CIRCLE:
       if (range_start < RETURNS_PER_LINE) {
-        if (range_end > RETURNS_PER_LINE) {
-          range_end = RETURNS_PER_LINE;
+        if (range_end >= len) {
+          range_end = len - 1;  // range_end is inclusive
         }
 
-        for (size_t r = range_start; r <= range_end; r++) {
-          if (!m_multi_sweep_filter || HISTORY_FILTER_ALLOW(hist[r])) {
-            if (data[r] >= m_pi->m_settings.threshold_blue) {
-              m_running_count++;
-            }
+        m_running_count +=
+            SpokeCountReturns(data, hist, range_start, range_end + 1, m_pi->m_settings.threshold_blue, m_multi_sweep_filter);
 #ifdef TEST_GUARD_ZONE_LOCATION
-            // Zap guard zone computation location to green so this is visible on screen
-            else {
-              data[r] = m_pi->m_settings.threshold_green;
-            }
+        ZapGuardZone(data, hist, range_start, range_end + 1, m_multi_sweep_filter, m_pi->m_settings.threshold_blue,
+                     m_pi->m_settings.threshold_green);
 #endif
-          }
-        }
         if (angle > m_last_angle) {
           in_guard_zone = true;
         }
@@ -160,25 +161,38 @@ void GuardZone::SearchTargets() {
       // and if the beam has passed the target location with SCAN_MARGIN spokes
       if ((time1 > (arpa_update_time[MOD_ROTATION2048(angle)] + SCAN_MARGIN2) &&
            time2 >= time1)) {  // the beam sould have passed our "angle" AND a point SCANMARGIN further
-                               // set new refresh time
+        // blobs that start on this pair of spokes, labeled by RadarInfo::ProcessRadarSpoke; on the first pair
+        // of an arc also the blobs that start before the zone and reach into it
+        int first_angle = angle;
+        if (m_type != GZ_CIRCLE && angle == start_bearing) {
+          first_angle -= MAX_TARGET_DIAMETER;
+        }
+        SpokeBlob blobs[GUARD_ZONE_MAX_BLOBS];
+        int found;
+        {
+          wxCriticalSectionLocker lock(m_ri->m_exclusive);
+          if (m_ri->m_blobs->IsOpen(first_angle, angle + 1)) {
+            continue;  // look again on the next refresh, when these blobs are finished
+          }
+          found = m_ri->m_blobs->Find(first_angle, angle + 1, (int)range_start, (int)range_end - 1, blobs, GUARD_ZONE_MAX_BLOBS);
+        }
+        // set new refresh time
         arpa_update_time[MOD_ROTATION2048(angle)] = time1;
-        for (int rrr = (int)range_start; rrr < (int)range_end; rrr++) {
-          if (m_ri->m_arpa->MultiPix(angle, rrr)) {
-            bool next_r = false;
-            if (next_r) continue;
-            // pixel found that does not belong to a known target
-            Position own_pos;
-            Polar pol;
-            pol.angle = angle;
-            pol.r = rrr;
-            own_pos.lat = m_pi->m_ownship_lat;
-            own_pos.lon = m_pi->m_ownship_lon;
-            Position x;
-            x = Polar2Pos(pol, own_pos, m_ri->m_range_meters);
-            int target_i;
-            target_i = m_ri->m_arpa->AcquireNewARPATarget(pol, 0);
-            if (target_i == -1) break;  // TODO: how to handle max targets exceeded
+        for (int i = 0; i < found; i++) {
+          if (MOD_ROTATION2048(blobs[i].min_angle - angle) > 1 &&
+              MOD_ROTATION2048(angle - blobs[i].min_angle) > blobs[i].max_angle - blobs[i].min_angle) {
+            continue;  // ends before the zone
+          }
+          if (!m_ri->m_arpa->Pix(blobs[i].min_angle, blobs[i].start_r)) {
+            continue;  // already part of a known target
           }
+          // blob found that does not belong to a known target
+          Polar pol;
+          pol.angle = blobs[i].min_angle;
+          pol.r = blobs[i].start_r;
+          int target_i;
+          target_i = m_ri->m_arpa->AcquireNewARPATarget(pol, 0);
+          if (target_i == -1) break;  // TODO: how to handle max targets exceeded
         }
       }
     }
@@ -53,6 +53,9 @@ RadarCanvas::RadarCanvas(br24radar_pi *pi, RadarInfo *ri, wxWindow *parent, wxSi
   m_context = new wxGLContext(this);
   m_zero_context = new wxGLContext(this);
   m_cursor_texture = 0;
+  m_fonts_time = 0;
+  m_background_valid = false;
+  m_foreground_valid = false;
   m_last_mousewheel_zoom_in = 0;
   m_last_mousewheel_zoom_out = 0;
 
@@ -70,6 +73,21 @@ RadarCanvas::~RadarCanvas() {
   }
 }
 
+void RadarCanvas::BuildFonts() {
+  wxFont font = GetOCPNGUIScaledFont_PlugIn(_T("StatusBar"));
+  m_FontNormal.Build(font);
+  wxFont bigFont = GetOCPNGUIScaledFont_PlugIn(_T("Dialog"));
+  bigFont.SetPointSize(bigFont.GetPointSize() + 2);
+  bigFont.SetWeight(wxFONTWEIGHT_BOLD);
+  m_FontBig.Build(bigFont);
+  bigFont.SetPointSize(bigFont.GetPointSize() + 2);
+  bigFont.SetWeight(wxFONTWEIGHT_NORMAL);
+  m_FontMenu.Build(bigFont);
+  bigFont.SetPointSize(bigFont.GetPointSize() + 10);
+  bigFont.SetWeight(wxFONTWEIGHT_BOLD);
+  m_FontMenuBold.Build(bigFont);
+}
+
 void RadarCanvas::OnSize(wxSizeEvent &evt) {
   wxSize parentSize = m_parent->GetSize();
   LOG_DIALOG(wxT("BR24radar_pi: %s resize OpenGL canvas to %d, %d"), m_ri->m_name.c_str(), parentSize.x, parentSize.y);
@@ -84,7 +102,7 @@ void RadarCanvas::OnMove(wxMoveEvent &evt) {
   LOG_DIALOG(wxT("BR24radar_pi: %s move OpenGL canvas to %d, %d"), m_ri->m_name.c_str(), pos.x, pos.y);
 }
 
-void RadarCanvas::RenderTexts(int w, int h) {
+void RadarCanvas::AddTexts(int w, int h) {
   int x, y;
 
   wxString s;
@@ -102,13 +120,13 @@ void RadarCanvas::RenderTexts(int w, int h) {
   m_menu_size.x = x + 2 * (MENU_BORDER + MENU_EXTRA_WIDTH);
   m_menu_size.y = y + 2 * (MENU_BORDER);
 
-  glColor4ub(40, 40, 100, 128);
+  m_foreground.SetColour(40, 40, 100, 128);
 
-  DrawRoundRect(w - m_menu_size.x, 0, m_menu_size.x, m_menu_size.y, 4);
+  m_foreground.AddRoundRect(w - m_menu_size.x, 0, m_menu_size.x, m_menu_size.y, 4);
 
-  glColor4ub(100, 255, 255, 255);
+  m_foreground.SetColour(100, 255, 255, 255);
   // The Menu text is slightly inside the rect
-  m_FontMenu.RenderString(s, w - m_menu_size.x + MENU_BORDER + MENU_EXTRA_WIDTH, MENU_BORDER);
+  m_FontMenu.AddString(&m_foreground, s, w - m_menu_size.x + MENU_BORDER + MENU_EXTRA_WIDTH, MENU_BORDER);
 
   // Draw - + in mid bottom
 
@@ -119,33 +137,52 @@ void RadarCanvas::RenderTexts(int w, int h) {
   m_zoom_size.x = x + 2 * (MENU_BORDER);
   m_zoom_size.y = y + 2 * (MENU_BORDER);
 
-  glColor4ub(80, 80, 80, 128);
+  m_foreground.SetColour(80, 80, 80, 128);
 
-  DrawRoundRect(w / 2 - m_zoom_size.x / 2, h - m_zoom_size.y + MENU_ROUNDING, m_zoom_size.x, m_zoom_size.y, MENU_ROUNDING);
+  m_foreground.AddRoundRect(w / 2 - m_zoom_size.x / 2, h - m_zoom_size.y + MENU_ROUNDING, m_zoom_size.x, m_zoom_size.y,
+                            MENU_ROUNDING);
 
-  glColor4ub(200, 200, 200, 255);
+  m_foreground.SetColour(200, 200, 200, 255);
   // The Menu text is slightly inside the rect
-  m_FontMenuBold.RenderString(s, w / 2 - m_zoom_size.x / 2 + MENU_BORDER, h - m_zoom_size.y + MENU_BORDER);
+  m_FontMenuBold.AddString(&m_foreground, s, w / 2 - m_zoom_size.x / 2 + MENU_BORDER, h - m_zoom_size.y + MENU_BORDER);
 
-  glColor4ub(200, 255, 200, 255);
+  m_foreground.SetColour(200, 255, 200, 255);
 
-  s = m_ri->GetCanvasTextTopLeft();
-  m_FontBig.RenderString(s, 0, 0);
+  s = m_text_top_left;
+  m_FontBig.AddString(&m_foreground, s, 0, 0);
 
-  s = m_ri->GetCanvasTextBottomLeft();
+  s = m_text_bottom_left;
   if (s.length()) {
     m_FontBig.GetTextExtent(s, &x, &y);
-    m_FontBig.RenderString(s, 0, h - y);
+    m_FontBig.AddString(&m_foreground, s, 0, h - y);
   }
 
-  s = m_ri->GetCanvasTextCenter();
+  s = m_text_center;
   if (s.length()) {
     m_FontBig.GetTextExtent(s, &x, &y);
-    m_FontBig.RenderString(s, (w - x) / 2, (h - y) / 2);
+    m_FontBig.AddString(&m_foreground, s, (w - x) / 2, (h - y) / 2);
+  }
+}
+
+void RadarCanvas::GetHeadingAndPredictor(double *heading, double *predictor) {
+  switch (m_ri->m_orientation.value) {
+    case ORIENTATION_HEAD_UP:
+      *heading = 180.;
+      *predictor = 180.;
+      break;
+    case ORIENTATION_NORTH_UP:
+      *heading = 180;
+      *predictor = m_pi->m_hdt + 180;
+      break;
+    case ORIENTATION_COURSE_UP:
+    default:
+      *heading = m_ri->m_course + 180.;
+      *predictor = m_pi->m_hdt + 180. - m_ri->m_course;
+      break;
   }
 }
 
-void RadarCanvas::RenderRangeRingsAndHeading(int w, int h) {
+void RadarCanvas::AddRangeRingsAndHeading(int w, int h, double heading, double predictor) {
   // Max range ringe
   float r = wxMax(w, h) / 2.0;
 
@@ -159,40 +196,20 @@ void RadarCanvas::RenderRangeRingsAndHeading(int w, int h) {
   int px;
   int py;
 
-  glColor3ub(0, 126, 29);  // same color as HDS
-  glLineWidth(1.0);
+  m_background.SetColour(0, 126, 29);  // same color as HDS
 
   for (int i = 1; i <= 4; i++) {
-    DrawArc(center_x, center_y, r * i * 0.25, 0.0, 2.0 * (float)PI, 360);
+    m_background.AddArc(center_x, center_y, r * i * 0.25, 0.0, 2.0 * (float)PI, 360);
     const char *s = m_ri->GetDisplayRangeStr(i - 1);
     if (s) {
-      m_FontNormal.RenderString(wxString::Format(wxT("%s"), s), center_x + x * (float)i, center_y + y * (float)i);
+      m_FontNormal.AddString(&m_background, wxString::Format(wxT("%s"), s), center_x + x * (float)i,
+                             center_y + y * (float)i);
     }
   }
 
-  double heading;
-  double predictor;
-  switch (m_ri->m_orientation.value) {
-    case ORIENTATION_HEAD_UP:
-      heading = 180.;
-      predictor = 180.;
-      break;
-    case ORIENTATION_NORTH_UP:
-      heading = 180;
-      predictor = m_pi->m_hdt + 180;
-      break;
-    case ORIENTATION_COURSE_UP:
-      heading = m_ri->m_course + 180.;
-      predictor = m_pi->m_hdt + 180. - m_ri->m_course;
-      break;
-  }
-
   x = -sinf(deg2rad(predictor));
   y = cosf(deg2rad(predictor));
-  glBegin(GL_LINE_STRIP);
-  glVertex2f(center_x, center_y);
-  glVertex2f(center_x + x * r * 2, center_y + y * r * 2);
-  glEnd();
+  m_background.AddLine(center_x, center_y, center_x + x * r * 2, center_y + y * r * 2);
 
   for (int i = 0; i < 360; i += 5) {
     x = -sinf(deg2rad(i - heading)) * (r * 1.00 - 1);
@@ -212,7 +229,7 @@ void RadarCanvas::RenderRangeRingsAndHeading(int w, int h) {
     if (y > 0) {
       y -= py;
     }
-    m_FontNormal.RenderString(s, center_x + x, center_y + y);
+    m_FontNormal.AddString(&m_background, s, center_x + x, center_y + y);
   }
 }
 
@@ -278,7 +295,8 @@ void RadarCanvas::FillCursorTexture() {
   glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 16, 16, 0, GL_RGBA, GL_UNSIGNED_BYTE, cursorTexture);
 }
 
-void RadarCanvas::RenderCursor(int w, int h) {
+// Returns false when there is no cursor, otherwise the top left position of the cursor.
+bool RadarCanvas::GetCursorPosition(int w, int h, int *cursor_x, int *cursor_y) {
   double distance;
   double bearing;
 
@@ -287,7 +305,7 @@ void RadarCanvas::RenderCursor(int w, int h) {
     bearing = m_ri->m_mouse_ebl[m_ri->m_orientation.value];
   } else {
     if ((m_ri->m_mouse_lat == 0.0 && m_ri->m_mouse_lon == 0.0) || !m_pi->m_bpos_set) {
-      return;
+      return false;
     }
     // Can't compute this upfront, ownship may move...
     distance = local_distance(m_pi->m_ownship_lat, m_pi->m_ownship_lon, m_ri->m_mouse_lat, m_ri->m_mouse_lon) * 1852.;
@@ -307,33 +325,27 @@ void RadarCanvas::RenderCursor(int w, int h) {
   double center_x = w / 2.0;
   double center_y = h / 2.0;
   double angle = deg2rad(bearing);
-  double x = center_x + sin(angle) * range - CURSOR_WIDTH * CURSOR_SCALE / 2;
-  double y = center_y - cos(angle) * range - CURSOR_WIDTH * CURSOR_SCALE / 2;
+  *cursor_x = center_x + sin(angle) * range - CURSOR_WIDTH * CURSOR_SCALE / 2;
+  *cursor_y = center_y - cos(angle) * range - CURSOR_WIDTH * CURSOR_SCALE / 2;
 
   // LOG_DIALOG(wxT("BR24radar_pi: draw cursor angle=%.1f bearing=%.1f"), rad2deg(angle), bearing);
+  return true;
+}
 
+void RadarCanvas::AddCursor(int x, int y) {
   if (!m_cursor_texture) {
     glGenTextures(1, &m_cursor_texture);
     glBindTexture(GL_TEXTURE_2D, m_cursor_texture);
     FillCursorTexture();
+    glBindTexture(GL_TEXTURE_2D, 0);
     LOG_DIALOG(wxT("BR24radar_pi: generated cursor texture # %u"), m_cursor_texture);
   }
 
-  glColor3f(1.0f, 1.0f, 1.0f);
-  glBindTexture(GL_TEXTURE_2D, m_cursor_texture);
-  glBegin(GL_QUADS);
-  glTexCoord2i(0, 0);
-  glVertex2i(x, y);
-  glTexCoord2i(1, 0);
-  glVertex2i(x + CURSOR_SCALE * CURSOR_WIDTH, y);
-  glTexCoord2i(1, 1);
-  glVertex2i(x + CURSOR_SCALE * CURSOR_WIDTH, y + CURSOR_SCALE * CURSOR_HEIGHT);
-  glTexCoord2i(0, 1);
-  glVertex2i(x, y + CURSOR_SCALE * CURSOR_HEIGHT);
-  glEnd();
+  m_foreground.SetColour(255, 255, 255);
+  m_foreground.AddQuad(m_cursor_texture, x, y, x + CURSOR_SCALE * CURSOR_WIDTH, y + CURSOR_SCALE * CURSOR_HEIGHT, 0, 0, 1, 1);
 }
 
-void RadarCanvas::Render_EBL_VRM(int w, int h) {
+void RadarCanvas::Add_EBL_VRM(int w, int h) {
   static const uint8_t rgb[BEARING_LINES][3] = {{22, 129, 154}, {45, 255, 254}};
 
   float full_range = wxMax(w, h) / 2.0;
@@ -343,24 +355,88 @@ void RadarCanvas::Render_EBL_VRM(int w, int h) {
 
   for (int b = 0; b < BEARING_LINES; b++) {
     float x, y;
-    glColor3ubv(rgb[b]);
-    glLineWidth(1.0);
+    m_background.SetColour(rgb[b][0], rgb[b][1], rgb[b][2]);
     if (m_ri->m_vrm[b] != 0.0) {
       float scale = m_ri->m_vrm[b] * 1852.0 * full_range / display_range;
       if (m_ri->m_ebl[m_ri->m_orientation.value][b] != nanl("")) {
         float angle = (float)deg2rad(m_ri->m_ebl[m_ri->m_orientation.value][b]);
         x = center_x + sinf(angle) * full_range * 2.;
         y = center_y - cosf(angle) * full_range * 2.;
-        glBegin(GL_LINES);
-        glVertex2f(center_x, center_y);
-        glVertex2f(x, y);
-        glEnd();
+        m_background.AddLine(center_x, center_y, x, y);
       }
-      DrawArc(center_x, center_y, scale, 0.f, 2.f * (float)PI, 360);
+      m_background.AddArc(center_x, center_y, scale, 0.f, 2.f * (float)PI, 360);
     }
   }
 }
 
+// Build the range rings, heading line, compass labels and EBL/VRM again when anything they show has changed.
+void RadarCanvas::UpdateBackground(int w, int h) {
+  BackgroundState state;
+
+  memset(&state, 0, sizeof(state));  // So that memcmp does not see the padding
+  state.w = w;
+  state.h = h;
+  GetHeadingAndPredictor(&state.heading, &state.predictor);
+  for (int i = 0; i < 4; i++) {
+    state.range[i] = m_ri->GetDisplayRangeStr(i);
+  }
+  state.display_range = m_ri->GetDisplayRange();
+  for (int b = 0; b < BEARING_LINES; b++) {
+    state.vrm[b] = m_ri->m_vrm[b];
+    state.ebl[b] = m_ri->m_ebl[m_ri->m_orientation.value][b];
+  }
+  state.font = m_FontNormal.GetGeneration();
+
+  if (m_background_valid && memcmp(&state, &m_background_state, sizeof(state)) == 0) {
+    return;
+  }
+
+  // Adding a glyph may have grown the font texture, which moves the glyphs added before it; build once more then
+  do {
+    state.font = m_FontNormal.GetGeneration();
+    m_background.Clear();
+    AddRangeRingsAndHeading(w, h, state.heading, state.predictor);
+    Add_EBL_VRM(w, h);
+  } while (state.font != m_FontNormal.GetGeneration());
+  m_background_state = state;
+  m_background_valid = true;
+}
+
+// Build the menu buttons, texts and cursor again when anything they show has changed.
+void RadarCanvas::UpdateForeground(int w, int h) {
+  ForegroundState state;
+  wxString top_left = m_ri->GetCanvasTextTopLeft();
+  wxString bottom_left = m_ri->GetCanvasTextBottomLeft();
+  wxString center = m_ri->GetCanvasTextCenter();
+
+  memset(&state, 0, sizeof(state));  // So that memcmp does not see the padding
+  state.w = w;
+  state.h = h;
+  state.cursor = GetCursorPosition(w, h, &state.cursor_x, &state.cursor_y);
+  state.font = m_FontMenu.GetGeneration() + m_FontMenuBold.GetGeneration() + m_FontBig.GetGeneration();
+
+  if (m_foreground_valid && memcmp(&state, &m_foreground_state, sizeof(state)) == 0 && top_left == m_text_top_left &&
+      bottom_left == m_text_bottom_left && center == m_text_center) {
+    return;
+  }
+
+  m_text_top_left = top_left;
+  m_text_bottom_left = bottom_left;
+  m_text_center = center;
+
+  // As in UpdateBackground: build once more when adding a glyph grew a font texture
+  do {
+    state.font = m_FontMenu.GetGeneration() + m_FontMenuBold.GetGeneration() + m_FontBig.GetGeneration();
+    m_foreground.Clear();
+    AddTexts(w, h);
+    if (state.cursor) {
+      AddCursor(state.cursor_x, state.cursor_y);
+    }
+  } while (state.font != m_FontMenu.GetGeneration() + m_FontMenuBold.GetGeneration() + m_FontBig.GetGeneration());
+  m_foreground_state = state;
+  m_foreground_valid = true;
+}
+
 void RadarCanvas::Render(wxPaintEvent &evt) {
   int w, h;
 
@@ -387,18 +463,12 @@ void RadarCanvas::Render(wxPaintEvent &evt) {
   glPushMatrix();
   glPushAttrib(GL_ALL_ATTRIB_BITS);
 
-  wxFont font = GetOCPNGUIScaledFont_PlugIn(_T("StatusBar"));
-  m_FontNormal.Build(font);
-  wxFont bigFont = GetOCPNGUIScaledFont_PlugIn(_T("Dialog"));
-  bigFont.SetPointSize(bigFont.GetPointSize() + 2);
-  bigFont.SetWeight(wxFONTWEIGHT_BOLD);
-  m_FontBig.Build(bigFont);
-  bigFont.SetPointSize(bigFont.GetPointSize() + 2);
-  bigFont.SetWeight(wxFONTWEIGHT_NORMAL);
-  m_FontMenu.Build(bigFont);
-  bigFont.SetPointSize(bigFont.GetPointSize() + 10);
-  bigFont.SetWeight(wxFONTWEIGHT_BOLD);
-  m_FontMenuBold.Build(bigFont);
+  // The font settings rarely change, so only look them up once a second
+  time_t now = time(0);
+  if (now != m_fonts_time) {
+    BuildFonts();
+    m_fonts_time = now;
+  }
 
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);                // Black Background
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);  // Clear the canvas
@@ -414,8 +484,8 @@ void RadarCanvas::Render(wxPaintEvent &evt) {
   glOrtho(0, w, h, 0, -1, 1);
   glMatrixMode(GL_MODELVIEW);  // Reset matrick stack target back to GL_MODELVIEW
 
-  RenderRangeRingsAndHeading(w, h);
-  Render_EBL_VRM(w, h);
+  UpdateBackground(w, h);
+  m_background.Draw();
 
   glViewport(0, 0, w, h);
   glMatrixMode(GL_PROJECTION);  // Next two operations on the project matrix stack
@@ -435,10 +505,8 @@ void RadarCanvas::Render(wxPaintEvent &evt) {
   glOrtho(0, w, h, 0, -1, 1);
   glMatrixMode(GL_MODELVIEW);  // Reset matrick stack target back to GL_MODELVIEW
 
-  glEnable(GL_TEXTURE_2D);
-
-  RenderTexts(w, h);
-  RenderCursor(w, h);
+  UpdateForeground(w, h);
+  m_foreground.Draw();
 
 #ifdef NEVER
   glDisable(GL_TEXTURE_2D);
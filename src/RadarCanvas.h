@@ -50,10 +50,34 @@ class RadarCanvas : public wxGLCanvas {
 
  private:
   void FillCursorTexture();
-  void RenderTexts(int w, int h);
-  void RenderRangeRingsAndHeading(int w, int h);
-  void RenderCursor(int w, int h);
-  void Render_EBL_VRM(int w, int h);
+  void BuildFonts();
+  void GetHeadingAndPredictor(double* heading, double* predictor);
+  bool GetCursorPosition(int w, int h, int* cursor_x, int* cursor_y);
+  void AddTexts(int w, int h);
+  void AddRangeRingsAndHeading(int w, int h, double heading, double predictor);
+  void AddCursor(int x, int y);
+  void Add_EBL_VRM(int w, int h);
+  void UpdateBackground(int w, int h);
+  void UpdateForeground(int w, int h);
+
+  // Everything the background list depends on, compared with memcmp
+  struct BackgroundState {
+    int w, h;
+    double heading, predictor;
+    const char* range[4];
+    int display_range;
+    double vrm[BEARING_LINES];
+    double ebl[BEARING_LINES];
+    unsigned int font;
+  };
+
+  // Everything the foreground list depends on besides the texts
+  struct ForegroundState {
+    int w, h;
+    bool cursor;
+    int cursor_x, cursor_y;
+    unsigned int font;
+  };
 
   wxWindow* m_parent;
   br24radar_pi* m_pi;
@@ -66,11 +90,22 @@ class RadarCanvas : public wxGLCanvas {
   TextureFont m_FontBig;
   TextureFont m_FontMenu;
   TextureFont m_FontMenuBold;
+  time_t m_fonts_time;  // When the fonts were last built
   wxSize m_menu_size;
   wxSize m_zoom_size;
 
   unsigned int m_cursor_texture;
 
+  DrawList m_background;  // Drawn below the radar image
+  BackgroundState m_background_state;
+  bool m_background_valid;
+  DrawList m_foreground;  // Drawn on top of the radar image
+  ForegroundState m_foreground_state;
+  bool m_foreground_valid;
+  wxString m_text_top_left;
+  wxString m_text_bottom_left;
+  wxString m_text_center;
+
   wxLongLong m_last_mousewheel_zoom_in;
   wxLongLong m_last_mousewheel_zoom_out;
 
@@ -32,6 +32,7 @@
 #include "RadarDrawShader.h"
 #include "drawutil.h"
 #include "shaderutil.h"
+#include "spokeutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
@@ -58,38 +59,86 @@ static const char *FragmentShaderText =
     "} \n";
 #endif
 
-static const char *FragmentShaderColorText =
-    "uniform sampler2D tex2d; \n"
-    "void main() \n"
+// Polar coordinates of the fragment, computed per pixel. The texture coordinates run from -1 to 1.
+static const char *FragmentShaderPolarText =
+    "vec2 Polar() \n"
     "{ \n"
     "   float d = length(gl_TexCoord[0].xy);\n"
     "   if (d >= 1.0) \n"
     "      discard; \n"
     "   float a = atan(gl_TexCoord[0].y, gl_TexCoord[0].x) / 6.28318; \n"
-    "   gl_FragColor = texture2D(tex2d, vec2(d, a)); \n"
+    "   return vec2(d, a); \n"
     "} \n";
 
-bool RadarDrawShader::Init() {
-  m_format = GL_RGBA;
-  m_channels = SHADER_COLOR_CHANNELS;
+// Same, looked up in the remap texture built by BuildRemap
+static const char *FragmentShaderRemapText =
+    "uniform sampler2D remap; \n"
+    "vec2 Polar() \n"
+    "{ \n"
+    "   vec4 polar = texture2D(remap, gl_TexCoord[0].xy * 0.5 + 0.5); \n"
+    "   return vec2(polar.x, polar.w); \n"
+    "} \n";
 
+static const char *FragmentShaderColorText =
+    "uniform sampler2D tex2d; \n"
+    "void main() \n"
+    "{ \n"
+    "   gl_FragColor = texture2D(tex2d, Polar()); \n"
+    "} \n";
+
+// Same, but the texture holds the strength and the colour comes from the palette
+static const char *FragmentShaderPaletteText =
+    "uniform sampler2D tex2d; \n"
+    "uniform sampler1D palette; \n"
+    "void main() \n"
+    "{ \n"
+    "   float strength = texture2D(tex2d, Polar()).x; \n"
+    "   gl_FragColor = texture1D(palette, strength * (255.0 / 256.0) + 0.5 / 256.0); \n"
+    "} \n";
+
+bool RadarDrawShader::Init() {
   if (!CompileShader && !ShadersSupported()) {
     wxLogError(wxT("BR24radar_pi: the OpenGL system of this computer does not support shader m_programs"));
     return false;
   }
 
-  if (!CompileShaderText(&m_vertex, GL_VERTEX_SHADER, VertexShaderText) ||
-      !CompileShaderText(&m_fragment, GL_FRAGMENT_SHADER, FragmentShaderColorText)) {
+  if (!CompileShaderText(&m_vertex, GL_VERTEX_SHADER, VertexShaderText)) {
     wxLogError(wxT("BR24radar_pi: the OpenGL system of this computer failed to compile shader programs"));
     return false;
   }
 
-  m_program = LinkShaders(m_vertex, m_fragment);
-  if (!m_program) {
-    wxLogError(wxT("BR24radar_pi: GPU oriented OpenGL failed to link shader program"));
+  // Prefer uploading the raw strength, a quarter of the RGBA texels, and colouring on the GPU, with
+  // the polar coordinates looked up instead of computed for every pixel.
+  if (BuildProgram(FragmentShaderRemapText, FragmentShaderPaletteText)) {
+    m_format = GL_LUMINANCE;
+    m_channels = SHADER_INDEX_CHANNELS;
+    m_remap_size = -1;
+  } else if (BuildProgram(FragmentShaderPolarText, FragmentShaderColorText)) {
+    m_format = GL_RGBA;
+    m_channels = SHADER_COLOR_CHANNELS;
+    m_remap_size = 0;
+  } else {
+    wxLogError(wxT("BR24radar_pi: GPU oriented OpenGL failed to compile or link shader programs"));
     return false;
   }
 
+  m_texture_uniform = GetUniformLocation(m_program, "tex2d");
+  m_palette_uniform = GetUniformLocation(m_program, "palette");
+  m_remap_uniform = GetUniformLocation(m_program, "remap");
+
+  if (m_channels == SHADER_INDEX_CHANNELS) {
+    if (!m_palette) {
+      glGenTextures(1, &m_palette);
+    }
+    ActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, m_palette);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA, SHADER_PALETTE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_palette_data);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    ActiveTexture(GL_TEXTURE0);
+  }
+
   if (!m_texture) {
     glGenTextures(1, &m_texture);
   }
@@ -104,8 +153,20 @@ bool RadarDrawShader::Init() {
                /* format          = */ m_format,
                /* type            = */ GL_UNSIGNED_BYTE,
                /* data            = */ m_data);
-  glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  // Interpolating strengths would give colours that are not in the palette
+  GLint filter = m_channels == SHADER_INDEX_CHANNELS ? GL_NEAREST : GL_LINEAR;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);  // Radius, the angle wraps
+
+  if (!m_pbo[0] && BuffersSupported()) {
+    GenBuffers(SHADER_PIXEL_BUFFERS, m_pbo);
+    for (int i = 0; i < SHADER_PIXEL_BUFFERS; i++) {
+      BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[i]);
+      BufferData(GL_PIXEL_UNPACK_BUFFER, LINES_PER_ROTATION * RETURNS_PER_LINE * m_channels, 0, GL_STREAM_DRAW);
+    }
+    BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
 
   m_start_line = -1;
   m_end_line = 0;
@@ -113,6 +174,24 @@ bool RadarDrawShader::Init() {
   return true;
 }
 
+// Compiles the fragment shader from the two parts and links it with m_vertex into m_program. When that
+// fails the shader objects it created are deleted again, so that the caller can try other parts.
+bool RadarDrawShader::BuildProgram(const char* first, const char* second) {
+  wxString fragment = wxString::FromAscii(first) + wxString::FromAscii(second);
+
+  if (CompileShaderText(&m_fragment, GL_FRAGMENT_SHADER, fragment.mb_str())) {
+    m_program = LinkShaders(m_vertex, m_fragment);
+    if (m_program) {
+      return true;
+    }
+  }
+  if (m_fragment) {
+    DeleteShader(m_fragment);
+    m_fragment = 0;
+  }
+  return false;
+}
+
 RadarDrawShader::~RadarDrawShader() {
   wxCriticalSectionLocker lock(m_exclusive);
 
@@ -132,10 +211,138 @@ RadarDrawShader::~RadarDrawShader() {
     glDeleteTextures(1, &m_texture);
     m_texture = 0;
   }
+  if (m_palette) {
+    glDeleteTextures(1, &m_palette);
+    m_palette = 0;
+  }
+  if (m_remap) {
+    glDeleteTextures(1, &m_remap);
+    m_remap = 0;
+  }
+  if (m_pbo[0]) {
+    DeleteBuffers(SHADER_PIXEL_BUFFERS, m_pbo);
+    memset(m_pbo, 0, sizeof(m_pbo));
+  }
+}
+
+// Upload the palette, only when the colours, thresholds or transparency have changed
+void RadarDrawShader::UpdatePalette(GLubyte alpha) {
+  UINT8 strength[SHADER_PALETTE_SIZE];
+  unsigned char palette[sizeof(m_palette_data)];
+
+  for (int i = 0; i < SHADER_PALETTE_SIZE; i++) {
+    strength[i] = (UINT8)i;
+  }
+  SpokeToRGBA(palette, strength, SHADER_PALETTE_SIZE, m_ri->m_colour_map, m_ri->m_colour_map_rgb, alpha);
+
+  ActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_1D, m_palette);
+  if (memcmp(palette, m_palette_data, sizeof(palette)) != 0) {
+    memcpy(m_palette_data, palette, sizeof(palette));
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, SHADER_PALETTE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, m_palette_data);
+  }
+  ActiveTexture(GL_TEXTURE0);
+}
+
+// Store the polar coordinates (radius, angle) of each texel of a size x size square around the radar,
+// so the fragment shader does not have to compute them. Size follows the viewport, but is never below
+// SHADER_REMAP_MIN as that is already finer than the spokes and returns at the edge of the circle.
+void RadarDrawShader::UpdateRemap() {
+  GLint viewport[4];
+  int size = SHADER_REMAP_MIN;
+
+  glGetIntegerv(GL_VIEWPORT, viewport);
+  while (size < wxMax(viewport[2], viewport[3]) && size < SHADER_REMAP_MAX) {
+    size *= 2;
+  }
+
+  ActiveTexture(GL_TEXTURE2);
+  if (!m_remap) {
+    glGenTextures(1, &m_remap);
+  }
+  glBindTexture(GL_TEXTURE_2D, m_remap);
+
+  if (size != m_remap_size) {
+    GLushort *remap = (GLushort *)malloc(size * size * 2 * sizeof(GLushort));
+
+    if (remap) {
+      GLushort *p = remap;
+      for (int i = 0; i < size; i++) {
+        double y = (i + 0.5) * 2.0 / size - 1.0;
+        for (int j = 0; j < size; j++) {
+          double x = (j + 0.5) * 2.0 / size - 1.0;
+          double a = atan2(y, x) / (2 * PI);
+
+          *p++ = (GLushort)(wxMin(sqrt(x * x + y * y), 1.0) * 65535);
+          *p++ = (GLushort)((a < 0 ? a + 1.0 : a) * 65535);
+        }
+      }
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE16_ALPHA16, size, size, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_SHORT, remap);
+      // Interpolating would go wrong where the angle wraps from 1 to 0
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      free(remap);
+      m_remap_size = size;
+    }
+  }
+  ActiveTexture(GL_TEXTURE0);
+}
+
+// Copy the lines [start_line, end_line> of m_data to the same place in dest
+void RadarDrawShader::CopyLines(unsigned char *dest, int start_line, int end_line) {
+  size_t line_size = RETURNS_PER_LINE * m_channels;
+
+  if (end_line < start_line) {
+    memcpy(dest, m_data, end_line * line_size);
+    end_line = LINES_PER_ROTATION;
+  }
+  memcpy(dest + start_line * line_size, m_data + start_line * line_size, (end_line - start_line) * line_size);
+}
+
+// Copy the lines into the next pixel buffer and leave it bound, so that glTexSubImage2D returns without
+// waiting for the transfer. The buffer used three frames ago is normally done by now, so mapping does not stall.
+// Returns the pixels argument for UploadLines: an offset in the buffer, or m_data if it cannot be mapped.
+const unsigned char *RadarDrawShader::FillPixelBuffer(int start_line, int end_line) {
+  m_pbo_next = (m_pbo_next + 1) % SHADER_PIXEL_BUFFERS;
+  BindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pbo[m_pbo_next]);
+
+  unsigned char *buffer = (unsigned char *)MapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+  if (!buffer) {
+    BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    return m_data;
+  }
+  CopyLines(buffer, start_line, end_line);
+  if (!UnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+    BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);  // Contents were lost, try again next frame with m_data
+    return m_data;
+  }
+  return 0;
+}
+
+// Update the texture for the lines [start_line, end_line>, which may wrap past the end of the texture
+void RadarDrawShader::UploadLines(const unsigned char *pixels, int start_line, int end_line) {
+  if (end_line < start_line) {
+    // First remap [0, end_line> and then [start_line, LINES_PER_ROTATION>
+    UploadLines(pixels, 0, end_line);
+    end_line = LINES_PER_ROTATION;
+  }
+  glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
+                  /* level =    */ 0,
+                  /* x-offset = */ 0,
+                  /* y-offset = */ start_line,
+                  /* width =    */ RETURNS_PER_LINE,
+                  /* height =   */ end_line - start_line,
+                  /* format =   */ m_format,
+                  /* type =     */ GL_UNSIGNED_BYTE,
+                  /* pixels =   */ pixels + start_line * RETURNS_PER_LINE * m_channels);
 }
 
 void RadarDrawShader::DrawRadarImage() {
-  wxCriticalSectionLocker lock(m_exclusive);
+  int start_line = -1;
+  int end_line = 0;
+  GLubyte alpha;
 
   if (!m_program || !m_texture) {
     return;
@@ -145,62 +352,55 @@ void RadarDrawShader::DrawRadarImage() {
 
   UseProgram(m_program);
 
+  Uniform1i(m_texture_uniform, 0);
+  Uniform1i(m_palette_uniform, 1);
+  Uniform1i(m_remap_uniform, 2);
+  if (m_remap_size) {
+    UpdateRemap();
+  }
   glBindTexture(GL_TEXTURE_2D, m_texture);
 
-  if (m_start_line > -1) {
-    // Since the last time we have received data from [m_start_line, m_end_line>
-    // so we only need to update the texture for those data lines.
-    if (m_end_line < m_start_line) {
-      // if the new data wraps past the end of the texture
-      // tell it the two parts separately
-      // First remap [0, m_end_line>
-      glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
-                      /* level =    */ 0,
-                      /* x-offset = */ 0,
-                      /* y-offset = */ 0,
-                      /* width =    */ RETURNS_PER_LINE,
-                      /* height =   */ m_end_line,
-                      /* format =   */ m_format,
-                      /* type =     */ GL_UNSIGNED_BYTE,
-                      /* pixels =   */ m_data);
-      // And then remap [m_start_line, LINES_PER_ROTATION>
-      glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
-                      /* level =    */ 0,
-                      /* x-offset = */ 0,
-                      /* y-offset = */ m_start_line,
-                      /* width =    */ RETURNS_PER_LINE,
-                      /* height =   */ LINES_PER_ROTATION - m_start_line,
-                      /* format =   */ m_format,
-                      /* type =     */ GL_UNSIGNED_BYTE,
-                      /* pixels =   */ m_data + m_start_line * RETURNS_PER_LINE * m_channels);
-    } else {
-      // Remap [m_start_line, m_end_line>
-      glTexSubImage2D(/* target =   */ GL_TEXTURE_2D,
-                      /* level =    */ 0,
-                      /* x-offset = */ 0,
-                      /* y-offset = */ m_start_line,
-                      /* width =    */ RETURNS_PER_LINE,
-                      /* height =   */ m_end_line - m_start_line,
-                      /* format =   */ m_format,
-                      /* type =     */ GL_UNSIGNED_BYTE,
-                      /* pixels =   */ m_data + m_start_line * RETURNS_PER_LINE * m_channels);
+  {
+    // The process thread can write any line at any time, also one that is being copied after an angle
+    // jump or a whole rotation between two frames, so m_data is only read with the lock held. With a
+    // pixel buffer that is just the copy into it; the transfer to the texture happens after the lock.
+    wxCriticalSectionLocker lock(m_exclusive);
+
+    alpha = m_alpha;
+    if (m_start_line > -1) {
+      // Since the last time we have received data from [start_line, end_line>
+      // so we only need to update the texture for those data lines.
+      start_line = m_start_line;
+      end_line = m_end_line;
+      m_start_line = -1;
+      m_end_line = 0;
+
+      if (!m_pbo[0] || FillPixelBuffer(start_line, end_line) == m_data) {
+        UploadLines(m_data, start_line, end_line);
+        start_line = -1;
+      }
     }
-    m_start_line = -1;
-    m_end_line = 0;
+  }
+  if (start_line > -1) {
+    UploadLines(0, start_line, end_line);  // From the pixel buffer that FillPixelBuffer left bound
+    BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  }
+  if (m_palette) {
+    UpdatePalette(alpha);
   }
 
-  // We tell the GPU to draw a square from (-512,-512) to (+512,+512).
-  // The shader morphs this into a circle.
+  // We tell the GPU to draw a circle with radius 512 around (0, 0), so that the pixels outside the
+  // radar image are not even passed to the fragment shader.
   float fullscale = 512;
-  glBegin(GL_QUADS);
-  glTexCoord2f(-1, -1);
-  glVertex2f(-fullscale, -fullscale);
-  glTexCoord2f(1, -1);
-  glVertex2f(fullscale, -fullscale);
-  glTexCoord2f(1, 1);
-  glVertex2f(fullscale, fullscale);
-  glTexCoord2f(-1, 1);
-  glVertex2f(-fullscale, fullscale);
+  glBegin(GL_TRIANGLE_FAN);
+  glTexCoord2f(0, 0);
+  glVertex2f(0, 0);
+  for (int i = 0; i <= SHADER_CIRCLE_SEGMENTS; i++) {
+    float x = cosf(i * 2 * PI / SHADER_CIRCLE_SEGMENTS);
+    float y = sinf(i * 2 * PI / SHADER_CIRCLE_SEGMENTS);
+    glTexCoord2f(x, y);
+    glVertex2f(x * fullscale, y * fullscale);
+  }
   glEnd();
 
   UseProgram(0);
@@ -217,23 +417,10 @@ void RadarDrawShader::ProcessRadarSpoke(int transparency, SpokeBearing angle, UI
   m_end_line = angle + 1;  // whereas this keeps running every draw operation
 
   if (m_channels == SHADER_COLOR_CHANNELS) {
-    unsigned char *d = m_data + (angle * RETURNS_PER_LINE) * m_channels;
-    for (size_t r = 0; r < len; r++) {
-      GLubyte strength = data[r];
-      BlobColour colour = m_ri->m_colour_map[strength];
-      d[0] = m_ri->m_colour_map_rgb[colour].Red();
-      d[1] = m_ri->m_colour_map_rgb[colour].Green();
-      d[2] = m_ri->m_colour_map_rgb[colour].Blue();
-      d[3] = colour != BLOB_NONE ? alpha : 0;
-      d += m_channels;
-    }
+    SpokeToRGBA(m_data + (angle * RETURNS_PER_LINE) * m_channels, data, len, m_ri->m_colour_map, m_ri->m_colour_map_rgb, alpha);
   } else {
-    unsigned char *d = m_data + (angle * RETURNS_PER_LINE);
-    for (size_t r = 0; r < len; r++) {
-      GLubyte strength = data[r];
-      BlobColour colour = m_ri->m_colour_map[strength];
-      *d++ = (m_ri->m_colour_map_rgb[colour].Red() * alpha) >> 8;
-    }
+    memcpy(m_data + angle * RETURNS_PER_LINE, data, len);
+    m_alpha = alpha;
   }
 }
 
@@ -37,6 +37,12 @@
 PLUGIN_BEGIN_NAMESPACE
 
 #define SHADER_COLOR_CHANNELS (4)  // RGB + Alpha
+#define SHADER_INDEX_CHANNELS (1)  // Raw strength, the fragment shader looks up the colour
+#define SHADER_PALETTE_SIZE (UINT8_MAX + 1)
+#define SHADER_PIXEL_BUFFERS (3)      // Triple buffered texture uploads
+#define SHADER_REMAP_MIN (1024)       // Smallest remap texture, in texels per side
+#define SHADER_REMAP_MAX (2048)       // Largest remap texture
+#define SHADER_CIRCLE_SEGMENTS (256)  // Edge is less than 0.05 pixel inside the circle
 
 class RadarDrawShader : public RadarDraw {
  public:
@@ -48,9 +54,16 @@ class RadarDrawShader : public RadarDraw {
     m_fragment = 0;
     m_vertex = 0;
     m_program = 0;
+    m_palette = 0;
+    m_remap = 0;
+    m_remap_size = 0;
+    memset(m_pbo, 0, sizeof(m_pbo));
+    m_pbo_next = 0;
     m_format = GL_RGBA;
     m_channels = SHADER_COLOR_CHANNELS;
+    m_alpha = 255;
     memset(m_data, 0, sizeof(m_data));
+    memset(m_palette_data, 0, sizeof(m_palette_data));
   }
 
   ~RadarDrawShader();
@@ -60,12 +73,20 @@ class RadarDrawShader : public RadarDraw {
   void ProcessRadarSpoke(int transparency, SpokeBearing angle, UINT8* data, size_t len);
 
  private:
+  bool BuildProgram(const char* first, const char* second);
+  void UpdatePalette(GLubyte alpha);
+  void UpdateRemap();
+  void CopyLines(unsigned char* dest, int start_line, int end_line);
+  const unsigned char* FillPixelBuffer(int start_line, int end_line);
+  void UploadLines(const unsigned char* pixels, int start_line, int end_line);
+
   RadarInfo* m_ri;
 
-  wxCriticalSection m_exclusive;  // protects the following three data structures
+  wxCriticalSection m_exclusive;  // protects the following
   unsigned char m_data[SHADER_COLOR_CHANNELS * LINES_PER_ROTATION * RETURNS_PER_LINE];
   int m_start_line;
   int m_end_line;
+  GLubyte m_alpha;  // Of the last spoke, used for the palette
 
   int m_format;
   int m_channels;
@@ -74,6 +95,18 @@ class RadarDrawShader : public RadarDraw {
   GLuint m_fragment;
   GLuint m_vertex;
   GLuint m_program;
+
+  GLuint m_palette;  // 1D RGBA texture indexed by strength, 0 when RGBA texels are uploaded instead
+  GLint m_palette_uniform;
+  GLint m_texture_uniform;
+
+  GLuint m_remap;    // 2D (radius, angle) texture for the fragment shader
+  int m_remap_size;  // 0 when the shader computes the polar coordinates, -1 until it is built
+  GLint m_remap_uniform;
+  unsigned char m_palette_data[SHADER_PALETTE_SIZE * SHADER_COLOR_CHANNELS];  // What the GPU has
+
+  GLuint m_pbo[SHADER_PIXEL_BUFFERS];  // Pixel unpack buffers, 0 when not supported
+  int m_pbo_next;
 };
 
 PLUGIN_END_NAMESPACE
@@ -30,149 +30,487 @@
  */
 
 #include "RadarDrawVertex.h"
+#include "shaderutil.h"
+#include "spokeutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
-bool RadarDrawVertex::Init() { return true; }
+// Expands a SpokeCompactVertex (arc, radius + 1024 * colour) into a position and a colour.
+static const char* CompactVertexShaderText =
+    "uniform vec3 colours[64]; \n"
+    "uniform float alpha; \n"
+    "attribute vec2 blob; \n"
+    "void main() \n"
+    "{ \n"
+    "   float colour = floor(blob.y / 1024.0); \n"
+    "   float radius = blob.y - colour * 1024.0; \n"
+    "   float a = blob.x * (6.28318531 / 2048.0); \n"
+    "   gl_Position = gl_ModelViewProjectionMatrix * vec4(radius * cos(a), radius * sin(a), 0.0, 1.0); \n"
+    "   gl_FrontColor = vec4(colours[int(colour)], alpha); \n"
+    "} \n";
 
-#define ADD_VERTEX_POINT(angle, radius, r, g, b, a)          \
-  {                                                          \
-    line->points[count].x = m_polarLookup->x[angle][radius]; \
-    line->points[count].y = m_polarLookup->y[angle][radius]; \
-    line->points[count].red = r;                             \
-    line->points[count].green = g;                           \
-    line->points[count].blue = b;                            \
-    line->points[count].alpha = a;                           \
-    count++;                                                 \
-  }
+static const char* CompactFragmentShaderText =
+    "void main() \n"
+    "{ \n"
+    "   gl_FragColor = gl_Color; \n"
+    "} \n";
 
-void RadarDrawVertex::SetBlob(VertexLine* line, int angle_begin, int angle_end, int r1, int r2, GLubyte red, GLubyte green,
-                              GLubyte blue, GLubyte alpha) {
-  if (r2 == 0) {
-    return;
+// Compile the compact vertex program, returns false if the OpenGL system cannot run it.
+bool RadarDrawVertex::InitCompact() {
+  if (!CompileShader && !ShadersSupported()) {
+    return false;
   }
-  int arc1 = MOD_ROTATION2048(angle_begin);
-  int arc2 = MOD_ROTATION2048(angle_end);
-  size_t count = line->count;
-
-  if (line->count + VERTEX_PER_QUAD > line->allocated) {
-    const size_t extra = 8 * VERTEX_PER_QUAD;
-    line->points = (VertexPoint*)realloc(line->points, (line->allocated + extra) * sizeof(VertexPoint));
-    line->allocated += extra;
-    m_count += extra;
+  if (SPOKE_COMPACT_RADIUS != 1024 || BLOB_COLOURS > 64 || LINES_PER_ROTATION != 2048) {
+    return false;  // The shader text would have to change
+  }
+  if (!CompileShaderText(&m_vertex, GL_VERTEX_SHADER, CompactVertexShaderText) ||
+      !CompileShaderText(&m_fragment, GL_FRAGMENT_SHADER, CompactFragmentShaderText)) {
+    return false;
   }
+  m_program = LinkShaders(m_vertex, m_fragment);
+  if (!m_program) {
+    return false;
+  }
+  m_blob_attribute = GetAttribLocation(m_program, "blob");
+  m_colours_uniform = GetUniformLocation(m_program, "colours");
+  m_alpha_uniform = GetUniformLocation(m_program, "alpha");
+  return m_blob_attribute >= 0;
+}
+
+bool RadarDrawVertex::Init() {
+  wxCriticalSectionLocker lock(m_exclusive);
 
-  if (!line->points) {
-    if (!m_oom) {
+  if (!m_ring) {
+    m_compact = InitCompact();
+    m_vertex_size = m_compact ? sizeof(CompactPoint) : sizeof(VertexPoint);
+    m_ring = (UINT8*)malloc(BUFFER_SIZE_MIN * m_vertex_size);
+    if (!m_ring) {
       wxLogError(wxT("BR24radar_pi: Out of memory"));
-      m_oom = true;
+      return false;
     }
-    return;
+    m_ring_size = BUFFER_SIZE_MIN;
   }
 
-  // First triangle
-  ADD_VERTEX_POINT(arc1, r1, red, green, blue, alpha);
-  ADD_VERTEX_POINT(arc1, r2, red, green, blue, alpha);
-  ADD_VERTEX_POINT(arc2, r1, red, green, blue, alpha);
+  if (!m_vbo && BuffersSupported()) {
+    GenBuffers(1, &m_vbo);
+    BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    BufferData(GL_ARRAY_BUFFER, m_ring_size * m_vertex_size, 0, GL_STREAM_DRAW);
+    BindBuffer(GL_ARRAY_BUFFER, 0);
+    m_vbo_size = m_ring_size;
+    m_ring_uploaded = 0;
+  }
+  m_multi_draw = MultiDrawArrays != 0;
 
-  // Second triangle
+  if (!m_fbo && m_vbo && FramebuffersSupported()) {
+    InitFramebuffer();
+  }
+  return true;
+}
 
-  ADD_VERTEX_POINT(arc2, r1, red, green, blue, alpha);
-  ADD_VERTEX_POINT(arc1, r2, red, green, blue, alpha);
-  ADD_VERTEX_POINT(arc2, r2, red, green, blue, alpha);
+// Create the retained image, returns false (and leaves m_fbo 0) if the OpenGL system cannot draw into it
+bool RadarDrawVertex::InitFramebuffer() {
+  GLint previous;
 
-  line->count = count;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  glPushAttrib(GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT);
+
+  glGenTextures(1, &m_fbo_texture);
+  glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, FRAMEBUFFER_SIZE, FRAMEBUFFER_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  GenFramebuffers(1, &m_fbo);
+  BindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_fbo_texture, 0);
+  bool complete = CheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+  if (complete) {
+    glClearColor(0, 0, 0, 0);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  BindFramebuffer(GL_FRAMEBUFFER, previous);
+  glPopAttrib();
+
+  if (!complete) {
+    DeleteFramebuffers(1, &m_fbo);
+    glDeleteTextures(1, &m_fbo_texture);
+    m_fbo = 0;
+    m_fbo_texture = 0;
+    return false;
+  }
+  m_redraw = true;
+  return true;
+}
+
+RadarDrawVertex::~RadarDrawVertex() {
+  wxCriticalSectionLocker lock(m_exclusive);
+
+  if (m_vbo) {
+    DeleteBuffers(1, &m_vbo);
+    m_vbo = 0;
+  }
+  if (m_fbo) {
+    DeleteFramebuffers(1, &m_fbo);
+    glDeleteTextures(1, &m_fbo_texture);
+    m_fbo = 0;
+    m_fbo_texture = 0;
+  }
+  if (m_ring) {
+    free(m_ring);
+    m_ring = 0;
+  }
+  if (m_vertex) {
+    DeleteShader(m_vertex);
+    m_vertex = 0;
+  }
+  if (m_fragment) {
+    DeleteShader(m_fragment);
+    m_fragment = 0;
+  }
+  if (m_program) {
+    DeleteProgram(m_program);
+    m_program = 0;
+  }
 }
 
 void RadarDrawVertex::ProcessRadarSpoke(int transparency, SpokeBearing angle, UINT8* data, size_t len) {
-  wxColour colour;
   GLubyte alpha = 255 * (MAX_OVERLAY_TRANSPARENCY - transparency) / MAX_OVERLAY_TRANSPARENCY;
-  BlobColour previous_colour = BLOB_NONE;
-  GLubyte strength = 0;
   time_t now = time(0);
 
   wxCriticalSectionLocker lock(m_exclusive);
 
-  int r_begin = 0;
-  int r_end = 0;
-
-  if (angle < 0 || angle >= LINES_PER_ROTATION) {
+  if (angle < 0 || angle >= LINES_PER_ROTATION || !m_ring) {
     return;
   }
 
+  size_t needed = len * (m_compact ? SPOKE_COMPACT_VERTEX_PER_QUAD : VERTEX_PER_QUAD);  // Worst case: every return is a blob
+
+  if (m_ring_size < BUFFER_SIZE_MAX && RingFull(angle, needed)) {
+    GrowRing();
+  }
+
+  size_t offset = (size_t)(m_ring_head % m_ring_size);
+
+  if (offset + needed > m_ring_size) {
+    // Lines are never split, continue at the start of the ring
+    m_ring_head += m_ring_size - offset;
+    offset = 0;
+  }
+
   VertexLine* line = &m_vertices[angle];
 
-  if (!line->points) {
-    static size_t INITIAL_ALLOCATION = 600;  // Empirically found to be enough for a complicated picture
-    line->allocated = INITIAL_ALLOCATION * VERTEX_PER_QUAD;
-    m_count += INITIAL_ALLOCATION * VERTEX_PER_QUAD;
-    line->points = (VertexPoint*)malloc(line->allocated * sizeof(VertexPoint));
-    if (!line->points) {
-      if (!m_oom) {
-        wxLogError(wxT("BR24radar_pi: Out of memory"));
-        m_oom = true;
-      }
-      line->allocated = 0;
+  line->first = m_ring_head;
+  line->dirty = true;
+  line->timeout = now + m_ri->m_pi->m_settings.max_age;
+  if (m_compact) {
+    line->count = SpokeToCompactVertices((CompactPoint*)m_ring + offset, angle, data, len, m_ri->m_colour_map);
+    m_alpha = alpha;
+  } else {
+    line->count = SpokeToVertices((VertexPoint*)m_ring + offset, angle, data, len, m_ri->m_colour_map, m_ri->m_colour_map_rgb,
+                                  alpha, m_polarLookup);
+  }
+  m_ring_head += line->count;
+}
+
+// Whether writing a line of at most needed vertices would overwrite the line of the next spoke. In a
+// normal sweep that is the oldest line still shown, so the ring holds less than a rotation.
+// Called with m_exclusive held.
+bool RadarDrawVertex::RingFull(SpokeBearing angle, size_t needed) {
+  VertexLine* next = &m_vertices[MOD_ROTATION2048(angle + 1)];
+  wxLongLong_t end = m_ring_head + needed;
+  size_t offset = (size_t)(m_ring_head % m_ring_size);
+
+  if (offset + needed > m_ring_size) {
+    end += m_ring_size - offset;
+  }
+  return next->count && !TIMED_OUT(time(0), next->timeout) && m_ring_head - next->first <= (wxLongLong_t)m_ring_size &&
+         next->first < end - (wxLongLong_t)m_ring_size;
+}
+
+// Double the ring, up to BUFFER_SIZE_MAX. The lines that are still in it are copied to the start of the
+// new ring in the same order, so their positions move down by the same amount. When there is no memory
+// the ring stays as it is and keeps overwriting the oldest lines. Called with m_exclusive held.
+void RadarDrawVertex::GrowRing() {
+  size_t size = m_ring_size * 2;
+
+  if (size > BUFFER_SIZE_MAX) {
+    size = BUFFER_SIZE_MAX;
+  }
+  UINT8* ring = (UINT8*)malloc(size * m_vertex_size);
+  if (!ring) {
+    return;
+  }
+
+  wxLongLong_t base = m_ring_head - (wxLongLong_t)m_ring_size;
+  if (base < 0) {
+    base = 0;
+  }
+  for (wxLongLong_t position = base; position < m_ring_head;) {
+    size_t offset = (size_t)(position % m_ring_size);
+    size_t n = (size_t)(m_ring_head - position);
+
+    if (n > m_ring_size - offset) {
+      n = m_ring_size - offset;
+    }
+    memcpy(ring + (size_t)(position - base) * m_vertex_size, m_ring + offset * m_vertex_size, n * m_vertex_size);
+    position += n;
+  }
+  for (size_t i = 0; i < LINES_PER_ROTATION; i++) {
+    VertexLine* line = &m_vertices[i];
+
+    if (line->first < base) {  // Overwritten already
+      line->first = 0;
       line->count = 0;
-      return;
+    } else {
+      line->first -= base;
     }
   }
-  line->count = 0;
-  line->timeout = now + m_ri->m_pi->m_settings.max_age;
 
-  for (size_t radius = 0; radius < len; radius++) {
-    strength = data[radius];
-    BlobColour actual_colour = m_ri->m_colour_map[strength];
-
-    if (actual_colour == previous_colour) {
-      // continue with same color, just register it
-      r_end++;
-    } else if (previous_colour == BLOB_NONE && actual_colour != BLOB_NONE) {
-      // blob starts, no display, just register
-      r_begin = radius;
-      r_end = r_begin + 1;
-      previous_colour = actual_colour;  // new color
-    } else if (previous_colour != BLOB_NONE && (previous_colour != actual_colour)) {
-      colour = m_ri->m_colour_map_rgb[previous_colour];
-
-      SetBlob(line, angle, angle + 1, r_begin, r_end, colour.Red(), colour.Green(), colour.Blue(), alpha);
-
-      previous_colour = actual_colour;
-      if (actual_colour != BLOB_NONE) {  // change of color, start new blob
-        r_begin = radius;
-        r_end = r_begin + 1;
+  free(m_ring);
+  m_ring = ring;
+  m_ring_size = size;
+  m_ring_head -= base;
+  m_ring_uploaded = 0;  // Upload all of it again
+}
+
+// Copy the part of the ring that was written since the last upload into the vertex buffer
+void RadarDrawVertex::UploadRing() {
+  wxLongLong_t position = m_ring_uploaded;
+
+  if (m_vbo_size != m_ring_size) {  // The ring has grown
+    BufferData(GL_ARRAY_BUFFER, m_ring_size * m_vertex_size, 0, GL_STREAM_DRAW);
+    m_vbo_size = m_ring_size;
+    position = 0;
+  }
+  if (m_ring_head - position > (wxLongLong_t)m_ring_size) {
+    position = m_ring_head - m_ring_size;
+  }
+  while (position < m_ring_head) {
+    size_t offset = (size_t)(position % m_ring_size);
+    size_t n = (size_t)(m_ring_head - position);
+
+    if (n > m_ring_size - offset) {
+      n = m_ring_size - offset;
+    }
+    BufferSubData(GL_ARRAY_BUFFER, offset * m_vertex_size, n * m_vertex_size, m_ring + offset * m_vertex_size);
+    position += n;
+  }
+  m_ring_uploaded = m_ring_head;
+}
+
+// The colour map can change at any time, so the compact colours are checked every frame.
+// Returns true if they changed.
+bool RadarDrawVertex::UpdateColours() {
+  GLfloat colours[BLOB_COLOURS * 3];
+
+  for (int i = 0; i < BLOB_COLOURS; i++) {
+    colours[i * 3 + 0] = m_ri->m_colour_map_rgb[i].Red() / 255.0f;
+    colours[i * 3 + 1] = m_ri->m_colour_map_rgb[i].Green() / 255.0f;
+    colours[i * 3 + 2] = m_ri->m_colour_map_rgb[i].Blue() / 255.0f;
+  }
+  if (memcmp(colours, m_colours, sizeof(colours)) == 0) {
+    return false;
+  }
+  memcpy(m_colours, colours, sizeof(colours));
+  return true;
+}
+
+// Fill m_draw_first and m_draw_count with the lines to draw and return how many there are. Without
+// a framebuffer these are all live lines. With one, only the lines that changed; for those a wedge
+// that clears the old line is put in m_wedges as well. Call with m_exclusive held.
+GLsizei RadarDrawVertex::CollectLines(GLsizei* wedges) {
+  GLsizei lines = 0;
+  time_t now = time(0);
+
+  *wedges = 0;
+  for (size_t i = 0; i < LINES_PER_ROTATION; i++) {
+    VertexLine* line = &m_vertices[i];
+    bool live = line->count && !TIMED_OUT(now, line->timeout) && m_ring_head - line->first <= (wxLongLong_t)m_ring_size;
+
+    if (m_fbo) {
+      if (!m_redraw && !line->dirty && (live || !line->drawn)) {
+        continue;  // Unchanged in the framebuffer
       }
+      GLfloat* wedge = m_wedges + *wedges * 3 * 2;
+      int arc1 = (int)i;
+      int arc2 = MOD_ROTATION2048(arc1 + 1);
+
+      wedge[0] = 0;
+      wedge[1] = 0;
+      wedge[2] = m_polarLookup->X(arc1, RETURNS_PER_LINE + 1);
+      wedge[3] = m_polarLookup->Y(arc1, RETURNS_PER_LINE + 1);
+      wedge[4] = m_polarLookup->X(arc2, RETURNS_PER_LINE + 1);
+      wedge[5] = m_polarLookup->Y(arc2, RETURNS_PER_LINE + 1);
+      (*wedges)++;
+      line->dirty = false;
+      line->drawn = live;
+    }
+    if (live) {
+      m_draw_first[lines] = (GLint)(line->first % m_ring_size);
+      m_draw_count[lines] = (GLsizei)line->count;
+      lines++;
     }
   }
+  m_redraw = false;
+  return lines;
+}
 
-  if (previous_colour != BLOB_NONE) {  // Draw final blob
-    colour = m_ri->m_colour_map_rgb[previous_colour];
+// Draw the collected lines, with m_vbo bound if there is one. With a buffer bound the pointers are offsets into it.
+void RadarDrawVertex::DrawLines(const UINT8* points, GLsizei lines, GLubyte alpha) {
+  GLenum mode = GL_TRIANGLES;
+
+  if (m_compact) {
+    GLfloat a = alpha / 255.0f;
+
+    mode = GL_QUADS;
+    UseProgram(m_program);
+    Uniform3fv(m_colours_uniform, BLOB_COLOURS, m_colours);
+    Uniform1fv(m_alpha_uniform, 1, &a);
+    EnableVertexAttribArray(m_blob_attribute);
+    VertexAttribPointer(m_blob_attribute, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(CompactPoint), points);
+  } else {
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, sizeof(VertexPoint), points + offsetof(VertexPoint, x));
+    glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(VertexPoint), points + offsetof(VertexPoint, red));
+  }
+  if (m_multi_draw) {
+    MultiDrawArrays(mode, m_draw_first, m_draw_count, lines);
+  } else {
+    for (GLsizei i = 0; i < lines; i++) {
+      glDrawArrays(mode, m_draw_first[i], m_draw_count[i]);
+    }
+  }
 
-    SetBlob(line, angle, angle + 1, r_begin, r_end, colour.Red(), colour.Green(), colour.Blue(), alpha);
+  if (m_compact) {
+    DisableVertexAttribArray(m_blob_attribute);
+    UseProgram(0);
+  } else {
+    glDisableClientState(GL_VERTEX_ARRAY);  // disable vertex arrays
+    glDisableClientState(GL_COLOR_ARRAY);
   }
 }
 
-void RadarDrawVertex::DrawRadarImage() {
+// Clear the wedges and draw the lines in the framebuffer, in radar coordinates and without blending
+// so that the transparency is kept in the texture.
+void RadarDrawVertex::UpdateFramebuffer(const UINT8* points, GLsizei lines, GLsizei wedges, GLubyte alpha) {
+  GLint previous;
+
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+  glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT | GL_CURRENT_BIT);
+  BindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+  glViewport(0, 0, FRAMEBUFFER_SIZE, FRAMEBUFFER_SIZE);
+  glDisable(GL_BLEND);
+  glDisable(GL_SCISSOR_TEST);
+  glDisable(GL_STENCIL_TEST);
+  glDisable(GL_DEPTH_TEST);
+
+  glMatrixMode(GL_PROJECTION);
+  glPushMatrix();
+  glLoadIdentity();
+  glOrtho(-RETURNS_PER_LINE, RETURNS_PER_LINE, -RETURNS_PER_LINE, RETURNS_PER_LINE, -1, 1);
+  glMatrixMode(GL_MODELVIEW);
+  glPushMatrix();
+  glLoadIdentity();
+
+  glColor4ub(0, 0, 0, 0);
   glEnableClientState(GL_VERTEX_ARRAY);
-  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, 0, m_wedges);
+  glDrawArrays(GL_TRIANGLES, 0, wedges * 3);
+  glDisableClientState(GL_VERTEX_ARRAY);
+
+  if (lines > 0) {
+    if (m_vbo) {
+      BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    }
+    DrawLines(points, lines, alpha);
+    if (m_vbo) {
+      BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+  }
+
+  glMatrixMode(GL_PROJECTION);
+  glPopMatrix();
+  glMatrixMode(GL_MODELVIEW);
+  glPopMatrix();
+
+  BindFramebuffer(GL_FRAMEBUFFER, previous);
+  glPopAttrib();
+}
+
+void RadarDrawVertex::DrawRadarImage() {
+  GLsizei lines;
+  GLsizei wedges;
+  GLubyte alpha;
+
+  if (!m_ring) {  // Init() failed
+    return;
+  }
+
+  if (!m_vbo) {
+    // GL reads the lines straight from m_ring, which the process thread keeps rewriting
+    wxCriticalSectionLocker lock(m_exclusive);
+
+    lines = CollectFrame(&wedges, &alpha);
+    DrawFrame(m_ring, lines, wedges, alpha);
+    return;
+  }
 
-  time_t now = time(0);
   {
     wxCriticalSectionLocker lock(m_exclusive);
 
-    for (size_t i = 0; i < LINES_PER_ROTATION; i++) {
-      VertexLine* line = &m_vertices[i];
-      if (!line->count || TIMED_OUT(now, line->timeout)) {
-        continue;
-      }
+    BindBuffer(GL_ARRAY_BUFFER, m_vbo);
+    UploadRing();
+    BindBuffer(GL_ARRAY_BUFFER, 0);
+    lines = CollectFrame(&wedges, &alpha);
+  }
+  DrawFrame(0, lines, wedges, alpha);
+}
+
+// Collect the lines to draw and the alpha to draw them with. Called with m_exclusive held.
+GLsizei RadarDrawVertex::CollectFrame(GLsizei* wedges, GLubyte* alpha) {
+  *alpha = m_alpha;
+  if (m_compact && (UpdateColours() || *alpha != m_drawn_alpha)) {
+    m_redraw = true;  // The framebuffer has the old colours
+    m_drawn_alpha = *alpha;
+  }
+  return CollectLines(wedges);
+}
 
-      glVertexPointer(2, GL_FLOAT, sizeof(VertexPoint), &line->points[0].x);
-      glColorPointer(4, GL_UNSIGNED_BYTE, sizeof(VertexPoint), &line->points[0].red);
-      glDrawArrays(GL_TRIANGLES, 0, line->count);
+// Draw the collected lines, from points or from the buffer object when points is 0
+void RadarDrawVertex::DrawFrame(const UINT8* points, GLsizei lines, GLsizei wedges, GLubyte alpha) {
+  if (!m_fbo) {
+    if (m_vbo) {
+      BindBuffer(GL_ARRAY_BUFFER, m_vbo);
     }
+    DrawLines(points, lines, alpha);
+    if (m_vbo) {
+      BindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    return;
   }
-  glDisableClientState(GL_VERTEX_ARRAY);  // disable vertex arrays
-  glDisableClientState(GL_COLOR_ARRAY);
+
+  if (wedges > 0) {
+    UpdateFramebuffer(points, lines, wedges, alpha);
+  }
+
+  glPushAttrib(GL_ENABLE_BIT | GL_TEXTURE_BIT | GL_CURRENT_BIT);
+  glEnable(GL_TEXTURE_2D);
+  glBindTexture(GL_TEXTURE_2D, m_fbo_texture);
+  glColor4ub(255, 255, 255, 255);
+  glBegin(GL_QUADS);
+  glTexCoord2f(0, 0);
+  glVertex2f(-RETURNS_PER_LINE, -RETURNS_PER_LINE);
+  glTexCoord2f(1, 0);
+  glVertex2f(RETURNS_PER_LINE, -RETURNS_PER_LINE);
+  glTexCoord2f(1, 1);
+  glVertex2f(RETURNS_PER_LINE, RETURNS_PER_LINE);
+  glTexCoord2f(0, 1);
+  glVertex2f(-RETURNS_PER_LINE, RETURNS_PER_LINE);
+  glEnd();
+  glPopAttrib();
 }
 
 PLUGIN_END_NAMESPACE
@@ -34,10 +34,27 @@
 
 #include "RadarDraw.h"
 #include "drawutil.h"
+#include "spokeutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
-#define BUFFER_SIZE (2000000)
+/*
+ * The vertices of all spokes go into one ring, in the order the spokes arrive. The GUI thread copies
+ * what is new into a vertex buffer object of the same size and draws all lines with one
+ * glMultiDrawArrays. A line that has been overwritten by newer spokes is not drawn. Without buffer
+ * object support the lines are drawn from the ring itself. The ring starts at BUFFER_SIZE_MIN
+ * vertices and doubles, up to BUFFER_SIZE_MAX, when it cannot hold the lines of one rotation.
+ *
+ * When the OpenGL system can run shaders the ring holds a SpokeCompactVertex per corner and a
+ * vertex shader computes the position and colour; otherwise it holds six SpokeVertex per blob.
+ *
+ * With framebuffer objects the lines are not drawn on screen directly but into a texture that keeps
+ * the whole image. Each frame only the lines that changed since the last frame, including the ones that
+ * timed out, are cleared and drawn again, and the texture is drawn as one quad.
+ */
+#define BUFFER_SIZE_MIN (LINES_PER_ROTATION * 64)  // Vertices in a new ring, about 10 blobs per spoke
+#define BUFFER_SIZE_MAX (2000000)                  // Vertices the ring may grow to
+#define FRAMEBUFFER_SIZE (2048)                    // Texels per side of the retained image
 
 class RadarDrawVertex : public RadarDraw {
  public:
@@ -47,13 +64,30 @@ class RadarDrawVertex : public RadarDraw {
     m_ri = ri;
 
     for (size_t i = 0; i < ARRAY_SIZE(m_vertices); i++) {
+      m_vertices[i].first = 0;
       m_vertices[i].count = 0;
-      m_vertices[i].allocated = 0;
       m_vertices[i].timeout = 0;
-      m_vertices[i].points = 0;
+      m_vertices[i].dirty = false;
+      m_vertices[i].drawn = false;
     }
-    m_count = 0;
-    m_oom = false;
+    m_ring = 0;
+    m_ring_size = 0;
+    m_vbo_size = 0;
+    m_ring_head = 0;
+    m_ring_uploaded = 0;
+    m_vertex_size = sizeof(VertexPoint);
+    m_vbo = 0;
+    m_multi_draw = false;
+    m_compact = false;
+    m_alpha = 255;
+    m_vertex = 0;
+    m_fragment = 0;
+    m_program = 0;
+    m_fbo = 0;
+    m_fbo_texture = 0;
+    m_redraw = true;
+    memset(m_colours, 0, sizeof(m_colours));
+    m_drawn_alpha = 255;
 
     m_polarLookup = GetPolarToCartesianLookupTable();
   }
@@ -62,48 +96,67 @@ class RadarDrawVertex : public RadarDraw {
   void DrawRadarImage();
   void ProcessRadarSpoke(int transparency, SpokeBearing angle, UINT8* data, size_t len);
 
-  ~RadarDrawVertex() {
-    wxCriticalSectionLocker lock(m_exclusive);
-
-    for (size_t i = 0; i < LINES_PER_ROTATION; i++) {
-      if (m_vertices[i].points) {
-        free(m_vertices[i].points);
-      }
-    }
-  }
+  ~RadarDrawVertex();
 
  private:
+  bool InitCompact();
+  bool InitFramebuffer();
+  bool RingFull(SpokeBearing angle, size_t needed);
+  void GrowRing();
+  void UploadRing();
+  bool UpdateColours();
+  GLsizei CollectLines(GLsizei* wedges);
+  GLsizei CollectFrame(GLsizei* wedges, GLubyte* alpha);
+  void DrawFrame(const UINT8* points, GLsizei lines, GLsizei wedges, GLubyte alpha);
+  void DrawLines(const UINT8* points, GLsizei lines, GLubyte alpha);
+  void UpdateFramebuffer(const UINT8* points, GLsizei lines, GLsizei wedges, GLubyte alpha);
+
   RadarInfo* m_ri;
 
-  static const int VERTEX_PER_TRIANGLE = 3;
-  static const int VERTEX_PER_QUAD = 2 * VERTEX_PER_TRIANGLE;
-  static const int MAX_BLOBS_PER_LINE = RETURNS_PER_LINE;
-
-  struct VertexPoint {
-    GLfloat x;
-    GLfloat y;
-    GLubyte red;
-    GLubyte green;
-    GLubyte blue;
-    GLubyte alpha;
-  };
+  static const int VERTEX_PER_QUAD = SPOKE_VERTEX_PER_QUAD;
+
+  typedef SpokeVertex VertexPoint;
+  typedef SpokeCompactVertex CompactPoint;
 
   struct VertexLine {
-    VertexPoint* points;
-    time_t timeout;
+    wxLongLong_t first;  // Position in the ring, counted from the start
     size_t count;
-    size_t allocated;
+    time_t timeout;
+    bool dirty;  // Changed since it was last drawn into the framebuffer
+    bool drawn;  // Is in the framebuffer
   };
 
   PolarToCartesianLookupTable* m_polarLookup;
 
+  GLuint m_vbo;       // 0 when buffer objects are not supported
+  size_t m_vbo_size;  // Vertices in m_vbo, the ring may have grown since
+  bool m_multi_draw;
+  GLint m_draw_first[LINES_PER_ROTATION];
+  GLsizei m_draw_count[LINES_PER_ROTATION];
+
+  bool m_compact;  // Ring holds CompactPoint corners that m_program expands
+  GLuint m_vertex;
+  GLuint m_fragment;
+  GLuint m_program;
+  GLint m_blob_attribute;
+  GLint m_colours_uniform;
+  GLint m_alpha_uniform;
+  GLfloat m_colours[BLOB_COLOURS * 3];  // Last colours passed to m_program
+  GLubyte m_drawn_alpha;                // Last alpha passed to m_program
+
+  GLuint m_fbo;  // 0 when framebuffer objects are not supported
+  GLuint m_fbo_texture;
+  bool m_redraw;  // Whole framebuffer must be drawn again
+  GLfloat m_wedges[LINES_PER_ROTATION * 3 * 2];  // Triangles that clear the lines to be drawn again
+
   wxCriticalSection m_exclusive;  // protects the following
   VertexLine m_vertices[LINES_PER_ROTATION];
-  unsigned int m_count;
-  bool m_oom;
-
-  void SetBlob(VertexLine* line, int angle_begin, int angle_end, int r1, int r2, GLubyte red, GLubyte green, GLubyte blue,
-               GLubyte alpha);
+  UINT8* m_ring;
+  size_t m_ring_size;  // Vertices in m_ring
+  size_t m_vertex_size;
+  wxLongLong_t m_ring_head;      // Position where the next line goes
+  wxLongLong_t m_ring_uploaded;  // Everything before this position is in m_vbo
+  GLubyte m_alpha;               // Of the last spoke, compact vertices have no alpha of their own
 };
 
 PLUGIN_END_NAMESPACE
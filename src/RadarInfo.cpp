@@ -35,15 +35,20 @@
 #include "RadarMarpa.h"
 #include "RadarPanel.h"
 #include "br24ControlsDialog.h"
+#include "br24Process.h"
 #include "br24Receive.h"
 #include "br24Transmit.h"
 #include "drawutil.h"
+#include "spokeutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
 bool g_first_render = true;
 
-enum { TIMER_ID = 1 };
+enum { TIMER_ID = 1, REFRESH_DUE_ID };
+
+// Posted by the process thread when new spokes make a repaint due
+static const wxEventType EVT_REFRESH_DUE = wxNewEventType();
 
 BEGIN_EVENT_TABLE(RadarInfo, wxEvtHandler)
 EVT_TIMER(TIMER_ID, RadarInfo::RefreshDisplay)
@@ -174,16 +179,16 @@ void radar_range_control_item::Update(int v) {
   }
 }
 
-RadarInfo::RadarInfo(br24radar_pi *pi, int radar) {
+RadarInfo::RadarInfo(br24radar_pi *pi, int radar) : m_arpa_wake(0, 1) {
   m_pi = pi;
   m_radar = radar;
   m_arpa = 0;
+  m_blobs = new SpokeBlobs;
+  m_plane = new OccupancyPlane;
   m_radar_type = RT_UNKNOWN;
   m_auto_range_mode = true;
   m_course_index = 0;
   m_old_range = 0;
-  m_dir_lat = 0;
-  m_dir_lon = 0;
   m_range_meters = 0;
   m_auto_range_meters = 0;
   m_previous_auto_range_meters = 0;
@@ -206,6 +211,7 @@ RadarInfo::RadarInfo(br24radar_pi *pi, int radar) {
   }
   m_transmit = 0;
   m_receive = 0;
+  m_process = 0;
   m_draw_panel.draw = 0;
   m_draw_overlay.draw = 0;
   m_radar_panel = 0;
@@ -222,6 +228,12 @@ RadarInfo::RadarInfo(br24radar_pi *pi, int radar) {
   m_overlay_refreshes_queued = 0;
   m_refreshes_queued = 0;
   m_refresh_millis = 50;
+  m_refresh_last = 0;
+  m_refresh_due = 0;
+  m_refresh_requested = true;
+  m_refresh_spokes = 0;
+  Connect(REFRESH_DUE_ID, EVT_REFRESH_DUE, wxCommandEventHandler(RadarInfo::RefreshDue));
+  m_arpa_spokes = 0;
 }
 
 void RadarInfo::DeleteDialogs() {
@@ -247,6 +259,12 @@ RadarInfo::~RadarInfo() {
     LOG_VERBOSE(wxT("BR24radar_pi: %s receive thread deleted"), m_name.c_str());
     m_receive = 0;
   }
+  if (m_process) {
+    m_process->Shutdown();
+    m_process->Wait();
+    delete m_process;
+    m_process = 0;
+  }
   DeleteDialogs();
   if (m_draw_panel.draw) {
     delete m_draw_panel.draw;
@@ -264,6 +282,10 @@ RadarInfo::~RadarInfo() {
     delete m_guard_zone[z];
     m_guard_zone[z] = 0;
   }
+  delete m_blobs;
+  m_blobs = 0;
+  delete m_plane;
+  m_plane = 0;
 }
 
 bool RadarInfo::Init(wxString name, int verbose) {
@@ -281,7 +303,7 @@ bool RadarInfo::Init(wxString name, int verbose) {
     return false;
   }
 
-  m_timer->Start(m_refresh_millis);
+  ScheduleRefresh();
   return true;
 }
 
@@ -336,6 +358,15 @@ void RadarInfo::SetName(wxString name) {
 }
 
 void RadarInfo::StartReceive() {
+  if (!m_process) {
+    LOG_RECEIVE(wxT("BR24radar_pi: %s starting process thread"), m_name.c_str());
+    m_process = new br24Process(m_pi, this);
+    if (!m_process || (m_process->Run() != wxTHREAD_NO_ERROR)) {
+      LOG_INFO(wxT("BR24radar_pi: %s unable to start process thread, processing spokes in receive thread"), m_name.c_str());
+      delete m_process;
+      m_process = 0;
+    }
+  }
   if (!m_receive) {
     LOG_RECEIVE(wxT("BR24radar_pi: %s starting receive thread"), m_name.c_str());
     m_receive = new br24Receive(m_pi, this);
@@ -390,6 +421,8 @@ void RadarInfo::ResetSpokes() {
 
   memset(zap, 0, sizeof(zap));
   memset(m_history, 0, sizeof(m_history));
+  m_blobs->Reset();
+  m_plane->Reset();
 
   if (m_draw_panel.draw) {
     for (size_t r = 0; r < LINES_PER_ROTATION; r++) {
@@ -408,8 +441,21 @@ void RadarInfo::ResetSpokes() {
 }
 
 /*
- * A spoke of data has been received by the receive thread and it calls this (in
- * the context of the receive thread, so no UI actions can be performed here.)
+ * A spoke of data has been received by the receive thread and it calls this to hand it
+ * over to the process thread.
+ */
+void RadarInfo::QueueRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT8 *data, size_t len, int range_meters,
+                                wxLongLong time_rec, double lat, double lon) {
+  if (!m_process) {
+    ProcessRadarSpoke(angle, bearing, data, len, range_meters, time_rec, lat, lon);
+  } else if (!m_process->QueueSpoke(angle, bearing, data, len, range_meters, time_rec, lat, lon)) {
+    m_statistics.dropped_spokes++;
+  }
+}
+
+/*
+ * A spoke of data has been queued by the receive thread and the process thread calls this
+ * (in the context of the process thread, so no UI actions can be performed here.)
  *
  * @param angle                 Bearing (relative to Boat)  at which the spoke is seen.
  * @param bearing               Bearing (relative to North) at which the spoke is seen.
@@ -451,15 +497,9 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT
   m_history[bearing].time = time_rec;
   m_history[bearing].lat = lat;
   m_history[bearing].lon = lon;
-  for (size_t radius = 0; radius < len; radius++) {
-    hist_data[radius] = hist_data[radius] << 1;  // shift left history byte 1 bit
-    // clear leftmost 2 bits to 00 for ARPA
-    hist_data[radius] = hist_data[radius] & 63;
-    if (data[radius] >= weakest_normal_blob) {
-      // and add 1 if above threshold and set the left 2 bits, used for ARPA
-      hist_data[radius] = hist_data[radius] | 192;
-    }
-  }
+  SpokeShiftHistory(hist_data, data, len, weakest_normal_blob);
+  m_blobs->AddSpoke(bearing, hist_data, len, 128);  // bit 7 is set for the returns of this sweep
+  m_plane->SetSpoke(bearing, hist_data, len, 128);
 
   for (size_t z = 0; z < GUARD_ZONES; z++) {
     if (m_guard_zone[z]->m_alarm_on) {
@@ -467,11 +507,7 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT
     }
   }
   if (m_multi_sweep_filter) {
-    for (size_t radius = 0; radius < len; radius++) {
-      if (!HISTORY_FILTER_ALLOW(m_history[bearing].line[radius])) {
-        data[radius] = 0;
-      }
-    }
+    SpokeMultiSweepFilter(data, hist_data, len);
   }
 
   bool draw_trails_on_overlay = (m_pi->m_settings.trails_on_overlay == 1);
@@ -493,39 +529,15 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT
 
   UpdateTrailPosition();  // for true trails
 
-  // True trails
-  for (size_t radius = 0; radius < len - 1; radius++) {  //  len - 1 : no trails on range circle
-    UINT8 *trail = &m_trails.true_trails[polarLookup->intx[bearing][radius] + TRAILS_SIZE / 2 + m_trails.offset.lat]
-                                        // when ship moves north, offset.lat > 0. Add to move trails image in opposite direction
-                                        [polarLookup->inty[bearing][radius] + TRAILS_SIZE / 2 + m_trails.offset.lon];
-    // when ship moves east, offset.lon > 0. Add to move trails image in opposite direction
-    if (data[radius] >= weakest_normal_blob) {
-      *trail = 1;
-    } else {
-      if (*trail > 0 && *trail < TRAIL_MAX_REVOLUTIONS) {
-        (*trail)++;
-      }
-      if (m_trails_motion.value == TARGET_MOTION_TRUE) {
-        data[radius] = m_trail_colour[*trail];
-      }
-    }
-  }
+  // True trails, len - 1 : no trails on range circle
+  // When ship moves north, offset.lat > 0 and when it moves east offset.lon > 0.
+  SpokeUpdateTrueTrails(m_trails.true_trails, polarLookup, bearing, m_trails.offset.lat, m_trails.offset.lon, data, len - 1,
+                        weakest_normal_blob,
+                        m_trails_motion.value == TARGET_MOTION_TRUE ? m_trail_colour : 0);
 
-  // Relative trails
-  UINT8 *trail = m_trails.relative_trails[angle];
-  for (size_t radius = 0; radius < len - 1; radius++) {  // len - 1 : no trails on range circle
-    if (data[radius] >= weakest_normal_blob) {
-      *trail = 1;
-    } else {
-      if (*trail > 0 && *trail < TRAIL_MAX_REVOLUTIONS) {
-        (*trail)++;
-      }
-      if (m_trails_motion.value == TARGET_MOTION_RELATIVE) {
-        data[radius] = m_trail_colour[*trail];
-      }
-    }
-    trail++;
-  }
+  // Relative trails, len - 1 : no trails on range circle
+  SpokeUpdateRelativeTrails(m_trails.relative_trails[angle], data, len - 1, weakest_normal_blob,
+                            m_trails_motion.value == TARGET_MOTION_RELATIVE ? m_trail_colour : 0);
 
   if (m_draw_overlay.draw && draw_trails_on_overlay) {
     m_draw_overlay.draw->ProcessRadarSpoke(m_pi->m_settings.overlay_transparency, bearing, data, len);
@@ -534,6 +546,14 @@ void RadarInfo::ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT
   if (m_draw_panel.draw) {
     m_draw_panel.draw->ProcessRadarSpoke(3, north_or_course_up ? bearing : angle, data, len);
   }
+  if (++m_refresh_spokes == 1 || m_refresh_spokes == REFRESH_SECTOR_SPOKES) {
+    wxCommandEvent event(EVT_REFRESH_DUE, REFRESH_DUE_ID);
+    wxPostEvent(this, event);
+  }
+  if (++m_arpa_spokes >= ARPA_SECTOR_SPOKES) {
+    m_arpa_spokes = 0;
+    m_arpa_wake.Post();
+  }
 }
 
 void RadarInfo::SampleCourse(int angle) {
@@ -584,37 +604,32 @@ void RadarInfo::ZoomTrails(float zoom_factor) {
   }
   memcpy(&m_trails.relative_trails[0][0], &m_trails.copy_of_relative_trails[0][0], sizeof(m_trails.copy_of_relative_trails));
 
-  // zoom true trails
+  // zoom true trails around the ship
   memset(&m_trails.copy_of_true_trails, 0, sizeof(m_trails.copy_of_true_trails));
-  for (int i = TRAILS_SIZE / 2 + m_trails.offset.lat - RETURNS_PER_LINE;
-       i < TRAILS_SIZE / 2 + m_trails.offset.lat + RETURNS_PER_LINE; i++) {
-    int index_i = (int((float)(i - TRAILS_SIZE / 2 + m_trails.offset.lat) * zoom_factor)) + TRAILS_SIZE / 2 -
-                  m_trails.offset.lat * zoom_factor;
-    if (index_i >= TRAILS_SIZE - 1) break;  // allow adding an additional pixel later
-    if (index_i < 0) continue;
-    for (int j = TRAILS_SIZE / 2 + m_trails.offset.lon - RETURNS_PER_LINE;
-         j < TRAILS_SIZE / 2 + m_trails.offset.lon + RETURNS_PER_LINE; j++) {
-      int index_j = (int((float)(j - TRAILS_SIZE / 2 + m_trails.offset.lon) * zoom_factor)) + TRAILS_SIZE / 2 -
-                    m_trails.offset.lon * zoom_factor;
-      if (index_j >= TRAILS_SIZE - 1) break;
-      if (index_j < 0) continue;
-      if (m_trails.true_trails[i][j] != 0) {  // many to one mapping, prevent overwriting trails with 0
-        m_trails.copy_of_true_trails[index_i][index_j] = m_trails.true_trails[i][j];
+  for (int i = -TRAILS_SIZE / 2; i < TRAILS_SIZE / 2; i++) {
+    int index_i = (int)((float)i * zoom_factor);
+    if (index_i < -TRAILS_SIZE / 2 || index_i >= TRAILS_SIZE / 2 - 1) continue;  // allow adding an additional pixel later
+    int lat = m_trails.offset.lat + index_i;
+    for (int j = -TRAILS_SIZE / 2; j < TRAILS_SIZE / 2; j++) {
+      int index_j = (int)((float)j * zoom_factor);
+      if (index_j < -TRAILS_SIZE / 2 || index_j >= TRAILS_SIZE / 2 - 1) continue;
+      int lon = m_trails.offset.lon + index_j;
+      TrailRevolutionsAge age = m_trails.true_trails[TrailIndex(m_trails.offset.lat + i, m_trails.offset.lon + j)];
+      if (age != 0) {  // many to one mapping, prevent overwriting trails with 0
+        m_trails.copy_of_true_trails[TrailIndex(lat, lon)] = age;
         if (zoom_factor > 1.2) {
           // add an extra pixel in the y direction
-          m_trails.copy_of_true_trails[index_i][index_j + 1] = m_trails.true_trails[i][j];
+          m_trails.copy_of_true_trails[TrailIndex(lat, lon + 1)] = age;
           if (zoom_factor > 1.6) {
             // also add  pixel in the x direction
-            m_trails.copy_of_true_trails[index_i + 1][index_j] = m_trails.true_trails[i][j];
-            m_trails.copy_of_true_trails[index_i + 1][index_j + 1] = m_trails.true_trails[i][j];
+            m_trails.copy_of_true_trails[TrailIndex(lat + 1, lon)] = age;
+            m_trails.copy_of_true_trails[TrailIndex(lat + 1, lon + 1)] = age;
           }
         }
       }
     }
   }
   memcpy(m_trails.true_trails, m_trails.copy_of_true_trails, sizeof(m_trails.copy_of_true_trails));
-  m_trails.offset.lon *= zoom_factor;
-  m_trails.offset.lat *= zoom_factor;
 }
 
 void RadarInfo::UpdateTransmitState() {
@@ -690,12 +705,27 @@ void RadarInfo::RequestRadarState(RadarState state) {
   }
 }
 
+void RadarInfo::ClearTrailRows(int lat, int count) {
+  for (int i = lat; i < lat + count; i++) {
+    for (int j = 0; j < TRAILS_SIZE; j += TRAILS_TILE) {
+      memset(&m_trails.true_trails[TrailIndex(i, j)], 0, TRAILS_TILE);
+    }
+  }
+}
+
+void RadarInfo::ClearTrailColumns(int lon, int count) {
+  for (int i = 0; i < TRAILS_SIZE; i++) {
+    for (int j = lon; j < lon + count; j++) {
+      m_trails.true_trails[TrailIndex(i, j)] = 0;
+    }
+  }
+}
+
 void RadarInfo::UpdateTrailPosition() {
-  // When position changes the trail image is not moved, only the pointer to the center
-  // of the image (offset) is changed.
-  // So we move the image around within the m_trails.true_trails buffer (by moving the pointer).
-  // But when there is no room anymore (margin used) the whole trails image is shifted
-  // and the is offset reset
+  // When position changes the trail image is not moved, only the position of the ship in
+  // the image (offset) is changed. The image wraps around, so the rows and columns that
+  // come into view ahead of the ship are the ones that just went out of view behind it,
+  // and only those are cleared.
   if (!m_pi->m_bpos_set || m_pi->m_heading_source == HEADING_NONE) {
     return;
   }
@@ -711,44 +741,12 @@ void RadarInfo::UpdateTrailPosition() {
   double fshift_lon = dif_lon * 60. * 1852. / (double)m_range_meters * (double)(RETURNS_PER_LINE);
   fshift_lon *= cos(deg2rad(m_pi->m_ownship_lat));  // at higher latitudes a degree of longitude is fewer meters
   int shift_lat = (int)(fshift_lat + m_trails.dif_lat);
-
-  if (shift_lat > 0 && m_dir_lat <= 0) {
-    // change of direction of movement
-    // clear space in true_trails outside image in that direction (this area might not be empty)
-    memset(&m_trails.true_trails[TRAILS_SIZE - MARGIN + m_trails.offset.lat][0], 0, TRAILS_SIZE * (MARGIN - m_trails.offset.lat));
-    m_dir_lat = 1;
-  }
-
-  if (shift_lat < 0 && m_dir_lat >= 0) {
-    // change of direction of movement
-    // clear space in true_trails outside image in that direction
-    memset(&m_trails.true_trails[0][0], 0, TRAILS_SIZE * (MARGIN + m_trails.offset.lat));
-    m_dir_lat = -1;
-  }
-
   int shift_lon = (int)(fshift_lon + m_trails.dif_lon);
-  if (shift_lon > 0 && m_dir_lon <= 0) {
-    // change of direction of movement
-    // clear space in true_trails outside image in that direction
-    for (int i = 0; i < TRAILS_SIZE; i++) {
-      memset(&m_trails.true_trails[i][TRAILS_SIZE - MARGIN + m_trails.offset.lon], 0, MARGIN - m_trails.offset.lon);
-    }
-    m_dir_lon = 1;
-  }
-
-  if (shift_lon < 0 && m_dir_lon >= 0) {
-    // change of direction of movement
-    // clear space in true_trails outside image in that direction
-    for (int i = 0; i < TRAILS_SIZE; i++) {
-      memset(&m_trails.true_trails[i][0], 0, MARGIN + m_trails.offset.lon);
-    }
-    m_dir_lon = -1;
-  }
 
   m_trails.dif_lat = fshift_lat + m_trails.dif_lat - (double)shift_lat;  // save the rounding fraction and appy it next time
   m_trails.dif_lon = fshift_lon + m_trails.dif_lon - (double)shift_lon;
 
-  if (abs(shift_lat) >= MARGIN || abs(shift_lon) >= MARGIN) {  // huge shift, reset trails
+  if (abs(shift_lat) >= TRAILS_MAX_SHIFT || abs(shift_lon) >= TRAILS_MAX_SHIFT) {  // huge shift, reset trails
     ClearTrails();
     m_trails.lat = m_pi->m_ownship_lat;
     m_trails.lon = m_pi->m_ownship_lon;
@@ -758,48 +756,69 @@ void RadarInfo::UpdateTrailPosition() {
     return;
   }
 
-  // don't shift the image yet, only shift the center
-  m_trails.offset.lat += shift_lat;
-  m_trails.offset.lon += shift_lon;  //  index as follows: array[lat][lon]
-
-  if (abs(m_trails.offset.lon) >= MARGIN) {  // offset too large: shift image
-                                             // shift in the opposite direction of the offset
-    m_trails.offset.lon -= shift_lon;        // subtract again, image should be indide limits
-    if (m_trails.offset.lon > 0) {
-      for (int i = 0; i < TRAILS_SIZE; i++) {
-        memmove(&m_trails.true_trails[i][MARGIN], &m_trails.true_trails[i][MARGIN + m_trails.offset.lon], RETURNS_PER_LINE * 2);
-        memset(&m_trails.true_trails[i][TRAILS_SIZE - MARGIN], 0, MARGIN);
-      }
-    }
-    if (m_trails.offset.lon < 0) {
-      for (int i = 0; i < TRAILS_SIZE; i++) {
-        memmove(&m_trails.true_trails[i][MARGIN], &m_trails.true_trails[i][MARGIN + m_trails.offset.lon], RETURNS_PER_LINE * 2);
-        //     memset(&m_trails.true_trails[i][TRAILS_SIZE - MARGIN], 0, MARGIN);
-        memset(&m_trails.true_trails[i][0], 0, MARGIN);
-      }
-    }
-    m_trails.offset.lon = shift_lon;
+  // The image covers offset - TRAILS_SIZE / 2 up to offset + TRAILS_SIZE / 2 - 1, index as follows: [lat][lon]
+  if (shift_lat > 0) {
+    ClearTrailRows(m_trails.offset.lat + TRAILS_SIZE / 2, shift_lat);
+  } else if (shift_lat < 0) {
+    ClearTrailRows(m_trails.offset.lat + shift_lat - TRAILS_SIZE / 2, -shift_lat);
   }
+  if (shift_lon > 0) {
+    ClearTrailColumns(m_trails.offset.lon + TRAILS_SIZE / 2, shift_lon);
+  } else if (shift_lon < 0) {
+    ClearTrailColumns(m_trails.offset.lon + shift_lon - TRAILS_SIZE / 2, -shift_lon);
+  }
+  m_trails.offset.lat += shift_lat;
+  m_trails.offset.lon += shift_lon;
+}
 
-  if (abs(m_trails.offset.lat) >= MARGIN) {  // offset too large: shift image
-    m_trails.offset.lat -= shift_lat;        // image inside array
+// Repaint as soon as the budget allows even if no new spokes arrived
+void RadarInfo::RequestRefresh() {
+  m_refresh_requested = true;
+  ScheduleRefresh();
+}
 
-    if (m_trails.offset.lat > 0) {
-      memmove(&m_trails.true_trails[MARGIN][0], &m_trails.true_trails[MARGIN + m_trails.offset.lat][0],
-              (RETURNS_PER_LINE * 2) * TRAILS_SIZE);
-      memset(&m_trails.true_trails[TRAILS_SIZE - MARGIN][0], 0, TRAILS_SIZE * MARGIN);
-    }
+// The process thread saw the first new spoke or a sector's worth of them
+void RadarInfo::RefreshDue(wxCommandEvent &event) { ScheduleRefresh(); }
 
-    if (m_trails.offset.lat < 0) {
-      memmove(&m_trails.true_trails[MARGIN][0], &m_trails.true_trails[MARGIN + m_trails.offset.lat][0],
-              RETURNS_PER_LINE * 2 * TRAILS_SIZE);
+/*
+ * Start the one-shot m_timer so that RefreshDisplay runs when the next repaint is due: m_refresh_millis after
+ * the last one when a sector's worth of spokes is new or RequestRefresh was called, REFRESH_MAX_WAIT times
+ * that when only a few spokes are new, or after REFRESH_IDLE_MILLIS when nothing is pending.
+ * The timer is only restarted when that is sooner than it would run anyway.
+ */
+void RadarInfo::ScheduleRefresh() {
+  int spokes;
+  {
+    wxCriticalSectionLocker lock(m_exclusive);
+    spokes = m_refresh_spokes;
+  }
+
+  wxLongLong now = wxGetUTCTimeMillis();
+  wxLongLong due;
+  if (m_refresh_requested || spokes >= REFRESH_SECTOR_SPOKES) {
+    due = m_refresh_last + m_refresh_millis;
+  } else if (spokes > 0) {
+    due = m_refresh_last + REFRESH_MAX_WAIT * m_refresh_millis;
+  } else {
+    due = now + REFRESH_IDLE_MILLIS;
+  }
+  if (due < now + REFRESH_MIN_MILLIS) {
+    due = now + REFRESH_MIN_MILLIS;
+  }
 
-      memset(&m_trails.true_trails[0][0], 0, TRAILS_SIZE * MARGIN);
-    }
-    m_trails.offset.lat = shift_lat;
+  if (!m_timer->IsRunning() || due < m_refresh_due) {
+    m_refresh_due = due;
+    m_timer->Start((due - now).ToLong(), wxTIMER_ONE_SHOT);
   }
 }
 
+/*
+ * Run by the one-shot m_timer, see ScheduleRefresh. Instead of repainting at a fixed rate this repaints when
+ * a sector's worth of new spokes has arrived, when new spokes have waited for REFRESH_MAX_WAIT refresh
+ * intervals, or when RequestRefresh was called; but never more often than once per m_refresh_millis.
+ * So a radar in standby only wakes up every REFRESH_IDLE_MILLIS, and a fast scanning radar is shown as soon
+ * as the budget allows.
+ */
 void RadarInfo::RefreshDisplay(wxTimerEvent &event) {
   if (m_radar == 0) {
     time_t now = time(0);
@@ -808,13 +827,41 @@ void RadarInfo::RefreshDisplay(wxTimerEvent &event) {
       m_main_timer_timeout = now + 1;
     }
   }
+  if (m_arpa) {
+    m_arpa->SendReports();
+  }
+
+  // Calculate refresh speed
+  if (m_pi->m_settings.refreshrate) {
+    int millis = 1000 / (1 + ((m_pi->m_settings.refreshrate) - 1) * 5);
+
+    if (millis != m_refresh_millis) {
+      m_refresh_millis = millis;
+      LOG_VERBOSE(wxT("BR24radar_pi: %s changed refresh interval to %d milliseconds"), m_name.c_str(), m_refresh_millis);
+    }
+  }
+
+  wxLongLong now = wxGetUTCTimeMillis();
+  wxLongLong elapsed = now - m_refresh_last;
+  int spokes;
+  {
+    wxCriticalSectionLocker lock(m_exclusive);
+    spokes = m_refresh_spokes;
+  }
+  if (elapsed < m_refresh_millis || (!m_refresh_requested && spokes < REFRESH_SECTOR_SPOKES &&
+                                     (spokes == 0 || elapsed < REFRESH_MAX_WAIT * m_refresh_millis))) {
+    ScheduleRefresh();
+    return;
+  }
 
+  bool refreshed = false;
   if (m_overlay_refreshes_queued > 0) {
     // don't do additional refresh when too busy
     LOG_DIALOG(wxT("BR24radar_pi: %s busy encountered, overlay_refreshes_queued=%d"), m_name.c_str(), m_overlay_refreshes_queued);
   } else if (m_pi->IsOverlayOnScreen(m_radar)) {
     m_overlay_refreshes_queued++;
     GetOCPNCanvasWindow()->Refresh(false);
+    refreshed = true;
   }
 
   if (m_refreshes_queued > 0) {
@@ -824,18 +871,17 @@ void RadarInfo::RefreshDisplay(wxTimerEvent &event) {
   } else if (IsPaneShown()) {
     m_refreshes_queued++;
     m_radar_panel->Refresh(false);
+    refreshed = true;
   }
 
-  // Calculate refresh speed
-  if (m_pi->m_settings.refreshrate) {
-    int millis = 1000 / (1 + ((m_pi->m_settings.refreshrate) - 1) * 5);
+  if (refreshed || (!m_pi->IsOverlayOnScreen(m_radar) && !IsPaneShown())) {
+    m_refresh_requested = false;
+    m_refresh_last = now;
 
-    if (millis != m_refresh_millis) {
-      m_refresh_millis = millis;
-      LOG_VERBOSE(wxT("BR24radar_pi: %s changed timer interval to %d milliseconds"), m_name.c_str(), m_refresh_millis);
-      m_timer->Start(m_refresh_millis);
-    }
+    wxCriticalSectionLocker lock(m_exclusive);
+    m_refresh_spokes -= spokes;
   }
+  ScheduleRefresh();
 }
 
 void RadarInfo::RenderGuardZone() {
@@ -937,37 +983,53 @@ void RadarInfo::ShowRadarWindow(bool show) { m_radar_panel->ShowFrame(show); }
 bool RadarInfo::IsPaneShown() { return m_radar_panel->IsPaneShown(); }
 
 void RadarInfo::UpdateControlState(bool all) {
-  wxCriticalSectionLocker lock(m_exclusive);
+  bool changed = all;
 
-  m_overlay.Update(m_pi->m_settings.chart_overlay == m_radar);
+  {
+    wxCriticalSectionLocker lock(m_exclusive);
+
+    int overlay = m_overlay.value;
+    m_overlay.Update(m_pi->m_settings.chart_overlay == m_radar);
+    if (m_overlay.value != overlay) {
+      changed = true;
+    }
 
 #ifdef OPENCPN_NO_LONGER_MIXES_GL_CONTEXT
-  //
-  // Once OpenCPN doesn't mess up with OpenGL context anymore we can do this
-  //
-  if (m_overlay.value == 0 && m_draw_overlay.draw) {
-    LOG_DIALOG(wxT("BR24radar_pi: Removing draw method as radar overlay is not shown"));
-    delete m_draw_overlay.draw;
-    m_draw_overlay.draw = 0;
-  }
-  if (!IsShown() && m_draw_panel.draw) {
-    LOG_DIALOG(wxT("BR24radar_pi: Removing draw method as radar window is not shown"));
-    delete m_draw_panel.draw;
-    m_draw_panel.draw = 0;
-  }
+    //
+    // Once OpenCPN doesn't mess up with OpenGL context anymore we can do this
+    //
+    if (m_overlay.value == 0 && m_draw_overlay.draw) {
+      LOG_DIALOG(wxT("BR24radar_pi: Removing draw method as radar overlay is not shown"));
+      delete m_draw_overlay.draw;
+      m_draw_overlay.draw = 0;
+    }
+    if (!IsShown() && m_draw_panel.draw) {
+      LOG_DIALOG(wxT("BR24radar_pi: Removing draw method as radar window is not shown"));
+      delete m_draw_panel.draw;
+      m_draw_panel.draw = 0;
+    }
 #endif
 
-  if (m_control_dialog) {
-    m_control_dialog->UpdateControlValues(all);
-    m_control_dialog->UpdateDialogShown();
+    if (m_control_dialog) {
+      m_control_dialog->UpdateControlValues(all);
+      m_control_dialog->UpdateDialogShown();
+    }
   }
 
-  if (IsPaneShown()) {
-    m_radar_panel->Refresh(false);
+  // Notify calls this every second, so only repaint when something shown on the canvas changed
+  wxString text = GetCanvasTextTopLeft() + GetCanvasTextCenter() + GetCanvasTextBottomLeft();
+  if (text != m_refresh_text) {
+    m_refresh_text = text;
+    changed = true;
+  }
+  if (changed) {
+    RequestRefresh();
   }
 }
 
 void RadarInfo::ResetRadarImage() {
+  wxCriticalSectionLocker lock(m_exclusive);  // also called from the receive thread, while spokes are processed
+
   if (m_range_meters) {
     ResetSpokes();
     ClearTrails();
@@ -1049,15 +1111,12 @@ void RadarInfo::RenderRadarImage(wxPoint center, double scale, double overlay_ro
   if (!overlay && m_orientation.value == ORIENTATION_COURSE_UP) {
     guard_rotate -= m_course;
   }
-  if (m_arpa) {
-    m_arpa->RefreshArpaTargets();
-  }
   if (overlay) {
     if (m_arpa) {
       glPushMatrix();
       glTranslated(center.x, center.y, 0);
       glScaled(scale, scale, 1.);
-      m_arpa->DrawArpaTargets();
+      m_arpa->DrawArpaTargets(true);
       glPopMatrix();
     }
 
@@ -1096,7 +1155,7 @@ void RadarInfo::RenderRadarImage(wxPoint center, double scale, double overlay_ro
       glPushMatrix();
       glScaled(scale, scale, 1.);
       glRotated(arpa_rotate, 0.0, 0.0, 1.0);
-      m_arpa->DrawArpaTargets();
+      m_arpa->DrawArpaTargets(false);
       glPopMatrix();
     }
 
@@ -1351,6 +1410,7 @@ void RadarInfo::SetMouseVrmEbl(double vrm, double ebl) {
   m_mouse_lat = 0.0;
   m_mouse_lon = 0.0;
   LOG_DIALOG(wxT("BR24radar_pi: SetMouseVrmEbl(%f, %f)"), vrm, ebl);
+  RequestRefresh();
 }
 
 void RadarInfo::SetBearing(int bearing) {
@@ -1369,6 +1429,7 @@ void RadarInfo::SetBearing(int bearing) {
     m_vrm[bearing] = local_distance(m_pi->m_ownship_lat, m_pi->m_ownship_lon, m_mouse_lat, m_mouse_lon);
     m_ebl[m_orientation.value][bearing] = local_bearing(m_pi->m_ownship_lat, m_pi->m_ownship_lon, m_mouse_lat, m_mouse_lon);
   }
+  RequestRefresh();
 }
 
 void RadarInfo::ClearTrails() { memset(&m_trails, 0, sizeof(m_trails)); }
@@ -1382,7 +1443,7 @@ void RadarInfo::ComputeTargetTrails() {
   if (m_trails_motion.value == 0) {
     maxRev = 0;
   }
-  TrailRevolutionsAge revolution;
+  int revolution;
   double coloursPerRevolution = 0.;
   double colour = 0.;
 
@@ -1394,9 +1455,9 @@ void RadarInfo::ComputeTargetTrails() {
   LOG_VERBOSE(wxT("BR24radar_pi: Target trail value %d = %d revolutions"), m_target_trails.value, maxRev);
 
   // Disperse the BLOB_HISTORY values over 0..maxrev
-  for (revolution = 0; revolution <= TRAIL_MAX_REVOLUTIONS; revolution++) {
+  for (revolution = 0; revolution < TRAIL_COLOURS; revolution++) {
     if (revolution >= 1 && revolution < maxRev) {
-      m_trail_colour[revolution] = (BlobColour)(BLOB_HISTORY_0 + (int)colour);
+      m_trail_colour[revolution] = (UINT8)(BLOB_HISTORY_0 + (int)colour);
       colour += coloursPerRevolution;
     } else {
       m_trail_colour[revolution] = BLOB_NONE;
@@ -40,6 +40,8 @@ class RadarDraw;
 class RadarCanvas;
 class RadarPanel;
 class GuardZoneBogey;
+class SpokeBlobs;
+class OccupancyPlane;
 
 struct RadarRange {
   int meters;
@@ -119,6 +121,23 @@ struct DrawInfo {
 typedef UINT8 TrailRevolutionsAge;
 #define SECONDS_TO_REVOLUTIONS(x) ((x)*2 / 5)
 #define TRAIL_MAX_REVOLUTIONS SECONDS_TO_REVOLUTIONS(600) + 1
+#define TRAIL_COLOURS (UINT8_MAX + 1)  // Trail colour tables cover every age, so vector lookups need no bounds check
+
+// True trails are a toroidal TRAILS_SIZE x TRAILS_SIZE image around the ship: moving the ship only
+// moves the origin. It is stored in tiles of TRAILS_TILE x TRAILS_TILE, one cache line each, so a
+// spoke touches far fewer cache lines than in a row by row layout.
+#define TRAILS_SIZE (RETURNS_PER_LINE * 2)
+#define TRAILS_TILE (8)
+#define TRAILS_MAX_SHIFT (100)  // Larger position jumps reset the trails
+
+static inline size_t TrailIndex(int lat, int lon) {
+  size_t i = (size_t)lat & (TRAILS_SIZE - 1);
+  size_t j = (size_t)lon & (TRAILS_SIZE - 1);
+
+  return ((i / TRAILS_TILE) * (TRAILS_SIZE / TRAILS_TILE) + j / TRAILS_TILE) * (TRAILS_TILE * TRAILS_TILE) +
+         (i % TRAILS_TILE) * TRAILS_TILE + j % TRAILS_TILE;
+}
+
 enum { TRAIL_15SEC, TRAIL_30SEC, TRAIL_1MIN, TRAIL_3MIN, TRAIL_5MIN, TRAIL_10MIN, TRAIL_CONTINUOUS, TRAIL_ARRAY_SIZE };
 
 class RadarInfo : public wxEvtHandler {
@@ -169,6 +188,7 @@ class RadarInfo : public wxEvtHandler {
 
   br24Transmit *m_transmit;
   br24Receive *m_receive;
+  br24Process *m_process;
   br24ControlsDialog *m_control_dialog;
   RadarPanel *m_radar_panel;
   RadarCanvas *m_radar_canvas;
@@ -187,7 +207,19 @@ class RadarInfo : public wxEvtHandler {
   bool m_auto_range_mode;
   int m_overlay_refreshes_queued;
   int m_refreshes_queued;
-  int m_refresh_millis;
+  int m_refresh_millis;       // Shortest time between two repaints, from the refresh rate setting
+  wxLongLong m_refresh_last;  // When the last repaint was requested
+  wxLongLong m_refresh_due;   // When the one-shot m_timer will run RefreshDisplay
+  bool m_refresh_requested;   // Something else than the radar image changed, see RequestRefresh
+  int m_refresh_spokes;       // Spokes processed since the last repaint, protected by m_exclusive
+  wxString m_refresh_text;    // Canvas texts at the last UpdateControlState, to see if they changed
+#define REFRESH_IDLE_MILLIS (250)   // Timer interval when no repaint is pending, for Notify and ARPA reports
+#define REFRESH_MIN_MILLIS (10)     // Shortest timer interval, used when a repaint is late or was skipped as busy
+#define REFRESH_SECTOR_SPOKES (64)  // Repaint as soon as this many spokes are new, if the budget allows
+#define REFRESH_MAX_WAIT (2)        // Otherwise repaint new spokes after this many refresh intervals
+  int m_arpa_spokes;          // Spokes processed since the ARPA thread was woken, protected by m_exclusive
+  wxSemaphore m_arpa_wake;    // Posted every ARPA_SECTOR_SPOKES spokes to run the ARPA thread
+#define ARPA_SECTOR_SPOKES (128)
   int m_main_timer_timeout;
 
   GuardZone *m_guard_zone[GUARD_ZONES];
@@ -204,32 +236,28 @@ class RadarInfo : public wxEvtHandler {
   };
 
   line_history m_history[LINES_PER_ROTATION];
+  SpokeBlobs *m_blobs;      // ARPA blobs of the last rotation, protected by m_exclusive
+  OccupancyPlane *m_plane;  // Returns of the last rotation and ARPA claims, read by ARPA without lock
 #define HISTORY_FILTER_ALLOW(x) (HasBitCount2[(x)&7])
 
-#define MARGIN (100)
-#define TRAILS_SIZE (RETURNS_PER_LINE * 2 + MARGIN * 2)
-  //#define TRAILS_MIDDLE (TRAILS_SIZE / 2)
-
   struct IntVector {
     int lat;
     int lon;
   };
   struct TrailBuffer {
-    TrailRevolutionsAge true_trails[TRAILS_SIZE][TRAILS_SIZE];
+    TrailRevolutionsAge true_trails[TRAILS_SIZE * TRAILS_SIZE];  // Index with TrailIndex()
     TrailRevolutionsAge relative_trails[LINES_PER_ROTATION][RETURNS_PER_LINE];
     union {
-      TrailRevolutionsAge copy_of_true_trails[TRAILS_SIZE][TRAILS_SIZE];
+      TrailRevolutionsAge copy_of_true_trails[TRAILS_SIZE * TRAILS_SIZE];
       TrailRevolutionsAge copy_of_relative_trails[LINES_PER_ROTATION][RETURNS_PER_LINE];
     };
     double lat;
     double lon;
     double dif_lat;  // Fraction of a pixel expressed in lat/lon for True Motion Target Trails
     double dif_lon;
-    IntVector offset;
+    IntVector offset;  // Position of the ship in the true trails image, unbounded
   };
   int m_old_range;
-  int m_dir_lat;
-  int m_dir_lon;
   TrailBuffer m_trails;
 
   /* Methods */
@@ -243,9 +271,14 @@ class RadarInfo : public wxEvtHandler {
   void AdjustRange(int adjustment);
   void SetAutoRangeMeters(int meters);
   bool SetControlValue(ControlType controlType, int value);
+  void QueueRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT8 *data, size_t len, int range_meters, wxLongLong time,
+                       double lat, double lon);
   void ProcessRadarSpoke(SpokeBearing angle, SpokeBearing bearing, UINT8 *data, size_t len, int range_meters, wxLongLong time,
                          double lat, double lon);
   void RefreshDisplay(wxTimerEvent &event);
+  void RefreshDue(wxCommandEvent &event);
+  void RequestRefresh();
+  void ScheduleRefresh();
   void UpdateTrailPosition();
   void RenderGuardZone();
   void ResetRadarImage();
@@ -289,6 +322,8 @@ class RadarInfo : public wxEvtHandler {
 
  private:
   void ResetSpokes();
+  void ClearTrailRows(int lat, int count);
+  void ClearTrailColumns(int lon, int count);
   void RenderRadarImage(DrawInfo *di);
   wxString FormatDistance(double distance);
   wxString FormatAngle(double angle);
@@ -305,7 +340,7 @@ class RadarInfo : public wxEvtHandler {
 
   wxString m_range_text;
 
-  BlobColour m_trail_colour[TRAIL_MAX_REVOLUTIONS + 1];
+  UINT8 m_trail_colour[TRAIL_COLOURS];  // BlobColour for each trail age
 
   DECLARE_EVENT_TABLE()
 };
@@ -31,20 +31,77 @@
 
 #include "RadarMarpa.h"
 #include "RadarInfo.h"
+#include "br24Arpa.h"
 #include "br24radar_pi.h"
 #include "drawutil.h"
+#include "spokeutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
+#define ARPA_MAX_NEAREST_BLOBS (256)  // Blobs looked at per FindNearestContour
+
 static int target_id_count = 0;
 
+// Grows array to size elements, keeping what is in it. Leaves it alone and returns false when out of memory.
+template <typename T>
+static bool GrowArray(T** array, int size) {
+  T* grown = (T*)realloc(*array, size * sizeof(T));
+  if (!grown) {
+    return false;
+  }
+  *array = grown;
+  return true;
+}
+
 RadarArpa::RadarArpa(br24radar_pi* pi, RadarInfo* ri) {
   m_ri = ri;
   m_pi = pi;
   m_radar_lost_count = 0;
+  m_targets = 0;
   m_number_of_targets = 0;
-  for (int i = 0; i < MAX_NUMBER_OF_TARGETS; i++) {
-    m_targets[i] = 0;
+  m_capacity = 0;
+  m_contours_revision = 0;
+  m_overlay_revision = 0;
+  m_panel_revision = 0;
+  m_snapshots = new ArpaSnapshot[3];
+  for (int i = 0; i < 3; i++) {
+    m_snapshots[i].revision = 0;
+    m_snapshots[i].targets = 0;
+    m_snapshots[i].target = 0;
+    m_snapshots[i].target_size = 0;
+    m_snapshots[i].point = 0;
+    m_snapshots[i].point_size = 0;
+  }
+  m_snapshot_front = 0;
+  m_snapshot_ready = 1;
+  m_snapshot_back = 2;
+  m_reports = 0;
+  m_report_count = 0;
+  m_report_size = 0;
+  m_sending = 0;
+  m_sending_size = 0;
+  m_workers = 0;
+  m_refresh_target = 0;
+  m_refresh_count = 0;
+  m_refresh_dist = TARGET_SEARCH_RADIUS1;
+  m_window = 0;
+  m_window_order = 0;
+  m_cluster_target = 0;
+  m_claim = 0;
+  m_cluster = 0;
+  m_clusters = 0;
+  m_next_cluster = 0;
+  m_saved = 0;
+  m_saved_kalman = 0;
+  m_saved_size = 0;
+  memset(m_grid, 0, sizeof(m_grid));
+  m_grid_range = 0;
+
+  m_thread = new br24Arpa(ri, this);
+  if (!m_thread || (m_thread->Run() != wxTHREAD_NO_ERROR)) {
+    LOG_INFO(wxT("BR24radar_pi: %s unable to start ARPA thread, refreshing targets in GUI thread"), m_ri->m_name.c_str());
+    delete m_thread;
+    m_thread = 0;
   }
   LOG_INFO(wxT("BR24radar_pi: RadarMarpa creator ready"));
 }
@@ -57,16 +114,68 @@ ArpaTarget::~ArpaTarget() {
 }
 
 RadarArpa::~RadarArpa() {
-  int n = m_number_of_targets;
-  m_number_of_targets = 0;
-  for (int i = 0; i < n; i++) {
-    if (m_targets[i]) {
-      delete m_targets[i];
-      m_targets[i] = 0;
+  if (m_thread) {
+    m_thread->Shutdown();
+    m_thread->Wait();
+    delete m_thread;
+    m_thread = 0;
+  }
+  for (int i = 0; i < m_workers; i++) {
+    m_worker[i]->Shutdown();
+    m_worker[i]->Wait();
+    delete m_worker[i];
+  }
+  m_workers = 0;
+  m_number_of_targets = 0;  // the targets themselves are deleted with m_pool
+  for (int i = 0; i < 3; i++) {
+    free(m_snapshots[i].target);
+    free(m_snapshots[i].point);
+  }
+  delete[] m_snapshots;
+  delete[] m_saved;
+  delete[] m_saved_kalman;
+  free(m_targets);
+  free(m_refresh_target);
+  free(m_window);
+  free(m_window_order);
+  free(m_cluster_target);
+  free(m_claim);
+  free(m_cluster);
+  free(m_reports);
+  free(m_sending);
+}
+
+ArpaTargetPool::ArpaTargetPool() {
+  m_slab = 0;
+  m_slabs = 0;
+  m_free = 0;
+  m_free_count = 0;
+}
+
+ArpaTargetPool::~ArpaTargetPool() {
+  for (int i = 0; i < m_slabs; i++) {
+    delete[] m_slab[i];
+  }
+  free(m_slab);
+  free(m_free);
+}
+
+ArpaTarget* ArpaTargetPool::Alloc() {
+  if (m_free_count == 0) {
+    if (!GrowArray(&m_slab, m_slabs + 1) || !GrowArray(&m_free, (m_slabs + 1) * ARPA_TARGET_SLAB)) {
+      return 0;
+    }
+    ArpaTarget* slab = new ArpaTarget[ARPA_TARGET_SLAB];
+    m_slab[m_slabs++] = slab;
+    for (int i = ARPA_TARGET_SLAB - 1; i >= 0; i--) {
+      m_free[m_free_count++] = slab + i;
     }
   }
+  return m_free[--m_free_count];
 }
 
+void ArpaTargetPool::Free(ArpaTarget* target) { m_free[m_free_count++] = target; }
+
 Position Polar2Pos(Polar pol, Position own_ship, double range) {
   // The "own_ship" in the fumction call can be the position at an earlier time than the current position
   // converts in a radar image angular data r ( 0 - 512) and angle (0 - 2096) to position (lat, lon)
@@ -92,49 +201,33 @@ Polar Pos2Polar(Position p, Position own_ship, int range) {
   return pol;
 }
 
-bool RadarArpa::Pix(int ang, int rad) {
-  if (rad <= 1 || rad >= RETURNS_PER_LINE - 1) {  //  avoid range ring
-    return false;
-  }
-  return ((m_ri->m_history[MOD_ROTATION2048(ang)].line[rad] & 128) != 0);
-}
+bool RadarArpa::Pix(int ang, int rad) { return m_ri->m_plane->IsFree(ang, rad); }
 
 bool ArpaTarget::Pix(int ang, int rad) {
-  if (rad <= 1 || rad >= RETURNS_PER_LINE - 1) {  //  avoid range ring
-    return false;
+  if (m_cluster && !InWindow(ang, 0)) {
+    m_strayed = true;  // another cluster may be claiming this spoke, so the pass is redone serially
   }
   if (m_check_for_duplicate) {
-    // check bit 1
-    return ((m_ri->m_history[MOD_ROTATION2048(ang)].line[rad] & 64) != 0);
-  } else {
-    // check bit 0
-    return ((m_ri->m_history[MOD_ROTATION2048(ang)].line[rad] & 128) != 0);
+    // any return, also the ones claimed by other targets
+    return m_ri->m_plane->IsReturn(ang, rad);
   }
+  if (!m_ri->m_plane->IsFree(ang, rad)) {
+    return false;
+  }
+  if (m_cluster) {
+    // claims of the targets refreshed before this one in the cluster are not in the plane yet
+    for (int i = 0; i < m_cluster->claims; i++) {
+      ArpaClaim& claim = m_cluster->claim[i];
+      if (MOD_ROTATION2048(ang - claim.min_angle) <= claim.angles && rad >= claim.min_r && rad <= claim.max_r) {
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
-bool RadarArpa::MultiPix(int ang, int rad) {
-  // returns true if a pixel i ang, rad and the blob contains at least 3 pixels
-  int test = 0;
-  if (!Pix(ang, rad)) return false;
-  test = Pix(ang + 1, rad) + Pix(ang - 1, rad) + Pix(ang, rad + 1) + Pix(ang, rad - 1);
-  if (test >= 2) return true;
-  test += Pix(ang + 1, rad + 1) + Pix(ang - 1, rad - 1) + Pix(ang - 1, rad + 1) + Pix(ang + 1, rad - 1);
-  if (test >= 2) return true;
-  test += Pix(ang + 2, rad + 2) + Pix(ang - 1, rad - 1) + Pix(ang - 1, rad + 1) + Pix(ang + 1, rad - 1);
-  return false;
-}
-
-bool ArpaTarget::MultiPix(int ang, int rad) {
-  // returns true if a pixel i ang, rad and the blob contains at least 3 pixels
-  int test = 0;
-  if (!Pix(ang, rad)) return false;
-  test = Pix(ang + 1, rad) + Pix(ang - 1, rad) + Pix(ang, rad + 1) + Pix(ang, rad - 1);
-  if (test >= 2) return true;
-  test += Pix(ang + 1, rad + 1) + Pix(ang - 1, rad - 1) + Pix(ang - 1, rad + 1) + Pix(ang + 1, rad - 1);
-  if (test >= 2) return true;
-  test += Pix(ang + 2, rad + 2) + Pix(ang - 1, rad - 1) + Pix(ang - 1, rad + 1) + Pix(ang + 1, rad - 1);
-  return false;
-}
+// Whether the spokes from ang to ang + angles are all in the window of the cluster being refreshed
+bool ArpaTarget::InWindow(int ang, int angles) { return MOD_ROTATION2048(ang - m_cluster->lo) + angles <= m_cluster->len; }
 
 void RadarArpa::AcquireNewMARPATarget(Position target_pos) { AcquireOrDeleteMarpaTarget(target_pos, ACQUIRE0); }
 
@@ -146,22 +239,13 @@ void RadarArpa::AcquireOrDeleteMarpaTarget(Position target_pos, int status) {
   // target status acquire0
   // returns in X metric coordinates of click
   // constructs Kalman filter
+  wxCriticalSectionLocker lock(m_lock);
 
   // make new target
-  int i_target;
-  if (m_number_of_targets < MAX_NUMBER_OF_TARGETS - 1 ||
-      (m_number_of_targets == MAX_NUMBER_OF_TARGETS - 1 && status == FOR_DELETION)) {
-    if (m_targets[m_number_of_targets] == 0) {
-      m_targets[m_number_of_targets] = new ArpaTarget(m_pi, m_ri);
-    }
-    i_target = m_number_of_targets;
-    m_number_of_targets++;
-  } else {
-    LOG_INFO(wxT("BR24radar_pi: RadarArpa:: Error, max targets exceeded "));
+  ArpaTarget* target = NewTarget(status);
+  if (!target) {
     return;
   }
-
-  ArpaTarget* target = m_targets[i_target];
   target->m_position = target_pos;  // Expected position
   target->m_position.time = 0;
   target->m_position.dlat_dt = 0.;
@@ -177,9 +261,145 @@ void RadarArpa::AcquireOrDeleteMarpaTarget(Position target_pos, int status) {
     target->m_kalman = new KalmanFilter();
   }
   target->m_automatic = false;
+  AddToGrid(target);
   return;
 }
 
+// ArpaMaxTargets, within what the target ids allow
+int RadarArpa::MaxTargets() {
+  int max = m_pi->m_settings.arpa_max_targets;
+  if (max <= 0) {
+    return MAX_NUMBER_OF_TARGETS;
+  }
+  return wxMax(2, wxMin(max, ARPA_TARGETS_LIMIT));
+}
+
+// Makes room for targets in m_targets and in the arrays that hold something per target. Called with m_lock held.
+bool RadarArpa::Reserve(int targets) {
+  if (targets <= m_capacity) {
+    return true;
+  }
+  int capacity = wxMax(targets, wxMin(m_capacity * 2, MaxTargets()));
+  if (!GrowArray(&m_targets, capacity) || !GrowArray(&m_refresh_target, capacity) || !GrowArray(&m_window, capacity) ||
+      !GrowArray(&m_window_order, capacity) || !GrowArray(&m_cluster_target, capacity) || !GrowArray(&m_claim, capacity) ||
+      !GrowArray(&m_cluster, capacity)) {
+    LOG_INFO(wxT("BR24radar_pi: %s out of memory for %d ARPA targets"), m_ri->m_name.c_str(), capacity);
+    return false;
+  }
+  {
+    wxCriticalSectionLocker lock(m_report_lock);
+    if (!GrowArray(&m_reports, capacity * ARPA_REPORTS_PER_TARGET)) {
+      return false;
+    }
+    m_report_size = capacity * ARPA_REPORTS_PER_TARGET;
+  }
+  m_capacity = capacity;
+  return true;
+}
+
+// Takes a target from the pool and adds it to the end of m_targets, 0 when ArpaMaxTargets are in use.
+// The last one is kept for a target with status FOR_DELETION. Called with m_lock held.
+ArpaTarget* RadarArpa::NewTarget(int status) {
+  int max = MaxTargets();
+  if (m_number_of_targets >= max || (m_number_of_targets == max - 1 && status != FOR_DELETION)) {
+    LOG_INFO(wxT("BR24radar_pi: RadarArpa:: Error, max targets exceeded %i"), m_number_of_targets);
+    return 0;
+  }
+  if (!Reserve(m_number_of_targets + 1)) {
+    return 0;
+  }
+  ArpaTarget* target = m_pool.Alloc();
+  if (!target) {
+    return 0;
+  }
+  target->set(m_pi, m_ri);
+  m_targets[m_number_of_targets++] = target;
+  return target;
+}
+
+// Puts every target in the bucket of the grid for its angle and range. Called with m_lock held.
+void RadarArpa::BuildGrid() {
+  memset(m_grid, 0, sizeof(m_grid));
+  m_grid_range = m_ri->m_range_meters;
+  for (int i = 0; i < m_number_of_targets; i++) {
+    if (m_targets[i]) {
+      AddToGrid(m_targets[i]);
+    }
+  }
+}
+
+void RadarArpa::AddToGrid(ArpaTarget* target) {
+  int sector = 0;
+  int band = 0;
+  if (m_grid_range > 0) {
+    Position own_pos;
+    own_pos.lat = m_pi->m_ownship_lat;
+    own_pos.lon = m_pi->m_ownship_lon;
+    Polar pol = Pos2Polar(target->m_position, own_pos, m_grid_range);
+    sector = MOD_ROTATION2048(pol.angle) / ARPA_GRID_SPOKES;
+    band = wxMax(0, wxMin(pol.r / ARPA_GRID_RETURNS, ARPA_GRID_BANDS - 1));
+  }
+  target->m_grid_next = m_grid[sector][band];
+  m_grid[sector][band] = target;
+}
+
+// Finds the target nearest to pos that is not lost, other than except. The buckets of the grid are searched
+// in rings around pos, until the buckets outside the ring are too far away to hold a nearer target.
+// The grid was built for the own ship position of the last refresh, so a target that is less than
+// ARPA_GRID_SLACK returns nearer than the one found may be missed when own ship moved further than that.
+// Called with m_lock held.
+ArpaTarget* RadarArpa::FindNearestTarget(Position* pos, ArpaTarget* except) {
+  if (m_grid_range != m_ri->m_range_meters) {
+    BuildGrid();
+  }
+  int sector = 0;
+  int band = 0;
+  Polar pol;
+  pol.r = 0;
+  if (m_grid_range > 0) {
+    Position own_pos;
+    own_pos.lat = m_pi->m_ownship_lat;
+    own_pos.lon = m_pi->m_ownship_lon;
+    pol = Pos2Polar(*pos, own_pos, m_grid_range);
+    sector = MOD_ROTATION2048(pol.angle) / ARPA_GRID_SPOKES;
+    band = wxMax(0, wxMin(pol.r / ARPA_GRID_RETURNS, ARPA_GRID_BANDS - 1));
+  }
+  double degrees_per_return = (double)m_grid_range / RETURNS_PER_LINE / 60. / 1852.;
+
+  ArpaTarget* nearest = 0;
+  double min_dist = 1000;
+  for (int k = 0; k <= ARPA_GRID_SECTORS / 2 || k < ARPA_GRID_BANDS; k++) {
+    int first_sector = -wxMin(k, ARPA_GRID_SECTORS / 2 - 1);
+    int last_sector = wxMin(k, ARPA_GRID_SECTORS / 2);
+    for (int db = -k; db <= k; db++) {
+      if (band + db < 0 || band + db >= ARPA_GRID_BANDS) continue;
+      for (int ds = first_sector; ds <= last_sector; ds++) {
+        if (abs(ds) != k && abs(db) != k) continue;  // inside the ring, searched already
+        ArpaTarget* t = m_grid[(sector + ds + ARPA_GRID_SECTORS) % ARPA_GRID_SECTORS][band + db];
+        for (; t; t = t->m_grid_next) {
+          if (t == except || t->m_status == LOST) continue;
+          double dif_lat = pos->lat - t->m_position.lat;
+          double dif_lon = (pos->lon - t->m_position.lon) * cos(deg2rad(pos->lat));
+          double dist2 = dif_lat * dif_lat + dif_lon * dif_lon;
+          if (dist2 < min_dist) {
+            min_dist = dist2;
+            nearest = t;
+          }
+        }
+      }
+    }
+    if (nearest) {
+      // returns between pos and any bucket outside the ring
+      double bound = wxMin((double)k * ARPA_GRID_RETURNS, pol.r * sin(deg2rad(wxMin(k * 360. / ARPA_GRID_SECTORS, 90.))));
+      bound = (bound - ARPA_GRID_SLACK) * degrees_per_return;
+      if (bound > 0. && bound * bound >= min_dist) {
+        break;
+      }
+    }
+  }
+  return nearest;
+}
+
 bool ArpaTarget::FindContourFromInside(Polar* pol) {  // moves pol to contour of blob
   // true if success
   // false when failed
@@ -203,7 +423,6 @@ int ArpaTarget::GetContour(Polar* pol) {  // sets the measured_pos if succesfull
                                           // pol must start on the contour of the blob
                                           // follows the contour in a clockwise direction
                                           // returns metric position of the blob in Z
-  wxCriticalSectionLocker lock(ArpaTarget::m_ri->m_exclusive);
   // the 4 possible translations to move from a point on the contour to the next
   Polar transl[4];  //   = { 0, 1,   1, 0,   0, -1,   -1, 0 };
   transl[0].angle = 0;
@@ -301,6 +520,7 @@ int ArpaTarget::GetContour(Polar* pol) {  // sets the measured_pos if succesfull
     }
   }
   m_contour_length = count;
+  m_contour_changed = true;
   //  CalculateCentroid(*target);    we better use the real centroid instead of the average, todo
   if (m_min_angle.angle < 0) {
     m_min_angle.angle += LINES_PER_ROTATION;
@@ -321,108 +541,150 @@ int ArpaTarget::GetContour(Polar* pol) {  // sets the measured_pos if succesfull
   return 0;  //  succes, blob found
 }
 
-void RadarArpa::DrawContour(ArpaTarget* target) {
-  // should be improved using vertex arrays
+// Add the contour of a target to the list in radar units, as separate lines so all targets go in one draw call
+void RadarArpa::AddContour(DrawList* list, ArpaSnapshot* snapshot, ArpaSnapshotTarget* target) {
   PolarToCartesianLookupTable* polarLookup;
   polarLookup = GetPolarToCartesianLookupTable();
-  glColor4ub(40, 40, 100, 250);
-  glLineWidth(3.0);
-  glBegin(GL_LINES);
-  for (int i = 0; i < target->m_contour_length; i++) {
-    double xx;
-    double yy;
-    int angle = MOD_ROTATION2048(target->m_contour[i].angle - 512);
-    int radius = target->m_contour[i].r;
-    if (radius <= 0 || radius >= RETURNS_PER_LINE) {
-      return;
-    }
-    xx = polarLookup->x[angle][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    yy = polarLookup->y[angle][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    glVertex2f(xx, yy);
+  ArpaSnapshotPoint* contour = snapshot->point + target->first;
+  list->SetColour(40, 40, 100, 250);
+  for (int i = 0; i < target->length; i++) {
     int ii = i + 1;
-    if (ii == target->m_contour_length) {
+    if (ii == target->length) {
       ii = 0;  // start point again
     }
-    if (radius <= 0 || radius >= RETURNS_PER_LINE) {
+    int angle1 = MOD_ROTATION2048(contour[i].angle - 512);
+    int radius1 = contour[i].r;
+    int angle2 = MOD_ROTATION2048(contour[ii].angle - 512);
+    int radius2 = contour[ii].r;
+    if (radius1 <= 0 || radius1 >= RETURNS_PER_LINE || radius2 <= 0 || radius2 >= RETURNS_PER_LINE) {
       return;
     }
-    angle = MOD_ROTATION2048(target->m_contour[ii].angle - 512);
-    radius = target->m_contour[ii].r;
-    xx = polarLookup->x[angle][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    yy = polarLookup->y[angle][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    glVertex2f(xx, yy);
+    list->AddLine(polarLookup->X(angle1, radius1), polarLookup->Y(angle1, radius1), polarLookup->X(angle2, radius2),
+                  polarLookup->Y(angle2, radius2));
   }
 // following displays expected position with crosses that indicate the size of the search area
 // for debugging only
 
 #ifdef MARPA_DEBUG
   // draw expected pos for test
-  int angle = MOD_ROTATION2048(target->expected.angle - 512);
-  int radius = target->expected.r;
+  int angle = MOD_ROTATION2048(target->expected_angle - 512);
+  int radius = target->expected_r;
 
-  double xx;
-  double yy;
   int dist_a = (int)(326. / (double)radius * TARGET_SEARCH_RADIUS2 / 2.);
   int dist_r = (int)((double)TARGET_SEARCH_RADIUS2 / 2.);
-  glColor4ub(0, 250, 0, 250);
+  list->SetColour(0, 250, 0, 250);
   if (radius < 511 - dist_r && radius > dist_r) {
-    xx = polarLookup->x[MOD_ROTATION2048(angle)][radius - dist_r] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    yy = polarLookup->y[MOD_ROTATION2048(angle)][radius - dist_r] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    glVertex2f(xx, yy);
-    xx = polarLookup->x[MOD_ROTATION2048(angle)][radius + dist_r] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    yy = polarLookup->y[MOD_ROTATION2048(angle)][radius + dist_r] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    glVertex2f(xx, yy);
-    xx = polarLookup->x[MOD_ROTATION2048(angle - dist_a)][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    yy = polarLookup->y[MOD_ROTATION2048(angle - dist_a)][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    glVertex2f(xx, yy);
-    xx = polarLookup->x[MOD_ROTATION2048(angle + dist_a)][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    yy = polarLookup->y[MOD_ROTATION2048(angle + dist_a)][radius] * m_ri->m_range_meters / RETURNS_PER_LINE;
-    glVertex2f(xx, yy);
+    list->AddLine(polarLookup->X(angle, radius - dist_r), polarLookup->Y(angle, radius - dist_r),
+                  polarLookup->X(angle, radius + dist_r), polarLookup->Y(angle, radius + dist_r));
+    int angle1 = MOD_ROTATION2048(angle - dist_a);
+    int angle2 = MOD_ROTATION2048(angle + dist_a);
+    list->AddLine(polarLookup->X(angle1, radius), polarLookup->Y(angle1, radius), polarLookup->X(angle2, radius),
+                  polarLookup->Y(angle2, radius));
   }
 #endif
-
-  glEnd();
 }
 
-void RadarArpa::DrawArpaTargets() {
+// Copy the contours into the back snapshot and make it the ready one, if any contour changed.
+// Called with m_lock held.
+void RadarArpa::PublishSnapshot() {
+  bool changed = false;
+  int points = 0;
   for (int i = 0; i < m_number_of_targets; i++) {
-    if (!m_targets[i]) continue;
-    if (m_targets[i]->m_status != LOST) {
-      DrawContour(m_targets[i]);
+    if (m_targets[i] && m_targets[i]->m_contour_changed) {
+      m_targets[i]->m_contour_changed = false;
+      changed = true;
+    }
+    if (m_targets[i] && m_targets[i]->m_status != LOST) {
+      points += m_targets[i]->m_contour_length;
+    }
+  }
+  if (!changed) {
+    return;
+  }
+
+  ArpaSnapshot* snapshot = m_snapshots + m_snapshot_back;
+  if (snapshot->target_size < m_number_of_targets) {
+    if (!GrowArray(&snapshot->target, m_number_of_targets)) {
+      return;
+    }
+    snapshot->target_size = m_number_of_targets;
+  }
+  if (snapshot->point_size < points) {
+    if (!GrowArray(&snapshot->point, points)) {
+      return;
+    }
+    snapshot->point_size = points;
+  }
+  points = 0;
+  snapshot->targets = 0;
+  for (int i = 0; i < m_number_of_targets; i++) {
+    ArpaTarget* target = m_targets[i];
+    if (!target || target->m_status == LOST) continue;
+
+    ArpaSnapshotTarget* t = snapshot->target + snapshot->targets++;
+    t->first = points;
+    t->length = target->m_contour_length;
+    t->expected_angle = target->m_expected.angle;
+    t->expected_r = target->m_expected.r;
+    for (int j = 0; j < target->m_contour_length; j++) {
+      snapshot->point[points].angle = (UINT16)MOD_ROTATION2048(target->m_contour[j].angle);
+      snapshot->point[points].r = (UINT16)target->m_contour[j].r;
+      points++;
     }
   }
+  snapshot->revision = ++m_contours_revision;
+  m_snapshot_back = (int)ARPA_EXCHANGE(&m_snapshot_ready, (long)(m_snapshot_back | ARPA_SNAPSHOT_FRESH)) & ARPA_SNAPSHOT_INDEX;
 }
 
-void RadarArpa::RefreshArpaTargets() {
-  // remove targets with status LOST and put them at the end
-  if (m_number_of_targets > 0) {
-    if (m_pi->m_context_menu_delete_marpa_target == 0) {
-      wxMenu dummy_menu;
-      wxMenuItem* mi5 = new wxMenuItem(&dummy_menu, -1, _("Delete Arpa Target"));
-      wxMenuItem* mi6 = new wxMenuItem(&dummy_menu, -1, _("Delete all Arpa Targets"));
-#ifdef __WXMSW__
-      wxFont* qFont = OCPNGetFont(_("Menu"), 10);
-      mi5->SetFont(*qFont);
-      mi6->SetFont(*qFont);
-#endif
-      m_pi->m_context_menu_delete_marpa_target = AddCanvasContextMenuItem(mi5, m_pi);
-      m_pi->m_context_menu_delete_all_marpa_targets = AddCanvasContextMenuItem(mi6, m_pi);
+// The last snapshot that the ARPA thread published. GUI thread only.
+ArpaSnapshot* RadarArpa::TakeSnapshot() {
+  if (ARPA_LOAD(&m_snapshot_ready) & ARPA_SNAPSHOT_FRESH) {
+    m_snapshot_front = (int)ARPA_EXCHANGE(&m_snapshot_ready, (long)m_snapshot_front) & ARPA_SNAPSHOT_INDEX;
+  }
+  return m_snapshots + m_snapshot_front;
+}
+
+// Draw all contours with one draw call. The list is only built again when a new snapshot has been published.
+// The overlay and the radar window have their own list, as they draw in a different OpenGL context.
+void RadarArpa::DrawArpaTargets(bool overlay) {
+  DrawList* list = overlay ? &m_draw_overlay : &m_draw_panel;
+  unsigned int* revision = overlay ? &m_overlay_revision : &m_panel_revision;
+  ArpaSnapshot* snapshot = TakeSnapshot();
+
+  if (*revision != snapshot->revision) {
+    list->Clear();
+    for (int i = 0; i < snapshot->targets; i++) {
+      AddContour(list, snapshot, snapshot->target + i);
     }
+    *revision = snapshot->revision;
   }
+
+  double scale = (double)m_ri->m_range_meters / RETURNS_PER_LINE;  // Contours are in radar units
+  glPushAttrib(GL_LINE_BIT);
+  glLineWidth(3.0);
+  glPushMatrix();
+  glScaled(scale, scale, 1.);
+  list->Draw();
+  glPopMatrix();
+  glPopAttrib();
+}
+
+// Called by the ARPA thread every ARPA_SECTOR_SPOKES spokes
+void RadarArpa::RefreshArpaTargets() {
+  wxCriticalSectionLocker lock(m_lock);
+
+  // remove targets with status LOST and give them back to the pool, keep the others in sequence
+  int kept = 0;
   for (int i = 0; i < m_number_of_targets; i++) {
-    if (m_targets[i]) {
-      if (m_targets[i]->m_status == LOST) {
-        // we keep the lost target for later use, destruction and construction is expensive
-        ArpaTarget* lost = m_targets[i];
-        int len = sizeof(ArpaTarget*);
-        // move rest of larget list up to keep them in sequence
-        memmove(&m_targets[i], &m_targets[i] + 1, (m_number_of_targets - i) * len);
-        m_number_of_targets--;
-        // set the lost target at the last position
-        m_targets[m_number_of_targets] = lost;
-      }
+    if (!m_targets[i]) continue;
+    if (m_targets[i]->m_status == LOST) {
+      m_pool.Free(m_targets[i]);
+    } else {
+      m_targets[kept++] = m_targets[i];
     }
   }
+  m_number_of_targets = kept;
+  BuildGrid();  // the freed targets are still linked in their buckets
 
   int target_to_delete = -1;
   // find a target with status FOR_DELETION if it is there
@@ -434,62 +696,301 @@ void RadarArpa::RefreshArpaTargets() {
   }
   if (target_to_delete != -1) {
     // delete the target that is closest to the target with status FOR_DELETION
-    Position* deletePosition = &m_targets[target_to_delete]->m_position;
-    double min_dist = 1000;
-    int del_target = -1;
-    for (int i = 0; i < m_number_of_targets; i++) {
-      if (!m_targets[i]) continue;
-      if (i == target_to_delete || m_targets[i]->m_status == LOST) continue;
-      double dif_lat = deletePosition->lat - m_targets[i]->m_position.lat;
-      double dif_lon = (deletePosition->lon - m_targets[i]->m_position.lon) * cos(deg2rad(deletePosition->lat));
-      double dist2 = dif_lat * dif_lat + dif_lon * dif_lon;
-      if (dist2 < min_dist) {
-        min_dist = dist2;
-        del_target = i;
-      }
-    }
-    // del_target is the index of the target closest to target with index target_to_delete
-    if (del_target != -1) {
-      m_targets[del_target]->SetStatusLost();
+    ArpaTarget* del_target = FindNearestTarget(&m_targets[target_to_delete]->m_position, m_targets[target_to_delete]);
+    if (del_target) {
+      del_target->SetStatusLost();
     }
     m_targets[target_to_delete]->SetStatusLost();
   }
 
-  ArpaTarget t;
-  KalmanFilter k;
   // main target refresh loop
+  RefreshPass(PASS1);
+  RefreshPass(PASS2);
+  BuildGrid();
+
+  if (m_pi->m_settings.guard_zone_on_overlay) {
+    m_ri->m_guard_zone[0]->SearchTargets();
+  }
+  if (m_pi->m_settings.guard_zone_on_overlay) {
+    m_ri->m_guard_zone[1]->SearchTargets();
+  }
+  PublishSnapshot();
+}
 
-  // pass 1 of target refresh
-  int dist = TARGET_SEARCH_RADIUS1;
+// One pass of the target refresh: pass 1 looks for all targets close to where they are expected,
+// pass 2 searches further for the ones that were not found in pass 1.
+void RadarArpa::RefreshPass(PassN pass) {
+  m_refresh_dist = (pass == PASS1) ? TARGET_SEARCH_RADIUS1 : TARGET_SEARCH_RADIUS2;
+  m_refresh_count = 0;
   for (int i = 0; i < m_number_of_targets; i++) {
     if (!m_targets[i]) {
-      LOG_INFO(wxT("BR24radar_pi:  error target non existent i=%i"), i);
+      LOG_INFO(wxT("BR24radar_pi: error target non existent i=%i"), i);
       continue;
     }
-    m_targets[i]->m_pass_nr = PASS1;
-    if (m_targets[i]->m_pass1_result == NOT_FOUND_IN_PASS1) continue;
-    m_targets[i]->RefreshTarget(dist);
-    if (m_targets[i]->m_pass1_result == NOT_FOUND_IN_PASS1) {
+    if (pass == PASS1) {
+      m_targets[i]->m_pass_nr = PASS1;
+      if (m_targets[i]->m_pass1_result == NOT_FOUND_IN_PASS1) continue;
+    } else {
+      if (m_targets[i]->m_pass1_result == UNKNOWN) continue;
+      m_targets[i]->m_pass_nr = PASS2;
+    }
+    if (m_targets[i]->m_status != LOST) {
+      m_refresh_target[m_refresh_count++] = i;
     }
   }
 
-  // pass 2 of target refresh
-  dist = TARGET_SEARCH_RADIUS2;
-  for (int i = 0; i < m_number_of_targets; i++) {
-    if (!m_targets[i]) {
-      LOG_INFO(wxT("BR24radar_pi: error target non existent i=%i"), i);
-      continue;
+  int threads = wxMin(m_pi->m_settings.arpa_threads, ARPA_MAX_WORKERS + 1);
+  if (threads > 1 && m_refresh_count > 1 && BuildClusters() && RefreshParallel(threads)) {
+    return;
+  }
+  for (int k = 0; k < m_refresh_count; k++) {
+    m_targets[m_refresh_target[k]]->RefreshTarget(m_refresh_dist);
+  }
+}
+
+// Groups the targets of the pass in clusters of overlapping windows, the spokes that a target may look at
+// when it is refreshed. Returns false when there are less than two clusters.
+bool RadarArpa::BuildClusters() {
+  ArpaWindow* window = m_window;
+  int* order = m_window_order;
+  Position own_pos;
+
+  own_pos.lat = m_pi->m_ownship_lat;
+  own_pos.lon = m_pi->m_ownship_lon;
+  for (int k = 0; k < m_refresh_count; k++) {
+    ArpaTarget* t = m_targets[m_refresh_target[k]];
+    Polar pol = Pos2Polar(t->m_position, own_pos, m_ri->m_range_meters);
+    int dist = m_refresh_dist;
+    if (t->m_status == ACQUIRE0 || t->m_status == ACQUIRE1) {
+      dist *= 2;  // as in GetTarget
+    }
+    // search width of FindNearestContour plus the size of the blob and its claim
+    int reach = (int)(326. / (double)wxMax(pol.r, 1) * wxMax(dist, 2)) + abs(t->m_max_angle.angle - t->m_min_angle.angle) +
+                DISTANCE_BETWEEN_TARGETS + ARPA_CLUSTER_MARGIN;
+    if (2 * reach + 1 >= LINES_PER_ROTATION) {
+      return false;  // target close to the radar, it overlaps all others
     }
-    if (m_targets[i]->m_pass1_result == UNKNOWN) continue;
-    m_targets[i]->m_pass_nr = PASS2;
-    m_targets[i]->RefreshTarget(dist);
+    window[k].lo = pol.angle - reach;
+    window[k].hi = pol.angle + reach;
+    int j = k;
+    while (j > 0 && window[order[j - 1]].lo > window[k].lo) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = k;
   }
 
-  if (m_pi->m_settings.guard_zone_on_overlay) {
-    m_ri->m_guard_zone[0]->SearchTargets();
+  // merge the windows into clusters, lo and len hold the unreduced first and last spoke until they are final
+  ArpaCluster* cluster = m_cluster;
+  int clusters = 0;
+  for (int j = 0; j < m_refresh_count; j++) {
+    int k = order[j];
+    if (clusters == 0 || window[k].lo > cluster[clusters - 1].len) {
+      cluster[clusters].lo = window[k].lo;
+      cluster[clusters].len = window[k].hi;
+      clusters++;
+    } else if (window[k].hi > cluster[clusters - 1].len) {
+      cluster[clusters - 1].len = window[k].hi;
+    }
+    window[k].cluster = clusters - 1;
   }
-  if (m_pi->m_settings.guard_zone_on_overlay) {
-    m_ri->m_guard_zone[1]->SearchTargets();
+  // the last cluster may reach past north into the first one
+  if (clusters > 1 && cluster[clusters - 1].len - LINES_PER_ROTATION >= cluster[0].lo) {
+    clusters--;
+    cluster[0].len = wxMax(cluster[0].len, cluster[clusters].len - LINES_PER_ROTATION);
+    cluster[0].lo = cluster[clusters].lo - LINES_PER_ROTATION;
+    if (clusters > 1 && cluster[0].len >= cluster[1].lo) {
+      return false;
+    }
+    for (int k = 0; k < m_refresh_count; k++) {
+      if (window[k].cluster == clusters) {
+        window[k].cluster = 0;
+      }
+    }
+  }
+  if (clusters < 2) {
+    return false;
+  }
+
+  // list the targets of each cluster in index order
+  for (int c = 0; c < clusters; c++) {
+    cluster[c].len -= cluster[c].lo;
+    cluster[c].lo = MOD_ROTATION2048(cluster[c].lo);
+    cluster[c].count = 0;
+    cluster[c].claims = 0;
+  }
+  for (int k = 0; k < m_refresh_count; k++) {
+    cluster[window[k].cluster].count++;
+  }
+  int first = 0;
+  for (int c = 0; c < clusters; c++) {
+    cluster[c].first = first;
+    cluster[c].claim = m_claim + first;
+    first += cluster[c].count;
+    cluster[c].count = 0;
+  }
+  for (int k = 0; k < m_refresh_count; k++) {
+    ArpaCluster& c = cluster[window[k].cluster];
+    m_cluster_target[c.first + c.count++] = m_refresh_target[k];
+  }
+  m_clusters = clusters;
+  return true;
+}
+
+// Refreshes the clusters on this thread and on up to threads - 1 workers. The claims, new target ids and reports
+// are applied afterwards in target order, as the serial loop would have done. When a target touched a spoke
+// outside its cluster window the targets are put back as they were and false is returned to redo the pass serially.
+bool RadarArpa::RefreshParallel(int threads) {
+  while (m_workers < threads - 1) {
+    br24ArpaWorker* worker = new br24ArpaWorker(this, &m_workers_done);
+    if (worker->Run() != wxTHREAD_NO_ERROR) {
+      LOG_INFO(wxT("BR24radar_pi: %s unable to start ARPA worker thread"), m_ri->m_name.c_str());
+      delete worker;
+      break;
+    }
+    m_worker[m_workers++] = worker;
+  }
+  if (m_saved_size < m_capacity) {
+    delete[] m_saved;
+    delete[] m_saved_kalman;
+    m_saved = new ArpaTarget[m_capacity];
+    m_saved_kalman = new KalmanFilter[m_capacity];
+    m_saved_size = m_capacity;
+  }
+
+  for (int k = 0; k < m_refresh_count; k++) {
+    ArpaTarget* t = m_targets[m_refresh_target[k]];
+    m_saved[k] = *t;
+    m_saved[k].m_kalman = 0;
+    if (t->m_kalman) {
+      m_saved_kalman[k] = *t->m_kalman;
+    }
+  }
+  for (int c = 0; c < m_clusters; c++) {
+    for (int j = 0; j < m_cluster[c].count; j++) {
+      ArpaTarget* t = m_targets[m_cluster_target[m_cluster[c].first + j]];
+      t->m_cluster = &m_cluster[c];
+      t->m_strayed = false;
+    }
+  }
+
+  m_next_cluster = 0;
+  int started = wxMin(threads - 1, m_workers);
+  for (int i = 0; i < started; i++) {
+    m_worker[i]->Start();
+  }
+  RefreshClusters();
+  for (int i = 0; i < started; i++) {
+    m_workers_done.Wait();
+  }
+
+  bool strayed = false;
+  for (int k = 0; k < m_refresh_count; k++) {
+    ArpaTarget* t = m_targets[m_refresh_target[k]];
+    strayed = strayed || t->m_strayed;
+    t->m_cluster = 0;
+  }
+  if (strayed) {
+    for (int k = 0; k < m_refresh_count; k++) {
+      ArpaTarget* t = m_targets[m_refresh_target[k]];
+      KalmanFilter* kalman = t->m_kalman;
+      *t = m_saved[k];
+      t->m_kalman = kalman;
+      if (kalman) {
+        *kalman = m_saved_kalman[k];
+      }
+    }
+    LOG_VERBOSE(wxT("BR24radar_pi: %s ARPA target left its sector, refreshing serially"), m_ri->m_name.c_str());
+    return false;
+  }
+
+  for (int c = 0; c < m_clusters; c++) {
+    for (int i = 0; i < m_cluster[c].claims; i++) {
+      ArpaClaim& claim = m_cluster[c].claim[i];
+      m_ri->m_plane->Claim(claim.min_angle, claim.min_angle + claim.angles, claim.min_r, claim.max_r);
+    }
+  }
+  for (int k = 0; k < m_refresh_count; k++) {
+    ArpaTarget* t = m_targets[m_refresh_target[k]];
+    if (t->m_id_pending) {
+      t->AssignTargetId();
+      t->m_report.target_id = t->m_target_id;
+      t->m_id_pending = false;
+    }
+    if (t->m_report_pending) {
+      QueueReport(t->m_report);
+      t->m_report_pending = false;
+    }
+  }
+  return true;
+}
+
+// Refreshes clusters until none is left, called by the ARPA thread and its workers at the same time
+void RadarArpa::RefreshClusters() {
+  while (true) {
+    int c;
+    {
+      wxCriticalSectionLocker lock(m_cluster_lock);
+      if (m_next_cluster >= m_clusters) {
+        return;
+      }
+      c = m_next_cluster++;
+    }
+    ArpaCluster& cluster = m_cluster[c];
+    for (int j = 0; j < cluster.count; j++) {
+      m_targets[m_cluster_target[cluster.first + j]]->RefreshTarget(m_refresh_dist);
+    }
+  }
+}
+
+// Called by the GUI thread: sends the target reports that the ARPA thread has queued to OpenCPN
+void RadarArpa::SendReports() {
+  if (!m_thread && m_ri->m_arpa_wake.TryWait() == wxSEMA_NO_ERROR) {
+    RefreshArpaTargets();
+  }
+  if (m_number_of_targets > 0) {
+    if (m_pi->m_context_menu_delete_marpa_target == 0) {
+      wxMenu dummy_menu;
+      wxMenuItem* mi5 = new wxMenuItem(&dummy_menu, -1, _("Delete Arpa Target"));
+      wxMenuItem* mi6 = new wxMenuItem(&dummy_menu, -1, _("Delete all Arpa Targets"));
+#ifdef __WXMSW__
+      wxFont* qFont = OCPNGetFont(_("Menu"), 10);
+      mi5->SetFont(*qFont);
+      mi6->SetFont(*qFont);
+#endif
+      m_pi->m_context_menu_delete_marpa_target = AddCanvasContextMenuItem(mi5, m_pi);
+      m_pi->m_context_menu_delete_all_marpa_targets = AddCanvasContextMenuItem(mi6, m_pi);
+    }
+  }
+
+  int n;
+  {
+    wxCriticalSectionLocker lock(m_report_lock);
+    n = m_report_count;
+    if (n > m_sending_size) {
+      if (!GrowArray(&m_sending, m_report_size)) {
+        return;
+      }
+      m_sending_size = m_report_size;
+    }
+    memcpy(m_sending, m_reports, n * sizeof(ArpaReport));
+    m_report_count = 0;
+  }
+  for (int i = 0; i < n; i++) {
+    ArpaReport& report = m_sending[i];
+    // Check for AIS target at (M)ARPA position
+    if (report.ais_offset > 0. &&
+        m_pi->FindAIS_at_arpaPos(report.position.lat, report.position.lon, report.ais_offset)) {
+      report.status = L;
+    }
+    SendReport(report);
+  }
+}
+
+void RadarArpa::QueueReport(const ArpaReport& report) {
+  wxCriticalSectionLocker lock(m_report_lock);
+  if (m_report_count < m_report_size) {
+    m_reports[m_report_count++] = report;
   }
 }
 
@@ -604,9 +1105,11 @@ void ArpaTarget::RefreshTarget(int dist) {
     m_status++;
     // target gets an id when status  == STATUS_TO_OCPN
     if (m_status == STATUS_TO_OCPN) {
-      target_id_count++;
-      if (target_id_count >= 10000) target_id_count = 1;
-      m_target_id = target_id_count;
+      if (m_cluster) {
+        m_id_pending = true;  // given after the parallel pass, in target order
+      } else {
+        AssignTargetId();
+      }
     }
 
     // Kalman filter to  calculate the apostriori local position and speed based on found position (pol)
@@ -718,55 +1221,70 @@ void ArpaTarget::RefreshTarget(int dist) {
         // if target was not seen last sweep, color yellow
         s = Q;
       }
-      // Check for AIS target at (M)ARPA position
+      // Check for AIS target at (M)ARPA position when the report is sent
       double posOffset = (double)m_pi->m_settings.AISatARPAoffset;
       // Default 18 >> look 36 meters around + 3% of distance to target
       double dist2target = (3.0 / 100) * (double)pol.r / (double)RETURNS_PER_LINE * m_ri->m_range_meters;
       posOffset += dist2target;
-      if (m_pi->FindAIS_at_arpaPos(m_position.lat, m_position.lon, posOffset)) s = L;
-      PassARPAtoOCPN(&pol, s);
+      PassARPAtoOCPN(&pol, s, posOffset);
     }
   }
   return;
 }
 
-#define PIX(aa, rr)       \
-  if (rr > 510) continue; \
-  if (MultiPix(aa, rr)) { \
-    pol->angle = aa;      \
-    pol->r = rr;          \
-    return true;          \
-  }
-
 bool ArpaTarget::FindNearestContour(Polar* pol, int dist) {
-  // make a search pattern along a square
-  // returns the position of the nearest blob found in pol
+  // looks up the blobs labeled by RadarInfo::ProcessRadarSpoke near pol
+  // returns a point on the contour of the nearest blob found in pol
   // dist is search radius (1 more or less)
   int a = pol->angle;
   int r = pol->r;
   if (dist < 2) dist = 2;
-  for (int j = 1; j <= dist; j++) {
-    int dist_r = j;
-    int dist_a = (int)(326. / (double)r * j);  // 326/r: conversion factor to make squares
-    if (dist_a == 0) dist_a = 1;
-    for (int i = 0; i <= dist_a; i++) {  // "upper" side
-      PIX(a - i, r + dist_r);            // search starting from the middle
-      PIX(a + i, r + dist_r);
+  int dist_a = (int)(326. / (double)r * dist);  // 326/r: conversion factor to make squares
+  if (dist_a == 0) dist_a = 1;
+
+  // a blob is listed under its first spoke, which can be up to MAX_TARGET_DIAMETER before the window
+  SpokeBlob blobs[ARPA_MAX_NEAREST_BLOBS];
+  int found;
+  {
+    wxCriticalSectionLocker lock(m_ri->m_exclusive);
+    found = m_ri->m_blobs->Find(a - dist_a - MAX_TARGET_DIAMETER, a + dist_a, r - dist, r + dist, blobs,
+                                ARPA_MAX_NEAREST_BLOBS);
+  }
+
+  int best = -1;
+  double best_dist = 0.;
+  for (int i = 0; i < found; i++) {
+    SpokeBlob& blob = blobs[i];
+    int da = MOD_ROTATION2048(a - blob.min_angle);  // spokes from the start of the blob to a
+    if (da <= blob.max_angle - blob.min_angle) {
+      da = 0;
+    } else {
+      da = wxMin(da - (blob.max_angle - blob.min_angle), LINES_PER_ROTATION - da);
+    }
+    int dr = 0;
+    if (r < blob.min_r) {
+      dr = blob.min_r - r;
+    } else if (r > blob.max_r) {
+      dr = r - blob.max_r;
     }
-    for (int i = 0; i < dist_r; i++) {  // "right hand" side
-      PIX(a + dist_a, r + i);
-      PIX(a + dist_a, r - i);
+    if (da > dist_a || dr > dist) {
+      continue;
     }
-    for (int i = 0; i <= dist_a; i++) {  // "lower" side
-      PIX(a + i, r - dist_r);
-      PIX(a - i, r - dist_r);
+    if (!Pix(blob.min_angle, blob.start_r)) {
+      continue;  // claimed by another target since it was labeled
     }
-    for (int i = 0; i < dist_r; i++) {  // "left hand" side
-      PIX(a - dist_a, r + i);
-      PIX(a - dist_a, r - i);
+    double d = wxMax((double)dr, da * r / 326.);
+    if (best < 0 || d < best_dist) {
+      best = i;
+      best_dist = d;
     }
   }
-  return false;
+  if (best < 0) {
+    return false;
+  }
+  pol->angle = blobs[best].min_angle;
+  pol->r = blobs[best].start_r;
+  return true;
 }
 
 void RadarArpa::CalculateCentroid(ArpaTarget* target) {
@@ -779,6 +1297,7 @@ ArpaTarget::ArpaTarget(br24radar_pi* pi, RadarInfo* ri) {
   m_kalman = 0;
   m_status = LOST;
   m_contour_length = 0;
+  m_contour_changed = false;
   m_lost_count = 0;
   m_target_id = 0;
   m_refresh = 0;
@@ -791,12 +1310,19 @@ ArpaTarget::ArpaTarget(br24radar_pi* pi, RadarInfo* ri) {
   m_speeds.nr = 0;
   m_pass1_result = UNKNOWN;
   m_pass_nr = PASS1;
+  m_cluster = 0;
+  m_strayed = false;
+  m_id_pending = false;
+  m_report_pending = false;
+  m_grid_next = 0;
+  m_check_for_duplicate = false;
 }
 
 ArpaTarget::ArpaTarget() {
   m_kalman = 0;
   m_status = LOST;
   m_contour_length = 0;
+  m_contour_changed = false;
   m_lost_count = 0;
   m_target_id = 0;
   m_refresh = 0;
@@ -809,6 +1335,17 @@ ArpaTarget::ArpaTarget() {
   m_speeds.nr = 0;
   m_pass1_result = UNKNOWN;
   m_pass_nr = PASS1;
+  m_cluster = 0;
+  m_strayed = false;
+  m_id_pending = false;
+  m_report_pending = false;
+  m_grid_next = 0;
+  m_check_for_duplicate = false;
+}
+
+void ArpaTarget::set(br24radar_pi* pi, RadarInfo* ri) {
+  m_pi = pi;
+  m_ri = ri;
 }
 
 bool ArpaTarget::GetTarget(Polar* pol, int dist1) {
@@ -840,7 +1377,36 @@ bool ArpaTarget::GetTarget(Polar* pol, int dist1) {
   return true;
 }
 
-void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status) {
+// Queue the target for the GUI thread, which sends it to OpenCPN
+void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status, double ais_offset) {
+  ArpaReport report;
+
+  report.target_id = m_target_id;
+  report.automatic = m_automatic;
+  report.status = status;
+  report.angle = pol->angle;
+  report.r = pol->r;
+  report.range_meters = m_ri->m_range_meters;
+  report.speed_kn = m_speed_kn;
+  report.course = m_course;
+  report.position = m_position;
+  report.ais_offset = ais_offset;
+  if (m_cluster) {
+    m_report = report;  // queued after the parallel pass, in target order
+    m_report_pending = true;
+    return;
+  }
+  m_ri->m_arpa->QueueReport(report);
+}
+
+// Gives the target the next id, in the order in which the serial loop refreshes the targets
+void ArpaTarget::AssignTargetId() {
+  target_id_count++;
+  if (target_id_count >= 10000) target_id_count = 1;
+  m_target_id = target_id_count;
+}
+
+void RadarArpa::SendReport(const ArpaReport& report) {
   wxString s_TargID, s_Bear_Unit, s_Course_Unit;
   wxString s_speed, s_course, s_Dist_Unit, s_status;
   wxString s_bearing;
@@ -854,7 +1420,7 @@ void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status) {
   s_Bear_Unit = wxEmptyString;  // Bearing Units  R or empty
   s_Course_Unit = wxT("T");     // Course type R; Realtive T; true
   s_Dist_Unit = wxT("N");       // Speed/Distance Unit K, N, S N= NM/h = Knots
-  switch (status) {
+  switch (report.status) {
     case Q:
       s_status = wxT("Q");  // yellow
       break;
@@ -866,17 +1432,17 @@ void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status) {
       break;
   }
 
-  double dist = (double)pol->r / (double)RETURNS_PER_LINE * (double)m_ri->m_range_meters / 1852.;
-  double bearing = (double)pol->angle * 360. / (double)LINES_PER_ROTATION;
+  double dist = (double)report.r / (double)RETURNS_PER_LINE * (double)report.range_meters / 1852.;
+  double bearing = (double)report.angle * 360. / (double)LINES_PER_ROTATION;
 
   if (bearing < 0) bearing += 360;
-  s_TargID = wxString::Format(wxT("%4i"), m_target_id);
-  s_speed = wxString::Format(wxT("%4.2f"), status == Q ? 0.0 : m_speed_kn);
-  s_course = wxString::Format(wxT("%3.1f"), status == Q ? 0.0 : m_course);
-  if (m_automatic) {
-    s_target_name = wxString::Format(wxT("ARPA%4i"), m_target_id);
+  s_TargID = wxString::Format(wxT("%4i"), report.target_id);
+  s_speed = wxString::Format(wxT("%4.2f"), report.status == Q ? 0.0 : report.speed_kn);
+  s_course = wxString::Format(wxT("%3.1f"), report.status == Q ? 0.0 : report.course);
+  if (report.automatic) {
+    s_target_name = wxString::Format(wxT("ARPA%4i"), report.target_id);
   } else {
-    s_target_name = wxString::Format(wxT("MARPA%4i"), m_target_id);
+    s_target_name = wxString::Format(wxT("MARPA%4i"), report.target_id);
   }
   s_distance = wxString::Format(wxT("%f"), dist);
   s_bearing = wxString::Format(wxT("%f"), bearing);
@@ -903,6 +1469,7 @@ void ArpaTarget::PassARPAtoOCPN(Polar* pol, OCPN_target_status status) {
 
 void ArpaTarget::SetStatusLost() {
   m_contour_length = 0;
+  m_contour_changed = true;
   m_lost_count = 0;
   if (m_kalman) {
     // reset kalman filter, don't delete it, too  expensive
@@ -912,7 +1479,7 @@ void ArpaTarget::SetStatusLost() {
     Polar p;
     p.angle = 0;
     p.r = 0;
-    PassARPAtoOCPN(&p, L);
+    PassARPAtoOCPN(&p, L, 0.);
   }
   m_status = LOST;
   m_target_id = 0;
@@ -928,10 +1495,12 @@ void ArpaTarget::SetStatusLost() {
 }
 
 void RadarArpa::DeleteAllTargets() {
+  wxCriticalSectionLocker lock(m_lock);
   for (int i = 0; i < m_number_of_targets; i++) {
     if (!m_targets[i]) continue;
     m_targets[i]->SetStatusLost();
   }
+  PublishSnapshot();
 }
 
 int RadarArpa::AcquireNewARPATarget(Polar pol, int status) {
@@ -945,20 +1514,12 @@ int RadarArpa::AcquireNewARPATarget(Polar pol, int status) {
   own_pos.lat = m_pi->m_ownship_lat;
   own_pos.lon = m_pi->m_ownship_lon;
   target_pos = Polar2Pos(pol, own_pos, m_ri->m_range_meters);
-  // make new target or re-use an existing one with status == lost
-  int i;
-  if (m_number_of_targets < MAX_NUMBER_OF_TARGETS - 1 || (m_number_of_targets == MAX_NUMBER_OF_TARGETS - 1 && status == -2)) {
-    if (!m_targets[m_number_of_targets]) {
-      m_targets[m_number_of_targets] = new ArpaTarget(m_pi, m_ri);
-    }
-    i = m_number_of_targets;
-    m_number_of_targets++;
-  } else {
-    LOG_INFO(wxT("BR24radar_pi: RadarArpa:: Error, max targets exceeded %i"), m_number_of_targets);
+  // make new target or re-use one with status == lost from the pool
+  ArpaTarget* target = NewTarget(status);
+  if (!target) {
     return -1;
   }
-
-  ArpaTarget* target = m_targets[i];
+  int i = m_number_of_targets - 1;
 
   target->m_position = target_pos;  // Expected position
   target->m_position.time = wxGetUTCTimeMillis();
@@ -977,17 +1538,31 @@ int RadarArpa::AcquireNewARPATarget(Polar pol, int status) {
   target->m_automatic = true;
   target->m_target_id = 0;
   target->RefreshTarget(TARGET_SEARCH_RADIUS1);
+  AddToGrid(target);
   return i;
 }
 
 void ArpaTarget::ResetPixels() {
-  // resets the pixels of the current blob (plus a little margin) so that blob will no be found again in the same sweep
-  for (int r = m_min_r.r - DISTANCE_BETWEEN_TARGETS; r <= m_max_r.r + DISTANCE_BETWEEN_TARGETS; r++) {
-    if (r >= LINES_PER_ROTATION || r < 0) continue;
-    for (int a = m_min_angle.angle - DISTANCE_BETWEEN_TARGETS; a <= m_max_angle.angle + DISTANCE_BETWEEN_TARGETS; a++) {
-      m_ri->m_history[MOD_ROTATION2048(a)].line[r] = m_ri->m_history[MOD_ROTATION2048(a)].line[r] & 127;
+  // claims the pixels of the current blob (plus a little margin) so that blob will no be found again in the same sweep
+  int min_angle = m_min_angle.angle - DISTANCE_BETWEEN_TARGETS;
+  int max_angle = m_max_angle.angle + DISTANCE_BETWEEN_TARGETS;
+  int min_r = m_min_r.r - DISTANCE_BETWEEN_TARGETS;
+  int max_r = m_max_r.r + DISTANCE_BETWEEN_TARGETS;
+
+  if (m_cluster) {
+    // kept with the cluster until the parallel pass is done
+    if (!InWindow(min_angle, max_angle - min_angle) || m_cluster->claims >= m_cluster->count) {
+      m_strayed = true;
+      return;
     }
+    ArpaClaim& claim = m_cluster->claim[m_cluster->claims++];
+    claim.min_angle = MOD_ROTATION2048(min_angle);
+    claim.angles = max_angle - min_angle;
+    claim.min_r = min_r;
+    claim.max_r = max_r;
+    return;
   }
+  m_ri->m_plane->Claim(min_angle, max_angle, min_r, max_r);
 }
 
 void ArpaTarget::GetSpeed() {
@@ -36,6 +36,7 @@
 //#include "pi_common.h"
 
 //#include "br24radar_pi.h"
+#include "DrawList.h"
 #include "Kalman.h"
 #include "Matrix.h"
 #include "RadarInfo.h"
@@ -45,8 +46,12 @@ PLUGIN_BEGIN_NAMESPACE
 //    Forward definitions
 class KalmanFilter;
 class Position;
+class br24Arpa;
+class br24ArpaWorker;
 
-#define MAX_NUMBER_OF_TARGETS (200)  // real max numer of targets is 1 less
+#define MAX_NUMBER_OF_TARGETS (200)  // default of ArpaMaxTargets, real max numer of targets is 1 less
+#define ARPA_TARGETS_LIMIT (10000)   // highest ArpaMaxTargets, target ids wrap around at 10000
+#define ARPA_TARGET_SLAB (32)        // targets allocated at a time by ArpaTargetPool
 #define TARGET_SEARCH_RADIUS1 (2)    // radius of target search area for pass 1 (on top of the size of the blob)
 #define TARGET_SEARCH_RADIUS2 (15)   // radius of target search area for pass 1
 #define SCAN_MARGIN (150)            // number of lines that a next scan of the target may have moved
@@ -72,6 +77,24 @@ class Position;
 #define STATUS_TO_OCPN (5)            // First status to be send to OCPN
 #define START_UP_SPEED (0.5)          // maximum allowed speed (m/sec) for new target, real format with .
 #define DISTANCE_BETWEEN_TARGETS (4)  // minimum separation between targets
+#define ARPA_REPORTS_PER_TARGET (2)  // target reports queued for the GUI thread, per target
+#define ARPA_MAX_WORKERS (7)         // worker threads that help the ARPA thread refresh in parallel
+#define ARPA_CLUSTER_MARGIN (16)     // spokes a target may move between sweeps, for its cluster window
+#define ARPA_GRID_SECTORS (64)       // angular buckets of the target grid
+#define ARPA_GRID_BANDS (16)         // range buckets of the target grid
+#define ARPA_GRID_SPOKES (LINES_PER_ROTATION / ARPA_GRID_SECTORS)
+#define ARPA_GRID_RETURNS (RETURNS_PER_LINE / ARPA_GRID_BANDS)
+#define ARPA_GRID_SLACK (4)  // returns that a target may be off its bucket, own ship moved or Pos2Polar rounded
+
+#ifdef __GNUC__
+#define ARPA_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define ARPA_EXCHANGE(p, v) __atomic_exchange_n(p, v, __ATOMIC_ACQ_REL)
+#else
+#define ARPA_LOAD(p) (*(volatile long *)(p))
+#define ARPA_EXCHANGE(p, v) InterlockedExchange((volatile long *)(p), (v))
+#endif
+#define ARPA_SNAPSHOT_FRESH (4)  // set in m_snapshot_ready when the ARPA thread published a snapshot not drawn yet
+#define ARPA_SNAPSHOT_INDEX (3)
 
 typedef int target_status;
 enum OCPN_target_status {
@@ -103,9 +126,70 @@ struct SpeedHistory {
   int nr;
 };
 
+// A target report for OpenCPN, queued by the ARPA thread and sent as TTM sentence by the GUI thread
+struct ArpaReport {
+  int target_id;
+  bool automatic;
+  OCPN_target_status status;
+  int angle;
+  int r;
+  int range_meters;
+  double speed_kn;
+  double course;
+  Position position;
+  double ais_offset;  // send as lost if an AIS target is this close (meters), 0 to not check
+};
+
+// Contours of all targets as drawn, written by the ARPA thread and read by the GUI thread
+struct ArpaSnapshotTarget {
+  int first;  // index of the first point in ArpaSnapshot::point
+  int length;
+  int expected_angle;
+  int expected_r;
+};
+
+struct ArpaSnapshotPoint {
+  UINT16 angle;
+  UINT16 r;
+};
+
+struct ArpaSnapshot {
+  unsigned int revision;  // m_contours_revision when it was published
+  int targets;
+  ArpaSnapshotTarget* target;  // grown by the thread that fills the snapshot
+  int target_size;
+  ArpaSnapshotPoint* point;
+  int point_size;
+};
+
 enum TargetProcessStatus { UNKNOWN, NOT_FOUND_IN_PASS1 };
 enum PassN { PASS1, PASS2 };
 
+// Pixels claimed by ArpaTarget::ResetPixels while refreshing in parallel, applied to the plane after the pass
+struct ArpaClaim {
+  int min_angle;  // 0..LINES_PER_ROTATION-1
+  int angles;     // spokes in the claim - 1
+  int min_r;
+  int max_r;
+};
+
+// Spokes that a target of the pass may look at, lo may be negative
+struct ArpaWindow {
+  int lo;
+  int hi;
+  int cluster;
+};
+
+// Targets whose spokes overlap, refreshed in index order by one thread. Windows of clusters do not overlap.
+struct ArpaCluster {
+  int lo;            // first spoke of the window, 0..LINES_PER_ROTATION-1
+  int len;           // spokes in the window - 1
+  int first;         // first target in RadarArpa::m_cluster_target
+  int count;         // targets in the cluster
+  ArpaClaim* claim;  // room for one claim per target in RadarArpa::m_claim
+  int claims;        // claims made by the targets refreshed so far
+};
+
 class ArpaTarget {
   friend class RadarArpa;  // Allow RadarArpa access to private members
 
@@ -120,14 +204,16 @@ class ArpaTarget {
   bool FindContourFromInside(Polar* p);
   bool GetTarget(Polar* pol, int dist);
   void RefreshTarget(int dist);
-  void PassARPAtoOCPN(Polar* p, OCPN_target_status s);
+  void PassARPAtoOCPN(Polar* p, OCPN_target_status s, double ais_offset);
   void SetStatusLost();
   void ResetPixels();
   void GetSpeed();
   bool Pix(int ang, int rad);
-  bool MultiPix(int ang, int rad);
 
  private:
+  bool InWindow(int ang, int angles);
+  void AssignTargetId();
+
   RadarInfo* m_ri;
   br24radar_pi* m_pi;
   KalmanFilter* m_kalman;
@@ -145,23 +231,55 @@ class ArpaTarget {
   PassN m_pass_nr;
   Polar m_contour[MAX_CONTOUR_LENGTH + 1];  // contour of target, only valid immediately after finding it
   int m_contour_length;
+  bool m_contour_changed;  // Since the contours were last collected for drawing
   Polar m_max_angle, m_min_angle, m_max_r, m_min_r;  // charasterictics of contour
 
   Polar m_expected;
 
   bool m_automatic;  // True for ARPA, false for MARPA.
+
+  // Set while the target is refreshed in parallel, see RadarArpa::RefreshPass
+  ArpaCluster* m_cluster;  // cluster being refreshed, 0 when refreshed serially
+  bool m_strayed;          // touched a spoke outside the window of m_cluster
+  bool m_id_pending;       // reached STATUS_TO_OCPN, gets its id after the pass in target order
+  bool m_report_pending;   // m_report is queued after the pass in target order
+  ArpaReport m_report;
+
+  ArpaTarget* m_grid_next;  // next target in the same bucket of RadarArpa::m_grid
+};
+
+/*
+ * Targets are allocated in slabs of ARPA_TARGET_SLAB that are only deleted with the pool, so a
+ * target never moves and a pointer to it stays valid. Lost targets go back on the free list with
+ * their Kalman filter, destruction and construction is expensive.
+ */
+class ArpaTargetPool {
+ public:
+  ArpaTargetPool();
+  ~ArpaTargetPool();
+
+  ArpaTarget* Alloc();  // 0 when out of memory
+  void Free(ArpaTarget* target);
+
+ private:
+  ArpaTarget** m_slab;
+  int m_slabs;
+  ArpaTarget** m_free;  // room for all targets of all slabs
+  int m_free_count;
 };
 
 class RadarArpa {
  public:
   RadarArpa(br24radar_pi* pi, RadarInfo* ri);
   ~RadarArpa();
-  void DrawArpaTargets();
+  void DrawArpaTargets(bool overlay);
   void RefreshArpaTargets();
+  void SendReports();
+  void QueueReport(const ArpaReport& report);
   int AcquireNewARPATarget(Polar pol, int status);
   void AcquireNewMARPATarget(Position p);
   void DeleteTarget(Position p);
-  bool MultiPix(int ang, int rad);
+  bool Pix(int ang, int rad);
   void DeleteAllTargets();
   void RadarLost() {
     if (m_radar_lost_count > 5) {
@@ -171,18 +289,79 @@ class RadarArpa {
     m_radar_lost_count++;
   }
   void RadarLostReset() { m_radar_lost_count = 0; }
+  void RefreshClusters();
 
  private:
-  ArpaTarget* m_targets[MAX_NUMBER_OF_TARGETS];
+  ArpaTargetPool m_pool;
+  ArpaTarget** m_targets;  // targets in use from m_pool, in the order they were acquired
   br24radar_pi* m_pi;
   RadarInfo* m_ri;
   int m_number_of_targets;
+  int m_capacity;  // room in m_targets and the other arrays with something per target
   int m_radar_lost_count;  // all targets will be deleted when radar not seen five times in a row
 
+  br24Arpa* m_thread;        // Runs RefreshArpaTargets, 0 if it could not be started
+  wxCriticalSection m_lock;  // Held while the targets are changed, by the ARPA thread or the GUI thread
+
+  // Parallel refresh: targets are grouped in clusters of overlapping windows, which the ARPA thread and
+  // the workers take in turn. Each target only touches spokes in its cluster window, or the pass is redone serially.
+  br24ArpaWorker* m_worker[ARPA_MAX_WORKERS];
+  int m_workers;               // workers started so far
+  wxSemaphore m_workers_done;  // posted by each worker when it ran out of clusters
+  int* m_refresh_target;       // targets refreshed in the current pass, in index order
+  int m_refresh_count;
+  int m_refresh_dist;     // search radius of the current pass
+  ArpaWindow* m_window;   // window of each target of the pass
+  int* m_window_order;    // targets of the pass sorted on the start of their window
+  int* m_cluster_target;  // targets grouped by cluster, in index order within a cluster
+  ArpaClaim* m_claim;
+  ArpaCluster* m_cluster;
+  int m_clusters;
+  int m_next_cluster;  // next cluster to be taken, protected by m_cluster_lock
+  wxCriticalSection m_cluster_lock;
+  ArpaTarget* m_saved;           // targets of the pass before it ran, to redo it serially
+  KalmanFilter* m_saved_kalman;  // their filters, as m_saved does not own any
+  int m_saved_size;
+
+  // Targets by angle and range as of the last refresh, to find the nearest target without looking at all of them
+  ArpaTarget* m_grid[ARPA_GRID_SECTORS][ARPA_GRID_BANDS];  // first target in each bucket
+  int m_grid_range;                                        // m_range_meters when the grid was built
+
+  DrawList m_draw_overlay;           // Contours for the chart overlay
+  DrawList m_draw_panel;             // Contours for the radar window
+  unsigned int m_contours_revision;  // Incremented when any contour changes, protected by m_lock
+  unsigned int m_overlay_revision;   // Revision of the contours in m_draw_overlay
+  unsigned int m_panel_revision;     // Revision of the contours in m_draw_panel
+
+  // Triple buffered snapshots of the contours: the ARPA thread fills m_snapshot_back and swaps it with
+  // m_snapshot_ready, drawing swaps m_snapshot_front with m_snapshot_ready when that is fresh.
+  ArpaSnapshot* m_snapshots;
+  int m_snapshot_back;    // protected by m_lock
+  long m_snapshot_ready;  // only accessed with ARPA_LOAD and ARPA_EXCHANGE
+  int m_snapshot_front;   // GUI thread only
+
+  ArpaReport* m_reports;
+  int m_report_count;
+  int m_report_size;
+  ArpaReport* m_sending;  // GUI thread only
+  int m_sending_size;
+  wxCriticalSection m_report_lock;  // protects m_reports, m_report_count and m_report_size
+
   void AcquireOrDeleteMarpaTarget(Position p, int status);
+  int MaxTargets();
+  bool Reserve(int targets);
+  ArpaTarget* NewTarget(int status);
+  void BuildGrid();
+  void AddToGrid(ArpaTarget* target);
+  ArpaTarget* FindNearestTarget(Position* pos, ArpaTarget* except);
+  void RefreshPass(PassN pass);
+  bool BuildClusters();
+  bool RefreshParallel(int threads);
   void CalculateCentroid(ArpaTarget* t);
-  void DrawContour(ArpaTarget* t);
-  bool Pix(int ang, int rad);
+  void PublishSnapshot();
+  ArpaSnapshot* TakeSnapshot();
+  void AddContour(DrawList* list, ArpaSnapshot* snapshot, ArpaSnapshotTarget* t);
+  void SendReport(const ArpaReport& report);
 };
 
 PLUGIN_END_NAMESPACE
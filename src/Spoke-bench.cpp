@@ -0,0 +1,369 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Benchmark of the work done for every received spoke, without OpenCPN or a GL canvas.
+ *
+ * Usage: spoke-bench [scalar|sse2|avx2|neon] [table] [rotations] [capture.pcap[.gz]]
+ *
+ * Without a capture file it uses synthetic spokes with sea clutter, land and a few targets.
+ * Every stage is run on frames of 32 spokes in the order RadarInfo::ProcessRadarSpoke runs them,
+ * so each stage sees the output of the previous one.
+ *
+ * With 'table' the true trails stage uses full per return int tables, as the polar lookup table
+ * used to have, instead of the sine and cosine per angle. Run both under 'perf stat -e
+ * cache-misses' (or similar) to compare the cache behaviour.
+ */
+
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+
+#include "pcaputil.h"
+#include "spokeutil.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define BENCH_SPOKES_PER_FRAME (32)
+#define BENCH_MAX_SPOKES (16 * LINES_PER_ROTATION)
+#define BENCH_FRAME_HEADER (8)
+#define BENCH_LINE_HEADER (24)
+#define BENCH_LINE_ANGLE (8)  // Offset of the angle in the line header, for all radar types
+#define BENCH_SPOKES_PER_SECOND (LINES_PER_ROTATION * 48 / 60)  // 4G at its fastest scan speed
+
+#define BENCH_THRESHOLD_BLUE (50)
+#define BENCH_THRESHOLD_GREEN (100)
+#define BENCH_THRESHOLD_RED (200)
+
+enum BenchStage {
+  STAGE_HISTORY,
+  STAGE_ARPA_BLOBS,
+  STAGE_ARPA_PLANE,
+  STAGE_GUARD_ZONE,
+  STAGE_MULTI_SWEEP,
+  STAGE_TRUE_TRAILS,
+  STAGE_RELATIVE_TRAILS,
+  STAGE_DRAW_VERTEX,
+  STAGE_DRAW_COMPACT,
+  STAGE_DRAW_SHADER,
+  STAGES
+};
+
+static const char *stage_name[STAGES] = {"history shift",    "ARPA blobs",         "ARPA plane",
+                                         "guard zone count", "multi-sweep filter", "true trails",
+                                         "relative trails",  "RadarDrawVertex",    "compact vertices",
+                                         "RadarDrawShader"};
+
+static UINT8 history[LINES_PER_ROTATION][RETURNS_PER_LINE];
+static TrailRevolutionsAge true_trails[TRAILS_SIZE * TRAILS_SIZE];
+static TrailRevolutionsAge relative_trails[LINES_PER_ROTATION][RETURNS_PER_LINE];
+static UINT8 rgba[LINES_PER_ROTATION * RETURNS_PER_LINE * 4];
+static SpokeVertex vertices[RETURNS_PER_LINE * SPOKE_VERTEX_PER_QUAD];
+static SpokeCompactVertex compact[RETURNS_PER_LINE * SPOKE_COMPACT_VERTEX_PER_QUAD];
+static SpokeBlobs blobs;
+static OccupancyPlane plane;
+
+static int (*table_intx)[RETURNS_PER_LINE + 1];
+static int (*table_inty)[RETURNS_PER_LINE + 1];
+
+static UINT8 *spokes;
+static SpokeBearing *angles;
+static size_t spoke_count;
+
+static UINT32 random_state = 12345;
+
+static UINT8 Random(int max) {
+  random_state = random_state * 1103515245 + 12345;
+  return (UINT8)((random_state >> 16) % (max + 1));
+}
+
+static bool BuildFullTable(const PolarToCartesianLookupTable *lookup) {
+  table_intx = (int(*)[RETURNS_PER_LINE + 1])malloc((LINES_PER_ROTATION + 1) * sizeof(*table_intx));
+  table_inty = (int(*)[RETURNS_PER_LINE + 1])malloc((LINES_PER_ROTATION + 1) * sizeof(*table_inty));
+  if (!table_intx || !table_inty) {
+    return false;
+  }
+  for (int arc = 0; arc < LINES_PER_ROTATION + 1; arc++) {
+    for (int radius = 0; radius < RETURNS_PER_LINE + 1; radius++) {
+      table_intx[arc][radius] = lookup->IntX(arc, radius);
+      table_inty[arc][radius] = lookup->IntY(arc, radius);
+    }
+  }
+  return true;
+}
+
+// SpokeUpdateTrueTrails with the full tables
+static void TableTrueTrails(SpokeBearing angle, UINT8 *data, size_t len, UINT8 threshold, const UINT8 *trail_colour) {
+  for (size_t radius = 0; radius < len; radius++) {
+    TrailRevolutionsAge *trail = true_trails + TrailIndex(table_intx[angle][radius], table_inty[angle][radius]);
+
+    if (data[radius] >= threshold) {
+      *trail = 1;
+    } else {
+      if (*trail > 0 && *trail < (TRAIL_MAX_REVOLUTIONS)) {
+        (*trail)++;
+      }
+      data[radius] = trail_colour[*trail];
+    }
+  }
+}
+
+static void GenerateSpokes() {
+  spoke_count = 4 * LINES_PER_ROTATION;
+
+  for (size_t i = 0; i < spoke_count; i++) {
+    SpokeBearing angle = (SpokeBearing)(i % LINES_PER_ROTATION);
+    int rotation = (int)(i / LINES_PER_ROTATION);
+    UINT8 *data = spokes + i * RETURNS_PER_LINE;
+
+    angles[i] = angle;
+    for (int r = 0; r < RETURNS_PER_LINE; r++) {
+      // Sea clutter close by, noise further out
+      data[r] = Random(r < 64 ? 255 - 3 * r : 40);
+      // Land on one side
+      if (angle >= 300 && angle < 700 && r >= 320 + (angle & 31)) {
+        data[r] = 100 + Random(155);
+      }
+    }
+    // A few moving targets
+    for (int t = 0; t < 8; t++) {
+      int target_angle = (t * 256 + rotation * 2) % LINES_PER_ROTATION;
+      int target_r = 80 + t * 50 + rotation;
+      if (angle >= target_angle && angle < target_angle + 6) {
+        for (int r = target_r; r < target_r + 5 && r < RETURNS_PER_LINE; r++) {
+          data[r] = 255;
+        }
+      }
+    }
+  }
+}
+
+static bool ReadSpokes(const wxString &filename) {
+  PcapReader reader;
+  PcapDatagram datagram;
+  wxString error;
+
+  if (!reader.Open(filename, error)) {
+    printf("ERROR: %s\n", (const char *)error.mb_str());
+    return false;
+  }
+
+  spoke_count = 0;
+  while (spoke_count < BENCH_MAX_SPOKES && reader.NextDatagram(&datagram)) {
+    int line_len = BENCH_LINE_HEADER + RETURNS_PER_LINE;
+    int lines = (datagram.len - BENCH_FRAME_HEADER) / line_len;
+
+    if (lines <= 0 || datagram.len != BENCH_FRAME_HEADER + lines * line_len) {
+      continue;  // Not a radar frame
+    }
+    for (int l = 0; l < lines && spoke_count < BENCH_MAX_SPOKES; l++) {
+      const UINT8 *line = datagram.data + BENCH_FRAME_HEADER + l * line_len;
+      int angle_raw = (line[BENCH_LINE_ANGLE + 1] << 8) | line[BENCH_LINE_ANGLE];
+
+      angles[spoke_count] = MOD_ROTATION2048(angle_raw / 2);
+      memcpy(spokes + spoke_count * RETURNS_PER_LINE, line + BENCH_LINE_HEADER, RETURNS_PER_LINE);
+      spoke_count++;
+    }
+  }
+  reader.Close();
+
+  if (!spoke_count) {
+    printf("ERROR: %s does not contain radar frames\n", (const char *)filename.mb_str());
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  wxInitializer initializer;
+  long rotations = 32;
+  SpokeKernels kernels = SpokeBestKernels();
+  bool full_table = false;
+  wxString capture;
+
+  for (int i = 1; i < argc; i++) {
+    wxString arg(argv[i], wxConvUTF8);
+    bool is_kernels = false;
+
+    for (int k = 0; k < SPOKE_KERNELS_COUNT; k++) {
+      if (arg.CmpNoCase(wxString(SpokeKernelsName((SpokeKernels)k), wxConvUTF8)) == 0) {
+        kernels = (SpokeKernels)k;
+        is_kernels = true;
+      }
+    }
+    if (arg.CmpNoCase(wxT("table")) == 0) {
+      full_table = true;
+    } else if (!is_kernels && !arg.ToLong(&rotations)) {
+      capture = arg;
+    }
+  }
+  if (!SpokeSelectKernels(kernels)) {
+    printf("ERROR: This CPU cannot run the %s kernels\n", SpokeKernelsName(kernels));
+    return 1;
+  }
+  if (rotations < 1) {
+    rotations = 1;
+  }
+
+  spokes = (UINT8 *)malloc(BENCH_MAX_SPOKES * RETURNS_PER_LINE);
+  angles = (SpokeBearing *)malloc(BENCH_MAX_SPOKES * sizeof(SpokeBearing));
+  if (!spokes || !angles) {
+    printf("ERROR: Out of memory\n");
+    return 1;
+  }
+
+  if (capture.length() > 0) {
+    if (!ReadSpokes(capture)) {
+      return 1;
+    }
+  } else {
+    GenerateSpokes();
+  }
+
+  BlobColour colour_map[UINT8_MAX + 1];
+  wxColour colour_map_rgb[BLOB_COLOURS];
+  UINT8 trail_colour[TRAIL_COLOURS];
+
+  // Same as RadarInfo::ComputeColourMap and ComputeTargetTrails with 5 minute trails
+  for (int i = 0; i <= UINT8_MAX; i++) {
+    colour_map[i] = (i >= BENCH_THRESHOLD_RED) ? BLOB_STRONG : (i >= BENCH_THRESHOLD_GREEN)
+                                                                 ? BLOB_INTERMEDIATE
+                                                                 : (i >= BENCH_THRESHOLD_BLUE) ? BLOB_WEAK : BLOB_NONE;
+  }
+  colour_map_rgb[BLOB_NONE] = wxColour(0, 0, 0);
+  colour_map_rgb[BLOB_STRONG] = wxColour(255, 0, 0);
+  colour_map_rgb[BLOB_INTERMEDIATE] = wxColour(0, 255, 0);
+  colour_map_rgb[BLOB_WEAK] = wxColour(0, 0, 255);
+  for (int h = BLOB_HISTORY_0; h <= BLOB_HISTORY_MAX; h++) {
+    colour_map[h] = (BlobColour)h;
+    colour_map_rgb[h] = wxColour(255, 255, 255 - (h - BLOB_HISTORY_0) * 8);
+  }
+  TrailRevolutionsAge max_rev = SECONDS_TO_REVOLUTIONS(300);
+  double colour = 0.;
+  for (int revolution = 0; revolution < TRAIL_COLOURS; revolution++) {
+    if (revolution >= 1 && revolution < max_rev) {
+      trail_colour[revolution] = (UINT8)(BLOB_HISTORY_0 + (int)colour);
+      colour += BLOB_HISTORY_COLOURS / (double)max_rev;
+    } else {
+      trail_colour[revolution] = BLOB_NONE;
+    }
+  }
+
+  PolarToCartesianLookupTable *lookup = GetPolarToCartesianLookupTable();
+  if (full_table && !BuildFullTable(lookup)) {
+    printf("ERROR: Out of memory\n");
+    return 1;
+  }
+  GLubyte alpha = 255 * (MAX_OVERLAY_TRANSPARENCY - DEFAULT_OVERLAY_TRANSPARENCY) / MAX_OVERLAY_TRANSPARENCY;
+  UINT8 frame[BENCH_SPOKES_PER_FRAME * RETURNS_PER_LINE];
+  wxStopWatch stopwatch[STAGES];
+  size_t total_spokes = 0;
+  long check = 0;  // Keeps the compiler from optimizing stages away
+
+  for (int s = 0; s < STAGES; s++) {
+    stopwatch[s].Start();
+    stopwatch[s].Pause();
+  }
+
+  for (long rotation = 0; rotation < rotations; rotation++) {
+    for (size_t first = 0; first < LINES_PER_ROTATION; first += BENCH_SPOKES_PER_FRAME) {
+      size_t n = BENCH_SPOKES_PER_FRAME;
+      size_t spoke = (rotation * LINES_PER_ROTATION + first) % spoke_count;
+
+      if (spoke + n > spoke_count) {
+        n = spoke_count - spoke;
+      }
+      memcpy(frame, spokes + spoke * RETURNS_PER_LINE, n * RETURNS_PER_LINE);
+      total_spokes += n;
+
+#define BENCH_STAGE(stage, code)                       \
+  stopwatch[stage].Resume();                           \
+  for (size_t i = 0; i < n; i++) {                     \
+    UINT8 *data = frame + i * RETURNS_PER_LINE;        \
+    SpokeBearing angle = angles[spoke + i];            \
+    code;                                              \
+  }                                                    \
+  stopwatch[stage].Pause();
+
+      BENCH_STAGE(STAGE_HISTORY, SpokeShiftHistory(history[angle], data, RETURNS_PER_LINE, BENCH_THRESHOLD_BLUE));
+      BENCH_STAGE(STAGE_ARPA_BLOBS, blobs.AddSpoke(angle, history[angle], RETURNS_PER_LINE, 128));
+      BENCH_STAGE(STAGE_ARPA_PLANE, plane.SetSpoke(angle, history[angle], RETURNS_PER_LINE, 128));
+      BENCH_STAGE(STAGE_GUARD_ZONE,
+                  check += SpokeCountReturns(data, history[angle], 0, RETURNS_PER_LINE, BENCH_THRESHOLD_BLUE, true));
+      BENCH_STAGE(STAGE_MULTI_SWEEP, SpokeMultiSweepFilter(data, history[angle], RETURNS_PER_LINE));
+      if (full_table) {
+        BENCH_STAGE(STAGE_TRUE_TRAILS, TableTrueTrails(angle, data, RETURNS_PER_LINE - 1, BENCH_THRESHOLD_BLUE, trail_colour));
+      } else {
+        BENCH_STAGE(STAGE_TRUE_TRAILS, SpokeUpdateTrueTrails(true_trails, lookup, angle, 0, 0, data, RETURNS_PER_LINE - 1,
+                                                             BENCH_THRESHOLD_BLUE, trail_colour));
+      }
+      BENCH_STAGE(STAGE_RELATIVE_TRAILS, SpokeUpdateRelativeTrails(relative_trails[angle], data, RETURNS_PER_LINE - 1,
+                                                                   BENCH_THRESHOLD_BLUE, 0));
+      BENCH_STAGE(STAGE_DRAW_VERTEX, check += SpokeToVertices(vertices, angle, data, RETURNS_PER_LINE, colour_map,
+                                                              colour_map_rgb, alpha, lookup));
+      BENCH_STAGE(STAGE_DRAW_COMPACT, check += SpokeToCompactVertices(compact, angle, data, RETURNS_PER_LINE, colour_map));
+      BENCH_STAGE(STAGE_DRAW_SHADER, SpokeToRGBA(rgba + angle * RETURNS_PER_LINE * 4, data, RETURNS_PER_LINE, colour_map,
+                                                 colour_map_rgb, alpha));
+    }
+  }
+
+  printf("INFO: %lu spokes (%lu unique, %s), check %ld\n", (unsigned long)total_spokes, (unsigned long)spoke_count,
+         capture.length() > 0 ? (const char *)capture.mb_str() : "synthetic", check + rgba[0] + vertices[0].red);
+  printf("INFO: %s history, multi sweep and relative trail kernels\n", SpokeKernelsName(kernels));
+  printf("INFO: polar lookup %s, %lu bytes\n", full_table ? "full table" : "sine and cosine",
+         (unsigned long)(sizeof(*lookup) + (full_table ? 2 * (LINES_PER_ROTATION + 1) * sizeof(*table_intx) : 0)));
+  printf("%-20s %12s %14s %10s\n", "stage", "ns/spoke", "spokes/sec", "load");
+
+  double total_ns = 0.;
+  for (int s = 0; s <= STAGES; s++) {
+    double ns;
+
+    if (s < STAGES) {
+      ns = stopwatch[s].TimeInMicro().ToDouble() * 1000. / total_spokes;
+      total_ns += ns;
+    } else {
+      ns = total_ns;
+    }
+    double per_second = ns > 0. ? 1e9 / ns : 0.;
+    // Load is the fraction of one core needed for a single radar at 48 RPM
+    printf("%-20s %12.1f %14.0f %9.3f%%\n", s < STAGES ? stage_name[s] : "total", ns, per_second,
+           BENCH_SPOKES_PER_SECOND * ns / 1e7);
+  }
+
+  free(spokes);
+  free(angles);
+  free(table_intx);
+  free(table_inty);
+  return 0;
+}
+
+PLUGIN_END_NAMESPACE
+
+int main(int argc, char **argv) { return br24::main(argc, argv); }
@@ -0,0 +1,380 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+/*
+ * Checks that every SIMD version of the spoke kernels that this CPU can run gives exactly
+ * the same result as the scalar code, for all history and trail age values and for odd
+ * lengths and offsets. Also checks that the polar lookup gives exactly what the full table,
+ * with an entry per return, used to hold, and that compact vertices describe the same quads.
+ * The ARPA blobs are compared with a flood fill and the occupancy plane with the history bits.
+ */
+
+#include "spokeutil.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define TEST_LEN (RETURNS_PER_LINE + 64)
+#define TEST_ROUNDS (2000)
+
+static UINT32 test_random = 12345;
+
+static UINT8 TestRandom() {
+  test_random = test_random * 1103515245 + 12345;
+  return (UINT8)(test_random >> 16);
+}
+
+static bool TestKernels(SpokeKernels kernels) {
+  UINT8 data[TEST_LEN], hist[TEST_LEN];
+  UINT8 ref_data[TEST_LEN], ref_hist[TEST_LEN];
+  TrailRevolutionsAge trail[TEST_LEN], ref_trail[TEST_LEN];
+  UINT8 trail_colour[TRAIL_COLOURS];
+  UINT8 threshold = 0;
+
+  for (int age = 0; age < TRAIL_COLOURS; age++) {
+    trail_colour[age] = TestRandom();
+  }
+
+  for (int round = 0; round < TEST_ROUNDS; round++) {
+    size_t offset = TestRandom() % 32;
+    size_t len = round < 256 ? RETURNS_PER_LINE : TestRandom() % (TEST_LEN - offset + 1);
+
+    for (size_t r = 0; r < TEST_LEN; r++) {
+      data[r] = TestRandom();
+      // Go through every history value and every threshold in the first rounds
+      hist[r] = round < 256 ? (UINT8)(r + round) : TestRandom();
+      trail[r] = round < 256 ? (TrailRevolutionsAge)(r + round) : TestRandom();
+    }
+    threshold = round < 256 ? (UINT8)round : TestRandom();
+    memcpy(ref_data, data, sizeof(data));
+    memcpy(ref_hist, hist, sizeof(hist));
+    memcpy(ref_trail, trail, sizeof(trail));
+
+    SpokeSelectKernels(SPOKE_KERNELS_SCALAR);
+    SpokeShiftHistory(ref_hist + offset, ref_data + offset, len, threshold);
+    SpokeMultiSweepFilter(ref_data + offset, ref_hist + offset, len);
+    SpokeUpdateRelativeTrails(ref_trail + offset, ref_data + offset, len, threshold, (round & 1) ? trail_colour : 0);
+
+    SpokeSelectKernels(kernels);
+    SpokeShiftHistory(hist + offset, data + offset, len, threshold);
+    SpokeMultiSweepFilter(data + offset, hist + offset, len);
+    SpokeUpdateRelativeTrails(trail + offset, data + offset, len, threshold, (round & 1) ? trail_colour : 0);
+
+    if (memcmp(hist, ref_hist, sizeof(hist)) != 0 || memcmp(data, ref_data, sizeof(data)) != 0 ||
+        memcmp(trail, ref_trail, sizeof(trail)) != 0) {
+      cout << "ERROR: " << SpokeKernelsName(kernels) << " differs from scalar, offset=" << offset << " len=" << len
+           << " threshold=" << (int)threshold << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool TestPolarLookup() {
+  const PolarToCartesianLookupTable *lookup = GetPolarToCartesianLookupTable();
+
+  for (int arc = 0; arc < LINES_PER_ROTATION + 1; arc++) {
+    // This is how the full table was built
+    GLfloat sine = sinf((GLfloat)arc * PI * 2 / LINES_PER_ROTATION);
+    GLfloat cosine = cosf((GLfloat)arc * PI * 2 / LINES_PER_ROTATION);
+
+    for (int radius = 0; radius < RETURNS_PER_LINE + 1; radius++) {
+      GLfloat x = (GLfloat)radius * cosine;
+      GLfloat y = (GLfloat)radius * sine;
+      GLfloat lookup_x = lookup->X(arc, radius);
+      GLfloat lookup_y = lookup->Y(arc, radius);
+
+      if (memcmp(&x, &lookup_x, sizeof(x)) != 0 || memcmp(&y, &lookup_y, sizeof(y)) != 0 ||
+          (int)x != lookup->IntX(arc, radius) || (int)y != lookup->IntY(arc, radius)) {
+        cout << "ERROR: Polar lookup differs from full table, arc=" << arc << " radius=" << radius << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Decode the compact quads the way the vertex shader in RadarDrawVertex does and compare with the triangles
+static bool TestCompactVertices() {
+  const PolarToCartesianLookupTable *lookup = GetPolarToCartesianLookupTable();
+  BlobColour colour_map[UINT8_MAX + 1];
+  wxColour colour_map_rgb[BLOB_COLOURS];
+  SpokeVertex vertices[RETURNS_PER_LINE * SPOKE_VERTEX_PER_QUAD];
+  SpokeCompactVertex compact[RETURNS_PER_LINE * SPOKE_COMPACT_VERTEX_PER_QUAD];
+  UINT8 data[RETURNS_PER_LINE];
+  static const int corner[SPOKE_COMPACT_VERTEX_PER_QUAD] = {0, 1, 5, 2};  // Triangle vertex for each quad corner
+
+  for (int i = 0; i <= UINT8_MAX; i++) {
+    colour_map[i] = (BlobColour)(i % BLOB_COLOURS);
+  }
+  for (int i = 0; i < BLOB_COLOURS; i++) {
+    colour_map_rgb[i] = wxColour(i, 255 - i, i * 7);
+  }
+
+  for (int round = 0; round < TEST_ROUNDS; round++) {
+    SpokeBearing angle = (SpokeBearing)(round % LINES_PER_ROTATION);
+
+    for (size_t r = 0; r < RETURNS_PER_LINE; r++) {
+      data[r] = (round & 1) ? TestRandom() : (UINT8)((r / 7) * BLOB_COLOURS);  // Noise, or long runs
+    }
+    size_t count = SpokeToVertices(vertices, angle, data, RETURNS_PER_LINE, colour_map, colour_map_rgb, 255, lookup);
+    size_t compact_count = SpokeToCompactVertices(compact, angle, data, RETURNS_PER_LINE, colour_map);
+
+    if (count / SPOKE_VERTEX_PER_QUAD != compact_count / SPOKE_COMPACT_VERTEX_PER_QUAD) {
+      cout << "ERROR: Compact vertices have " << compact_count << " corners for " << count << " vertices\n";
+      return false;
+    }
+    for (size_t v = 0; v < compact_count; v++) {
+      const SpokeVertex &ref = vertices[v / SPOKE_COMPACT_VERTEX_PER_QUAD * SPOKE_VERTEX_PER_QUAD + corner[v % 4]];
+      int colour = compact[v].radius_colour / SPOKE_COMPACT_RADIUS;
+      int radius = compact[v].radius_colour % SPOKE_COMPACT_RADIUS;
+
+      if (lookup->X(compact[v].arc, radius) != ref.x || lookup->Y(compact[v].arc, radius) != ref.y ||
+          colour_map_rgb[colour].Red() != ref.red || colour_map_rgb[colour].Green() != ref.green ||
+          colour_map_rgb[colour].Blue() != ref.blue) {
+        cout << "ERROR: Compact vertex differs, angle=" << angle << " corner=" << v << "\n";
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#define TEST_BLOB_SPOKES (300)
+
+static UINT8 blob_hist[TEST_BLOB_SPOKES + 1][RETURNS_PER_LINE];
+static int blob_label[TEST_BLOB_SPOKES][RETURNS_PER_LINE];
+static int blob_stack[TEST_BLOB_SPOKES * RETURNS_PER_LINE];
+static SpokeBlobs test_blobs;  // Too large for the stack
+
+// Flood fill the blob at (i, r) with label, returns false when it is too small to be found.
+static bool FloodBlob(int i, int r, int label, SpokeBlob *blob) {
+  int n = 0;
+  double sum_angle = 0., sum_r = 0.;
+
+  blob->min_angle = i;
+  blob->max_angle = i;
+  blob->min_r = r;
+  blob->max_r = r;
+  blob->start_r = r;
+  blob->area = 0;
+  blob_label[i][r] = label;
+  blob_stack[n++] = i * RETURNS_PER_LINE + r;
+  while (n > 0) {
+    int ci = blob_stack[n - 1] / RETURNS_PER_LINE;
+    int cr = blob_stack[n - 1] % RETURNS_PER_LINE;
+    n--;
+    blob->area++;
+    sum_angle += ci;
+    sum_r += cr;
+    blob->max_angle = wxMax(blob->max_angle, ci);
+    blob->min_r = wxMin(blob->min_r, cr);
+    blob->max_r = wxMax(blob->max_r, cr);
+
+    static const int di[4] = {1, -1, 0, 0};
+    static const int dr[4] = {0, 0, 1, -1};
+    for (int d = 0; d < 4; d++) {
+      int ni = ci + di[d];
+      int nr = cr + dr[d];
+      if (ni < 0 || ni >= TEST_BLOB_SPOKES || nr < 2 || nr >= RETURNS_PER_LINE - 1) continue;
+      if (!(blob_hist[ni][nr] & 128) || blob_label[ni][nr] >= 0) continue;
+      blob_label[ni][nr] = label;
+      blob_stack[n++] = ni * RETURNS_PER_LINE + nr;
+    }
+  }
+  blob->centroid_angle = sum_angle / blob->area;
+  blob->centroid_r = sum_r / blob->area;
+  return blob->area >= SPOKE_BLOB_MIN_AREA;
+}
+
+static bool TestBlobsFrom(int first_angle) {
+  // Random rectangles and noise, with other history bits set that must be ignored
+  for (int i = 0; i <= TEST_BLOB_SPOKES; i++) {
+    for (int r = 0; r < RETURNS_PER_LINE; r++) {
+      blob_hist[i][r] = (TestRandom() & 63) | (TestRandom() < 20 ? 192 : 0);
+      if (i < TEST_BLOB_SPOKES) {
+        blob_label[i][r] = -1;
+      }
+    }
+  }
+  for (int b = 0; b < 200; b++) {
+    int i0 = TestRandom() % TEST_BLOB_SPOKES, r0 = TestRandom() * 2;
+    int di = TestRandom() % 20, dr = TestRandom() % 20;
+    for (int i = i0; i < wxMin(i0 + di, TEST_BLOB_SPOKES); i++) {
+      for (int r = r0; r < wxMin(r0 + dr, RETURNS_PER_LINE); r++) {
+        blob_hist[i][r] |= 128;
+      }
+    }
+  }
+  memset(blob_hist[TEST_BLOB_SPOKES], 0, RETURNS_PER_LINE);  // Finishes every blob
+
+  test_blobs.Reset();
+  for (int i = 0; i <= TEST_BLOB_SPOKES; i++) {
+    test_blobs.AddSpoke(MOD_ROTATION2048(first_angle + i), blob_hist[i], RETURNS_PER_LINE, 128);
+  }
+
+  static SpokeBlob found[SPOKE_BLOBS_TABLE];
+  int found_count =
+      test_blobs.Find(first_angle, first_angle + TEST_BLOB_SPOKES - 1, 0, RETURNS_PER_LINE, found, SPOKE_BLOBS_TABLE);
+  int expected_count = 0;
+
+  for (int i = 0; i < TEST_BLOB_SPOKES; i++) {
+    for (int r = 2; r < RETURNS_PER_LINE - 1; r++) {
+      SpokeBlob blob;
+      if (!(blob_hist[i][r] & 128) || blob_label[i][r] >= 0 || !FloodBlob(i, r, expected_count, &blob)) {
+        continue;
+      }
+      expected_count++;
+      bool match = false;
+      for (int f = 0; f < found_count && !match; f++) {
+        const SpokeBlob &b = found[f];
+        match = b.min_angle == MOD_ROTATION2048(first_angle + blob.min_angle) && b.start_r == blob.start_r &&
+                b.max_angle - b.min_angle == blob.max_angle - blob.min_angle && b.min_r == blob.min_r &&
+                b.max_r == blob.max_r && b.area == blob.area &&
+                fabs(b.centroid_angle - b.min_angle - (blob.centroid_angle - blob.min_angle)) < 1e-6 &&
+                fabs(b.centroid_r - blob.centroid_r) < 1e-6;
+      }
+      if (!match) {
+        cout << "ERROR: Blob at spoke " << i << " radius " << r << " with area " << blob.area << " not found, first angle "
+             << first_angle << "\n";
+        return false;
+      }
+    }
+  }
+  if (found_count != expected_count) {
+    cout << "ERROR: Found " << found_count << " blobs instead of " << expected_count << ", first angle " << first_angle << "\n";
+    return false;
+  }
+  return true;
+}
+
+static bool TestBlobs() { return TestBlobsFrom(100) && TestBlobsFrom(LINES_PER_ROTATION - 150); }
+
+#define TEST_PLANE_SPOKES (64)
+
+static OccupancyPlane test_plane;  // Too large for the stack
+
+// Compare the plane with the history bits that ARPA used before: bit 6 for any return of this sweep, and
+// bit 7 which was cleared when a target claimed the return.
+static bool TestOccupancyPlane() {
+  static UINT8 hist[TEST_PLANE_SPOKES][RETURNS_PER_LINE];
+
+  test_plane.Reset();
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < TEST_PLANE_SPOKES; i++) {
+      int angle = MOD_ROTATION2048(LINES_PER_ROTATION - TEST_PLANE_SPOKES / 2 + i);
+
+      for (int r = 0; r < RETURNS_PER_LINE; r++) {
+        hist[i][r] = (r > 1 && r < RETURNS_PER_LINE - 1 && TestRandom() < 100) ? 192 : 0;
+      }
+      test_plane.SetSpoke(angle, hist[i], RETURNS_PER_LINE, 128);
+    }
+    for (int c = 0; c < 20; c++) {
+      int min_angle = TestRandom() % TEST_PLANE_SPOKES;
+      int max_angle = min_angle + TestRandom() % 8;
+      int min_r = (int)(TestRandom() * 2) - 8;
+      int max_r = min_r + TestRandom() % 80;
+
+      test_plane.Claim(min_angle - TEST_PLANE_SPOKES / 2, max_angle - TEST_PLANE_SPOKES / 2, min_r, max_r);
+      for (int i = min_angle; i <= max_angle && i < TEST_PLANE_SPOKES; i++) {
+        for (int r = wxMax(min_r, 0); r <= max_r && r < RETURNS_PER_LINE; r++) {
+          hist[i][r] &= 127;
+        }
+      }
+    }
+    for (int i = 0; i < TEST_PLANE_SPOKES; i++) {
+      int angle = i - TEST_PLANE_SPOKES / 2;
+
+      for (int r = -1; r <= RETURNS_PER_LINE; r++) {
+        UINT8 h = (r >= 0 && r < RETURNS_PER_LINE) ? hist[i][r] : 0;
+        if (test_plane.IsReturn(angle, r) != ((h & 64) != 0) || test_plane.IsFree(angle, r) != ((h & 128) != 0)) {
+          cout << "ERROR: Occupancy plane differs at angle " << angle << " r " << r << " round " << round << "\n";
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+int main() {
+  int ret = 0;
+
+  cout << "INFO: Best kernels are " << SpokeKernelsName(SpokeBestKernels()) << "\n";
+
+  for (int k = SPOKE_KERNELS_SCALAR + 1; k < SPOKE_KERNELS_COUNT; k++) {
+    SpokeKernels kernels = (SpokeKernels)k;
+
+    if (!SpokeSelectKernels(kernels)) {
+      cout << "INFO: " << SpokeKernelsName(kernels) << " not supported\n";
+      continue;
+    }
+    if (TestKernels(kernels)) {
+      cout << "INFO: " << SpokeKernelsName(kernels) << " matches scalar\n";
+    } else {
+      ret = 1;
+    }
+  }
+
+  if (TestPolarLookup()) {
+    cout << "INFO: Polar lookup matches full table\n";
+  } else {
+    ret = 1;
+  }
+
+  if (TestCompactVertices()) {
+    cout << "INFO: Compact vertices match triangles\n";
+  } else {
+    ret = 1;
+  }
+
+  if (TestBlobs()) {
+    cout << "INFO: Blobs match flood fill\n";
+  } else {
+    ret = 1;
+  }
+
+  if (TestOccupancyPlane()) {
+    cout << "INFO: Occupancy plane matches history bits\n";
+  } else {
+    ret = 1;
+  }
+
+  if (ret == 0) {
+    cout << "INFO: TEST PASSED\n";
+  } else {
+    cout << "ERROR: TEST FAILED\n";
+  }
+  exit(ret);
+}
+
+PLUGIN_END_NAMESPACE
+
+int main() { br24::main(); }
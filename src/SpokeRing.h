@@ -0,0 +1,122 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKERING_H_
+#define _SPOKERING_H_
+
+#include "br24radar_pi.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+/*
+ * Bounded single producer, single consumer queue of spokes. The receive thread is the
+ * only producer and br24Process the only consumer, so no locks are needed: each side
+ * only writes its own index and publishes it with release semantics.
+ * Both sides store their own index and then load the other one, so a full fence sits between
+ * the two; otherwise each side could read the other's stale index and the wake up would be lost.
+ */
+
+#define SPOKE_RING_SLOTS (LINES_PER_ROTATION)  // Must be a power of 2; one rotation
+#define SPOKE_RING_MASK (SPOKE_RING_SLOTS - 1)
+
+#ifdef __GNUC__
+#define SPOKE_RING_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define SPOKE_RING_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define SPOKE_RING_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+// MSVC gives volatile loads acquire and volatile stores release semantics
+#define SPOKE_RING_LOAD(p) (*(volatile size_t *)(p))
+#define SPOKE_RING_STORE(p, v) (*(volatile size_t *)(p) = (v))
+#define SPOKE_RING_FENCE() MemoryBarrier()
+#endif
+
+struct RadarSpoke {
+  SpokeBearing angle;
+  SpokeBearing bearing;
+  int range_meters;
+  size_t len;
+  wxLongLong time_rec;
+  double lat;
+  double lon;
+  UINT8 data[RETURNS_PER_LINE];
+};
+
+class SpokeRing {
+ public:
+  SpokeRing() {
+    m_head = 0;
+    m_tail = 0;
+    m_slots = new RadarSpoke[SPOKE_RING_SLOTS];
+  }
+
+  ~SpokeRing() { delete[] m_slots; }
+
+  // Producer: returns the slot to fill, or 0 when the ring is full.
+  RadarSpoke *BeginWrite() {
+    if (m_head - SPOKE_RING_LOAD(&m_tail) >= SPOKE_RING_SLOTS) {
+      return 0;
+    }
+    return &m_slots[m_head & SPOKE_RING_MASK];
+  }
+
+  // Producer: publishes the slot. Returns true when the ring was empty before.
+  bool EndWrite() {
+    size_t head = m_head;
+
+    SPOKE_RING_STORE(&m_head, head + 1);
+    SPOKE_RING_FENCE();  // pairs with the fence in EndRead
+    return head == SPOKE_RING_LOAD(&m_tail);
+  }
+
+  // Consumer: returns the oldest slot, or 0 when the ring is empty.
+  RadarSpoke *BeginRead() {
+    if (m_tail == SPOKE_RING_LOAD(&m_head)) {
+      return 0;
+    }
+    return &m_slots[m_tail & SPOKE_RING_MASK];
+  }
+
+  // Consumer: hands the slot back to the producer. The fence orders the store before the next
+  // BeginRead loads m_head, so an empty ring seen there was seen empty by EndWrite as well.
+  void EndRead() {
+    SPOKE_RING_STORE(&m_tail, m_tail + 1);
+    SPOKE_RING_FENCE();
+  }
+
+ private:
+  size_t m_head;  // Next slot to write, only written by the producer
+  size_t m_tail;  // Next slot to read, only written by the consumer
+  RadarSpoke *m_slots;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKERING_H_ */
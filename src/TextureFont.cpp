@@ -119,6 +119,8 @@ void TextureFont::Build(wxFont &font, bool blur, bool luminance) {
   }
 
   internalformat = format;
+  m_format = format;
+  m_stride = stride;
 
   if (m_blur) image = image.Blur(1);
 
@@ -129,7 +131,7 @@ void TextureFont::Build(wxFont &font, bool blur, bool luminance) {
     for (int j = 0; j < tex_w * tex_h; j++)
       for (int k = 0; k < stride; k++) teximage[j * stride + k] = imgdata[3 * j];
   }
-  if (m_texobj) Delete();
+  if (m_texobj || m_extra_texobj) Delete();
 
   glGenTextures(1, &m_texobj);
   glBindTexture(GL_TEXTURE_2D, m_texobj);
@@ -147,6 +149,163 @@ void TextureFont::Build(wxFont &font, bool blur, bool luminance) {
 void TextureFont::Delete() {
   glDeleteTextures(1, &m_texobj);
   m_texobj = 0;
+  if (m_extra_texobj) {
+    glDeleteTextures(1, &m_extra_texobj);
+    m_extra_texobj = 0;
+  }
+  ClearExtraGlyphs();
+}
+
+// Only when the font is built again, as it moves glyphs that draw lists may be using
+void TextureFont::ClearExtraGlyphs() {
+  m_generation++;
+  m_extra_count = 0;
+  m_extra_x = 0;
+  m_extra_y = 0;
+  m_extra_row_h = 0;
+  m_extra_h = EXTRA_TEXTURE_SIZE;
+  free(m_extra_image);
+  m_extra_image = 0;
+  m_extra_upload = false;
+}
+
+// Makes the extra texture at least height high by doubling it. The glyphs stay where they are, but
+// as their texture coordinates change the generation does too.
+bool TextureFont::GrowExtraTexture(int height) {
+  GLint max_size = EXTRA_TEXTURE_MAX_HEIGHT;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+  int h = m_extra_h;
+  while (h < height) {
+    h *= 2;
+  }
+  if (h > wxMin(max_size, EXTRA_TEXTURE_MAX_HEIGHT)) {
+    return false;
+  }
+  if (m_extra_image) {
+    size_t row = EXTRA_TEXTURE_SIZE * m_stride;
+    unsigned char *image = (unsigned char *)realloc(m_extra_image, h * row);
+    if (!image) {
+      return false;
+    }
+    memset(image + m_extra_h * row, 0, (h - m_extra_h) * row);
+    m_extra_image = image;
+  }
+  m_extra_h = h;
+  m_extra_upload = true;
+  m_generation++;
+  return true;
+}
+
+/* find a glyph outside MIN_GLYPH..MAX_GLYPH, drawing it into the extra texture
+   the first time. When that is full it grows, so glyphs are never thrown out while a
+   draw list is being built; only when it cannot grow any more the glyph is left out. */
+TexGlyphInfo *TextureFont::GetExtraGlyph(wchar_t c) {
+  for (int i = 0; i < m_extra_count; i++) {
+    if (m_extra_char[i] == c) {
+      return &m_extra_tgi[i];
+    }
+  }
+
+  wxMemoryDC dc;
+  dc.SetFont(m_font);
+  wxCoord gw, gh;
+  dc.GetTextExtent(c, &gw, &gh);  // measure the text
+  if (gw <= 0 || gh <= 0 || gw > EXTRA_TEXTURE_SIZE || gh > EXTRA_TEXTURE_SIZE) {
+    return 0;
+  }
+
+  if (m_extra_x + gw > EXTRA_TEXTURE_SIZE) {
+    m_extra_x = 0;
+    m_extra_y += m_extra_row_h;
+    m_extra_row_h = 0;
+  }
+  if (m_extra_y + gh > m_extra_h && !GrowExtraTexture(m_extra_y + gh)) {
+    return 0;
+  }
+  if (m_extra_count == m_extra_size) {
+    wchar_t *extra_char = (wchar_t *)realloc(m_extra_char, (m_extra_size + EXTRA_GLYPHS) * sizeof(wchar_t));
+    if (!extra_char) {
+      return 0;
+    }
+    m_extra_char = extra_char;
+    TexGlyphInfo *extra_tgi = (TexGlyphInfo *)realloc(m_extra_tgi, (m_extra_size + EXTRA_GLYPHS) * sizeof(TexGlyphInfo));
+    if (!extra_tgi) {
+      return 0;
+    }
+    m_extra_tgi = extra_tgi;
+    m_extra_size += EXTRA_GLYPHS;
+  }
+  if (!m_extra_image) {
+    m_extra_image = (unsigned char *)calloc(EXTRA_TEXTURE_SIZE * m_extra_h, m_stride);
+    if (!m_extra_image) {
+      return 0;
+    }
+    m_extra_upload = true;
+  }
+
+  wxBitmap bmp(gw, gh);
+  dc.SelectObject(bmp);
+  dc.SetBackground(wxBrush(wxColour(0, 0, 0)));
+  dc.Clear();
+  /* draw the text white */
+  dc.SetTextForeground(wxColour(255, 255, 255));
+  dc.DrawText(c, 0, 0);
+  wxImage image = bmp.ConvertToImage();
+  if (m_blur) {
+    image = image.Blur(1);
+  }
+  unsigned char *imgdata = image.GetData();
+  if (!imgdata) {
+    return 0;
+  }
+  unsigned char *data = (unsigned char *)malloc(gw * gh * m_stride);
+  if (!data) {
+    return 0;
+  }
+  for (int j = 0; j < gw * gh; j++)
+    for (int k = 0; k < m_stride; k++) data[j * m_stride + k] = imgdata[3 * j];
+  for (int y = 0; y < gh; y++) {
+    memcpy(m_extra_image + ((m_extra_y + y) * EXTRA_TEXTURE_SIZE + m_extra_x) * m_stride, data + y * gw * m_stride,
+           gw * m_stride);
+  }
+
+  glPushAttrib(GL_TEXTURE_BIT);
+  if (!m_extra_texobj) {
+    glGenTextures(1, &m_extra_texobj);
+    glBindTexture(GL_TEXTURE_2D, m_extra_texobj);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    m_extra_upload = true;
+  } else {
+    glBindTexture(GL_TEXTURE_2D, m_extra_texobj);
+  }
+  glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  if (m_extra_upload) {
+    glTexImage2D(GL_TEXTURE_2D, 0, m_format, EXTRA_TEXTURE_SIZE, m_extra_h, 0, m_format, GL_UNSIGNED_BYTE, m_extra_image);
+    m_extra_upload = false;
+  } else {
+    glTexSubImage2D(GL_TEXTURE_2D, 0, m_extra_x, m_extra_y, gw, gh, m_format, GL_UNSIGNED_BYTE, data);
+  }
+  glPopClientAttrib();
+  glPopAttrib();
+  free(data);
+
+  TexGlyphInfo &tgi = m_extra_tgi[m_extra_count];
+  tgi.x = m_extra_x;
+  tgi.y = m_extra_y;
+  tgi.width = gw;
+  tgi.height = gh;
+  tgi.advance = gw;
+  m_extra_char[m_extra_count] = c;
+  m_extra_count++;
+
+  m_extra_x += gw;
+  m_extra_row_h = wxMax(m_extra_row_h, gh + 1);  // +1 as border between rows, like in Build
+  return &tgi;
 }
 
 void TextureFont::GetTextExtent(const wxString &string, int *width, int *height) {
@@ -165,12 +324,11 @@ void TextureFont::GetTextExtent(const wxString &string, int *width, int *height)
 
     if (c < MIN_GLYPH || c >= MAX_GLYPH) {
       // outside font
-      wxMemoryDC dc;
-      dc.SetFont(m_font);
-      wxCoord gw, gh;
-      dc.GetTextExtent(c, &gw, &gh);  // measure the text
-      w0 += gw;
-      if (h < gh) h = gh;
+      TexGlyphInfo *tgi = GetExtraGlyph(c);
+      if (tgi) {
+        w0 += tgi->advance;
+        if (h < tgi->height) h = tgi->height;
+      }
       continue;
     }
 
@@ -188,63 +346,31 @@ void TextureFont::RenderGlyph(wchar_t c) {
   if (c == 0x00B0)
     c = DEGREE_GLYPH;
   else if (c < MIN_GLYPH || c >= MAX_GLYPH) {
-    // outside font, render with draw pixels (slow)
-    wxMemoryDC dc;
-    dc.SetFont(m_font);
-    wxCoord gw, gh;
-    dc.GetTextExtent(c, &gw, &gh);  // measure the text
-    int w, h;
-    for (w = 1; w < gw; w *= 2)
-      ;
-    for (h = 1; h < gh; h *= 2)
-      ;
-    wxBitmap bmp(w, h);
-    dc.SelectObject(bmp);
-    dc.SetBackground(wxBrush(wxColour(0, 0, 0)));
-    dc.Clear();
-    /* draw the text white */
-    dc.SetTextForeground(wxColour(255, 255, 255));
-    dc.DrawText(c, 0, 0);
-    wxImage image = bmp.ConvertToImage();
-    if (m_blur) {
-      image = image.Blur(1);
-    }
-    unsigned char *imgdata = image.GetData();
-    if (!imgdata) {
-      return;
-    }
-    char *data = new char[w * h * 2];
-    if (!data) {
+    // outside font, render from the extra texture
+    TexGlyphInfo *tgi = GetExtraGlyph(c);
+    if (!tgi) {
       return;
     }
+    float w = tgi->width, h = tgi->height;
+    float tx1 = (float)tgi->x / EXTRA_TEXTURE_SIZE;
+    float tx2 = (float)(tgi->x + w) / EXTRA_TEXTURE_SIZE;
+    float ty1 = (float)tgi->y / m_extra_h;
+    float ty2 = (float)(tgi->y + h) / m_extra_h;
 
-    for (int i = 0; i < w * h; i++) {
-      data[2 * i + 0] = imgdata[3 * i];  // Luminance
-      data[2 * i + 1] = imgdata[3 * i];  // Alpha
-    }
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, w, h, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, data);
-    float u = (float)gw / w, v = (float)gh / h;
+    glBindTexture(GL_TEXTURE_2D, m_extra_texobj);
     glBegin(GL_QUADS);
-    glTexCoord2f(0, 0);
+    glTexCoord2f(tx1, ty1);
     glVertex2i(0, 0);
-    glTexCoord2f(u, 0);
-    glVertex2i(gw, 0);
-    glTexCoord2f(u, v);
-    glVertex2i(gw, gh);
-    glTexCoord2f(0, v);
-    glVertex2i(0, gh);
+    glTexCoord2f(tx2, ty1);
+    glVertex2i(w, 0);
+    glTexCoord2f(tx2, ty2);
+    glVertex2i(w, h);
+    glTexCoord2f(tx1, ty2);
+    glVertex2i(0, h);
     glEnd();
-
     glBindTexture(GL_TEXTURE_2D, m_texobj);
-    delete[] data;
 
-    glTranslatef(gw, 0.0, 0.0);
+    glTranslatef(tgi->advance, 0.0, 0.0);
     return;
   }
 
@@ -297,4 +423,40 @@ void TextureFont::RenderString(const wxString &string, int x, int y) {
   glPopMatrix();
 }
 
+// Add the glyph quads of a string to a draw list instead of drawing them now, in the colour of the list.
+void TextureFont::AddString(DrawList *list, const wxString &string, int x, int y) {
+  float px = x, py = y;
+
+  if (!m_texobj) {
+    return;
+  }
+
+  for (unsigned int i = 0; i < string.size(); i++) {
+    wchar_t c = string[i];
+
+    if (c == '\n') {
+      px = x;
+      py += m_tgi[(int)'A'].height;
+      continue;
+    }
+    if (c == 0x00B0) {
+      c = DEGREE_GLYPH;
+    } else if (c < MIN_GLYPH || c >= MAX_GLYPH) {
+      TexGlyphInfo *tgi = GetExtraGlyph(c);
+      if (tgi) {
+        list->AddQuad(m_extra_texobj, px, py, px + tgi->width, py + tgi->height, (float)tgi->x / EXTRA_TEXTURE_SIZE,
+                      (float)tgi->y / m_extra_h, (float)(tgi->x + tgi->width) / EXTRA_TEXTURE_SIZE,
+                      (float)(tgi->y + tgi->height) / m_extra_h);
+        px += tgi->advance;
+      }
+      continue;
+    }
+
+    TexGlyphInfo &tgic = m_tgi[c];
+    list->AddQuad(m_texobj, px, py, px + tgic.width, py + tgic.height, (float)tgic.x / tex_w, (float)tgic.y / tex_h,
+                  (float)(tgic.x + tgic.width) / tex_w, (float)(tgic.y + tgic.height) / tex_h);
+    px += tgic.advance;
+  }
+}
+
 PLUGIN_END_NAMESPACE
@@ -27,6 +27,7 @@
 #define __TEXFONT_H__
 
 #include "pi_common.h"
+#include "DrawList.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
@@ -40,6 +41,12 @@ PLUGIN_BEGIN_NAMESPACE
 #define COLS_GLYPHS 16
 #define ROWS_GLYPHS ((NUM_GLYPHS / COLS_GLYPHS) + 1)
 
+/* other glyphs are drawn into a second texture the first time they are used,
+   which grows in height when it is full so that glyphs never move within it */
+#define EXTRA_GLYPHS 64         // room for glyphs allocated at a time
+#define EXTRA_TEXTURE_SIZE 512  // width and initial height of the extra texture
+#define EXTRA_TEXTURE_MAX_HEIGHT 4096
+
 struct TexGlyphInfo {
   int x, y, width, height;
   float advance;
@@ -49,7 +56,22 @@ class TextureFont {
  public:
   TextureFont() {
     m_texobj = 0;
+    m_extra_texobj = 0;
     m_blur = false;
+    m_format = GL_ALPHA;
+    m_stride = 1;
+    m_generation = 0;
+    m_extra_char = 0;
+    m_extra_tgi = 0;
+    m_extra_size = 0;
+    m_extra_image = 0;
+    ClearExtraGlyphs();
+  }
+
+  ~TextureFont() {
+    free(m_extra_char);
+    free(m_extra_tgi);
+    free(m_extra_image);
   }
 
   void Build(wxFont &font, bool blur = false, bool luminance = false);
@@ -57,9 +79,17 @@ class TextureFont {
 
   void GetTextExtent(const wxString &string, int *width, int *height);
   void RenderString(const wxString &string, int x = 0, int y = 0);
+  void AddString(DrawList *list, const wxString &string, int x = 0, int y = 0);
+
+  // Changes whenever glyphs move in the textures, draw lists with this font must then be built again.
+  // Adding glyphs never clears the extra texture, so building a list again changes this at most a few times.
+  unsigned int GetGeneration() { return m_generation; }
 
  private:
   void RenderGlyph(wchar_t c);
+  void ClearExtraGlyphs();
+  TexGlyphInfo *GetExtraGlyph(wchar_t c);
+  bool GrowExtraTexture(int height);
 
   wxFont m_font;
   bool m_blur;
@@ -68,6 +98,19 @@ class TextureFont {
 
   unsigned int m_texobj;
   int tex_w, tex_h;
+  GLuint m_format;
+  int m_stride;
+
+  wchar_t *m_extra_char;
+  TexGlyphInfo *m_extra_tgi;
+  int m_extra_count;
+  int m_extra_size;                         // Room in m_extra_char and m_extra_tgi
+  int m_extra_x, m_extra_y, m_extra_row_h;  // Where the next glyph goes in the extra texture
+  int m_extra_h;                            // Height of the extra texture
+  unsigned char *m_extra_image;             // Copy of the extra texture, to upload it again when it grows
+  bool m_extra_upload;                      // The extra texture has grown and must be uploaded in full
+  unsigned int m_extra_texobj;
+  unsigned int m_generation;
 };
 
 PLUGIN_END_NAMESPACE
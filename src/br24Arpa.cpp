@@ -0,0 +1,74 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "br24Arpa.h"
+#include "RadarMarpa.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define MILLIS_PER_WAKE (250)  // Check for shutdown at least this often
+
+void *br24Arpa::Entry(void) {
+  LOG_VERBOSE(wxT("BR24radar_pi: %s ARPA thread starting"), m_ri->m_name.c_str());
+
+  while (!m_shutdown) {
+    if (m_ri->m_arpa_wake.WaitTimeout(MILLIS_PER_WAKE) == wxSEMA_NO_ERROR && !m_shutdown) {
+      m_arpa->RefreshArpaTargets();
+    }
+  }
+
+  LOG_VERBOSE(wxT("BR24radar_pi: %s ARPA thread stopping"), m_ri->m_name.c_str());
+  return 0;
+}
+
+void br24Arpa::Shutdown() {
+  m_shutdown = true;
+  m_ri->m_arpa_wake.Post();
+}
+
+void *br24ArpaWorker::Entry(void) {
+  while (true) {
+    m_start.Wait();
+    if (m_shutdown) {
+      break;
+    }
+    m_arpa->RefreshClusters();
+    m_done->Post();
+  }
+  return 0;
+}
+
+void br24ArpaWorker::Shutdown() {
+  m_shutdown = true;
+  m_start.Post();
+}
+
+PLUGIN_END_NAMESPACE
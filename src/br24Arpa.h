@@ -0,0 +1,95 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _BR24ARPA_H_
+#define _BR24ARPA_H_
+
+#include "RadarInfo.h"
+#include "pi_common.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+/*
+ * Runs RadarArpa::RefreshArpaTargets every time RadarInfo::ProcessRadarSpoke has completed a
+ * sector of ARPA_SECTOR_SPOKES spokes, so that tracking keeps pace with the radar instead of with
+ * the repaints of the chart overlay and the radar window.
+ */
+
+class br24Arpa : public wxThread {
+ public:
+  br24Arpa(RadarInfo *ri, RadarArpa *arpa) : wxThread(wxTHREAD_JOINABLE), m_ri(ri), m_arpa(arpa) {
+    Create(1024 * 1024);  // Stack size, be liberal
+    m_shutdown = false;
+
+    LOG_VERBOSE(wxT("BR24radar_pi: %s ARPA thread created"), m_ri->m_name.c_str());
+  };
+
+  ~br24Arpa() {}
+
+  void *Entry(void);
+  void Shutdown(void);
+
+ private:
+  RadarInfo *m_ri;
+  RadarArpa *m_arpa;
+
+  volatile bool m_shutdown;
+};
+
+/*
+ * Helps the ARPA thread refresh targets when ArpaThreads is set to more than 1: every time it is started
+ * it runs RadarArpa::RefreshClusters until no cluster of targets is left, and then posts done.
+ */
+
+class br24ArpaWorker : public wxThread {
+ public:
+  br24ArpaWorker(RadarArpa *arpa, wxSemaphore *done) : wxThread(wxTHREAD_JOINABLE), m_arpa(arpa), m_done(done), m_start(0, 1) {
+    Create(1024 * 1024);  // Stack size, be liberal
+    m_shutdown = false;
+  };
+
+  ~br24ArpaWorker() {}
+
+  void *Entry(void);
+  void Start(void) { m_start.Post(); }
+  void Shutdown(void);
+
+ private:
+  RadarArpa *m_arpa;
+  wxSemaphore *m_done;
+  wxSemaphore m_start;
+
+  volatile bool m_shutdown;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _BR24ARPA_H_ */
@@ -0,0 +1,85 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Hakan Svensson
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+
+#include "br24Process.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define MILLIS_PER_WAKE (250)  // Check for shutdown at least this often
+
+bool br24Process::QueueSpoke(SpokeBearing angle, SpokeBearing bearing, UINT8 *data, size_t len, int range_meters,
+                             wxLongLong time_rec, double lat, double lon) {
+  RadarSpoke *spoke = m_ring.BeginWrite();
+
+  if (!spoke) {
+    return false;
+  }
+
+  spoke->angle = angle;
+  spoke->bearing = bearing;
+  spoke->range_meters = range_meters;
+  spoke->len = wxMin(len, RETURNS_PER_LINE);
+  spoke->time_rec = time_rec;
+  spoke->lat = lat;
+  spoke->lon = lon;
+  memcpy(spoke->data, data, spoke->len);
+
+  if (m_ring.EndWrite()) {
+    // The process thread drains the ring before it waits, so it only needs a wake up when it was empty
+    m_wake.Post();
+  }
+  return true;
+}
+
+void *br24Process::Entry(void) {
+  LOG_RECEIVE(wxT("BR24radar_pi: %s process thread starting"), m_ri->m_name.c_str());
+
+  while (!m_shutdown) {
+    RadarSpoke *spoke;
+
+    while ((spoke = m_ring.BeginRead()) != 0 && !m_shutdown) {
+      m_ri->ProcessRadarSpoke(spoke->angle, spoke->bearing, spoke->data, spoke->len, spoke->range_meters, spoke->time_rec,
+                              spoke->lat, spoke->lon);
+      m_ring.EndRead();
+    }
+    m_wake.WaitTimeout(MILLIS_PER_WAKE);
+  }
+
+  LOG_RECEIVE(wxT("BR24radar_pi: %s process thread stopping"), m_ri->m_name.c_str());
+  return 0;
+}
+
+void br24Process::Shutdown() {
+  m_shutdown = true;
+  m_wake.Post();
+}
+
+PLUGIN_END_NAMESPACE
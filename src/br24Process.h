@@ -0,0 +1,76 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _BR24PROCESS_H_
+#define _BR24PROCESS_H_
+
+#include "RadarInfo.h"
+#include "SpokeRing.h"
+#include "pi_common.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+/*
+ * Runs RadarInfo::ProcessRadarSpoke for the spokes that br24Receive has queued, so that
+ * a slow paint holding RadarInfo::m_exclusive does not stop the receive thread from
+ * reading the network.
+ */
+
+class br24Process : public wxThread {
+ public:
+  br24Process(br24radar_pi *pi, RadarInfo *ri) : wxThread(wxTHREAD_JOINABLE), m_pi(pi), m_ri(ri), m_wake(0, 0) {
+    Create(1024 * 1024);  // Stack size, be liberal
+    m_shutdown = false;
+
+    LOG_RECEIVE(wxT("BR24radar_pi: %s process thread created"), m_ri->m_name.c_str());
+  };
+
+  ~br24Process() {}
+
+  void *Entry(void);
+  void Shutdown(void);
+
+  // Called by the receive thread. Returns false when the ring is full and the spoke is dropped.
+  bool QueueSpoke(SpokeBearing angle, SpokeBearing bearing, UINT8 *data, size_t len, int range_meters, wxLongLong time_rec,
+                  double lat, double lon);
+
+ private:
+  br24radar_pi *m_pi;
+  RadarInfo *m_ri;
+
+  SpokeRing m_ring;
+  wxSemaphore m_wake;  // Posted when a spoke is queued in an empty ring, or on shutdown
+  volatile bool m_shutdown;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _BR24PROCESS_H_ */
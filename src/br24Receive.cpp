@@ -33,6 +33,10 @@
 #include "br24Receive.h"
 #include "RadarMarpa.h"
 
+#ifdef __linux__
+#include <sys/socket.h>  // recvmmsg(), SO_TIMESTAMPNS, SO_RXQ_OVFL
+#endif
+
 PLUGIN_BEGIN_NAMESPACE
 
 /*
@@ -41,8 +45,14 @@ PLUGIN_BEGIN_NAMESPACE
  * The rest of the plugin uses a (slightly) abstract definition of the radar.
  */
 
-#define MILLIS_PER_SELECT 250
-#define SECONDS_SELECT(x) ((x)*MILLISECONDS_PER_SECOND / MILLIS_PER_SELECT)
+#define MILLIS_PER_SELECT 250  // Emulator and replay tick
+
+// Receive watchdogs, in milliseconds since the socket was last fed
+#define RECEIVE_IDLE_MILLIS (2000)      // Watchdogs that have fired try again after this
+#define RECEIVE_RETRY_MILLIS (1000)     // Retry finding a network interface when there is none
+#define REPORT_WATCHDOG_MILLIS (17000)  // Try the next interface this long after the last report or command
+#define DATA_WATCHDOG_MILLIS (6000)     // ... or after the last data frame
+#define SPOKE_WATCHDOG_MILLIS (3500)    // Clear the radar image this long after the last data frame
 
 // There are two radars in every 4G radome. They send and listen on different addresses
 
@@ -155,12 +165,10 @@ void br24Receive::logBinaryData(const wxString &what, const UINT8 *data, int siz
 // Process one radar frame packet, which can contain up to 32 'spokes' or lines extending outwards
 // from the radar up to the range indicated in the packet.
 //
-void br24Receive::ProcessFrame(const UINT8 *data, int len) {
+void br24Receive::ProcessFrame(const UINT8 *data, int len, wxLongLong time_rec) {
   time_t now = time(0);
   double lat = m_pi->m_ownship_lat;
   double lon = m_pi->m_ownship_lon;
-  // log_line.time_rec = wxGetUTCTimeMillis();
-  wxLongLong time_rec = wxGetUTCTimeMillis();
 
   radar_frame_pkt *packet = (radar_frame_pkt *)data;
 
@@ -266,7 +274,7 @@ void br24Receive::ProcessFrame(const UINT8 *data, int len) {
 
     SpokeBearing a = MOD_ROTATION2048(angle_raw / 2);    // divide by 2 to map on 2048 scanlines
     SpokeBearing b = MOD_ROTATION2048(bearing_raw / 2);  // divide by 2 to map on 2048 scanlines
-    m_ri->ProcessRadarSpoke(a, b, line->data, RETURNS_PER_LINE, range_meters, time_rec, lat, lon);
+    m_ri->QueueRadarSpoke(a, b, line->data, RETURNS_PER_LINE, range_meters, time_rec, lat, lon);
   }
 }
 
@@ -331,12 +339,88 @@ void br24Receive::EmulateFakeBuffer(void) {
     wxLongLong time_rec;
     double lat = 0.;
     double lon = 0.;
-    m_ri->ProcessRadarSpoke(a, b, data, sizeof(data), range_meters, time_rec, lat, lon);
+    m_ri->QueueRadarSpoke(a, b, data, sizeof(data), range_meters, time_rec, lat, lon);
   }
 
   LOG_VERBOSE(wxT("BR24radar_pi: emulating %d spokes at range %d with %d spots"), scanlines_in_packet, range_meters, spots);
 }
 
+/*
+ * Replay a pcap capture file instead of listening to the network.
+ * The UDP payloads sent to the data, report and command ports of this radar are
+ * passed to the same Process... methods as live data, so the whole pipeline
+ * (spokes, guard zones, ARPA, drawing) sees a repeatable load.
+ *
+ * Returns true when the thread was asked to stop, false at the end of the file.
+ */
+bool br24Receive::ReplayCapture(void) {
+  PcapReader reader;
+  PcapDatagram datagram;
+  wxString error;
+  double speed = m_pi->m_settings.replay_speed;
+
+  if (!reader.Open(m_pi->m_settings.replay_file, error)) {
+    wxLogError(wxT("BR24radar_pi: %s cannot replay: %s"), m_ri->m_name.c_str(), error.c_str());
+    return socketReady(m_receive_socket, 5 * MILLISECONDS_PER_SECOND);
+  }
+  LOG_INFO(wxT("BR24radar_pi: %s replaying %s at speed %g"), m_ri->m_name.c_str(), m_pi->m_settings.replay_file.c_str(), speed);
+
+  wxLongLong first_packet = -1;
+  wxLongLong first_wall = 0;
+  wxLongLong last_check = 0;
+  int datagrams = 0;
+
+  while (reader.NextDatagram(&datagram)) {
+    wxLongLong now = wxGetUTCTimeMillis();
+
+    if (speed > 0.0) {
+      // Keep the original spacing between packets, divided by the speed multiplier
+      if (first_packet < 0) {
+        first_packet = datagram.time;
+        first_wall = now;
+      }
+      double due = (datagram.time - first_packet).ToDouble() / MILLISECONDS_PER_SECOND / speed;
+      wxLongLong wait = first_wall + wxLongLong((wxLongLong_t)due) - now;
+      if (wait > 0 && socketReady(m_receive_socket, (int)wait.GetValue())) {
+        return true;
+      }
+    } else if (now - last_check >= MILLIS_PER_SELECT) {
+      // As fast as possible, but still respond to a shutdown request
+      last_check = now;
+      if (socketReady(m_receive_socket, 0)) {
+        return true;
+      }
+    }
+
+    const UINT8 *a = datagram.src_addr;
+    if (datagram.dst_port == LISTEN_DATA[m_ri->m_radar].port) {
+      ProcessFrame(datagram.data, datagram.len, wxGetUTCTimeMillis());
+    } else if (datagram.dst_port == LISTEN_REPORT[m_ri->m_radar].port) {
+      if (ProcessReport(datagram.data, datagram.len)) {
+        if (m_ri->m_state.value == RADAR_OFF) {
+          wxString addr;
+          addr.Printf(wxT("%u.%u.%u.%u"), a[0], a[1], a[2], a[3]);
+          m_pi->m_pMessageBox->SetRadarIPAddress(addr);
+          LOG_INFO(wxT("BR24radar_pi: %s detected at %s (replay)"), m_ri->m_name.c_str(), addr.c_str());
+          m_ri->m_state.Update(RADAR_STANDBY);
+        }
+        m_ri->m_radar_timeout = time(0) + WATCHDOG_TIMEOUT;
+      }
+    } else if (datagram.dst_port == LISTEN_COMMAND[m_ri->m_radar].port) {
+      wxString addr;
+      addr.Printf(wxT("%u.%u.%u.%u"), a[0], a[1], a[2], a[3]);
+      ProcessCommand(addr, datagram.data, datagram.len);
+    } else {
+      continue;
+    }
+    datagrams++;
+  }
+
+  LOG_INFO(wxT("BR24radar_pi: %s replayed %d datagrams from %s"), m_ri->m_name.c_str(), datagrams,
+           m_pi->m_settings.replay_file.c_str());
+  return false;
+}
+
 SOCKET br24Receive::PickNextEthernetCard() {
   SOCKET socket = INVALID_SOCKET;
   m_mcast_addr = 0;
@@ -402,12 +486,27 @@ SOCKET br24Receive::GetNewDataSocket() {
     return INVALID_SOCKET;
   }
 
-  socket = startUDPMulticastReceiveSocket(m_mcast_addr, LISTEN_DATA[m_ri->m_radar].port, LISTEN_DATA[m_ri->m_radar].address, error);
+  socket = startUDPMulticastReceiveSocket(m_mcast_addr, LISTEN_DATA[m_ri->m_radar].port, LISTEN_DATA[m_ri->m_radar].address, error,
+                                          m_pi->m_settings.receive_buffer);
   if (socket != INVALID_SOCKET) {
     wxString addr;
     UINT8 *a = (UINT8 *)&m_mcast_addr->sin_addr;  // sin_addr is in network layout
+    int receive_buffer = 0;
+    socklen_t len = sizeof(receive_buffer);
+
+    getsockopt(socket, SOL_SOCKET, SO_RCVBUF, (char *)&receive_buffer, &len);
     addr.Printf(wxT("%u.%u.%u.%u"), a[0], a[1], a[2], a[3]);
-    LOG_RECEIVE(wxT("BR24radar_pi: %s listening for data on %s"), m_ri->m_name.c_str(), addr.c_str());
+    LOG_RECEIVE(wxT("BR24radar_pi: %s listening for data on %s with %d byte receive buffer"), m_ri->m_name.c_str(), addr.c_str(),
+                receive_buffer);
+    m_dropped = 0;  // New socket, new drop counter
+#ifdef __linux__
+    if (m_pi->m_settings.receive_batch) {
+      int one = 1;
+      if (setsockopt(socket, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one))) {
+        LOG_INFO(wxT("BR24radar_pi: %s unable to enable receive timestamps, using arrival time"), m_ri->m_name.c_str());
+      }
+    }
+#endif
   } else {
     wxLogError(wxT("BR24radar_pi: Unable to listen to socket: %s"), error.c_str());
   }
@@ -435,10 +534,87 @@ SOCKET br24Receive::GetNewCommandSocket() {
   return socket;
 }
 
+#ifdef __linux__
+/*
+ * Read frames from the data socket, up to RECEIVE_BATCH with a single system call if
+ * receive_batch is set. When the socket has SO_TIMESTAMPNS set each frame gets the time
+ * the kernel received it, instead of the time that we got round to reading it.
+ * The SO_RXQ_OVFL counter of datagrams the kernel dropped is added to the statistics.
+ *
+ * Returns the number of frames processed, or the recvmmsg() result when that is <= 0.
+ */
+int br24Receive::ReceiveDataBatch(SOCKET socket) {
+  struct mmsghdr msgs[RECEIVE_BATCH];
+  struct iovec iov[RECEIVE_BATCH];
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(UINT32))];
+  } control[RECEIVE_BATCH];
+  int batch = m_pi->m_settings.receive_batch ? RECEIVE_BATCH : 1;
+
+  if (!m_batch) {
+    m_batch = (radar_frame_pkt *)malloc(RECEIVE_BATCH * sizeof(radar_frame_pkt));
+    if (!m_batch) {
+      wxLogError(wxT("BR24radar_pi: Out of memory"));
+      return -1;
+    }
+  }
+
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < batch; i++) {
+    iov[i].iov_base = &m_batch[i];
+    iov[i].iov_len = sizeof(radar_frame_pkt);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_control = control[i].buf;
+    msgs[i].msg_hdr.msg_controllen = sizeof(control[i].buf);
+  }
+
+  // Wait for the first frame (select says there is one), then take whatever else is queued
+  int r = recvmmsg(socket, msgs, batch, MSG_WAITFORONE, 0);
+  if (r <= 0) {
+    return r;
+  }
+
+  wxLongLong now = wxGetUTCTimeMillis();
+  for (int i = 0; i < r; i++) {
+    wxLongLong time_rec = now;
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cmsg; cmsg = CMSG_NXTHDR(&msgs[i].msg_hdr, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec ts;
+
+        memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        time_rec = wxLongLong((wxLongLong_t)ts.tv_sec * MILLISECONDS_PER_SECOND + ts.tv_nsec / 1000000);
+      }
+#ifdef SO_RXQ_OVFL
+      else if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        UINT32 dropped;
+
+        memcpy(&dropped, CMSG_DATA(cmsg), sizeof(dropped));
+        m_ri->m_statistics.dropped_packets += (int)(dropped - m_dropped);  // Counter is cumulative, and may wrap
+        m_dropped = dropped;
+      }
+#endif
+    }
+    if (msgs[i].msg_len > 0) {
+      ProcessFrame((UINT8 *)&m_batch[i], (int)msgs[i].msg_len, time_rec);
+    }
+  }
+  return r;
+}
+#endif
+
+static void CloseWatchedSocket(SocketWaiter *waiter, SOCKET *sockfd) {
+  if (*sockfd != INVALID_SOCKET) {
+    waiter->Remove(*sockfd);
+    closesocket(*sockfd);
+    *sockfd = INVALID_SOCKET;
+  }
+}
+
 void *br24Receive::Entry(void) {
   int r = 0;
-  int no_data_timeout = 0;
-  int no_spoke_timeout = 0;
   union {
     sockaddr_storage addr;
     sockaddr_in ipv4;
@@ -456,85 +632,103 @@ void *br24Receive::Entry(void) {
   SOCKET commandSocket = INVALID_SOCKET;
   SOCKET reportSocket = INVALID_SOCKET;
 
+  SocketWaiter waiter;
+  wxLongLong now = wxGetUTCTimeMillis();
+  wxLongLong radar_deadline = now + RECEIVE_IDLE_MILLIS;  // When to give up on the radar on this interface
+  wxLongLong spoke_deadline = now + RECEIVE_IDLE_MILLIS;  // When to clear the image if no spokes arrive
+  wxLongLong emulator_deadline = 0;                       // When to emulate the next frame
+
   LOG_RECEIVE(wxT("BR24radar_pi: br24Receive thread %s starting"), m_ri->m_name.c_str());
   socketReady(INVALID_SOCKET, 1000);  // sleep for 1s so that other stuff is set up (fixes Windows core on startup)
 
+  waiter.Add(m_receive_socket);
   if (m_mcast_addr) {
     reportSocket = GetNewReportSocket();
+    waiter.Add(reportSocket);
   }
 
   while (true) {
+    if (m_pi->m_settings.replay_file.length() > 0) {
+      // Loop the capture until we are told to stop
+      if (ReplayCapture()) {
+        break;
+      }
+      continue;
+    }
+
+    wxLongLong deadline;
+    now = wxGetUTCTimeMillis();
+
     if (!m_pi->m_settings.emulator_on) {
+      emulator_deadline = 0;
       if (reportSocket == INVALID_SOCKET) {
         reportSocket = PickNextEthernetCard();
         if (reportSocket != INVALID_SOCKET) {
-          no_data_timeout = 0;
-          no_spoke_timeout = 0;
+          waiter.Add(reportSocket);
+          radar_deadline = now + RECEIVE_IDLE_MILLIS;
+          spoke_deadline = now + RECEIVE_IDLE_MILLIS;
         }
       } else {
         // reportSocket is still valid, open data and command sockets as well if they are closed
         if (dataSocket == INVALID_SOCKET) {
           dataSocket = GetNewDataSocket();
-        } else if (commandSocket == INVALID_SOCKET) {
+          waiter.Add(dataSocket);
+        }
+        if (commandSocket == INVALID_SOCKET) {
           commandSocket = GetNewCommandSocket();
+          waiter.Add(commandSocket);
         }
       }
-    } else {
       if (reportSocket != INVALID_SOCKET) {
-        closesocket(reportSocket);
-        reportSocket = INVALID_SOCKET;
+        deadline = radar_deadline < spoke_deadline ? radar_deadline : spoke_deadline;
+      } else {
+        deadline = now + RECEIVE_RETRY_MILLIS;
+        if (spoke_deadline < deadline) {
+          deadline = spoke_deadline;
+        }
+      }
+    } else {
+      CloseWatchedSocket(&waiter, &reportSocket);
+      if (emulator_deadline == 0) {
+        emulator_deadline = now + MILLIS_PER_SELECT;
       }
+      deadline = emulator_deadline;
     }
 
-    struct timeval tv = {(long)0, (long)(MILLIS_PER_SELECT * 1000)};
+    SOCKET ready[SOCKET_WAITER_MAX];
+    int n = waiter.Wait(deadline, ready, ARRAY_SIZE(ready));
+    bool shutdown = false;
 
-    fd_set fdin;
-    FD_ZERO(&fdin);
+    for (int i = 0; i < n && !shutdown; i++) {
+      SOCKET sockfd = ready[i];
 
-    int maxFd = INVALID_SOCKET;
-    if (m_receive_socket != INVALID_SOCKET) {
-      FD_SET(m_receive_socket, &fdin);
-      maxFd = MAX(m_receive_socket, maxFd);
-    }
-    if (reportSocket != INVALID_SOCKET) {
-      FD_SET(reportSocket, &fdin);
-      maxFd = MAX(reportSocket, maxFd);
-    }
-    if (commandSocket != INVALID_SOCKET) {
-      FD_SET(commandSocket, &fdin);
-      maxFd = MAX(commandSocket, maxFd);
-    }
-    if (dataSocket != INVALID_SOCKET) {
-      FD_SET(dataSocket, &fdin);
-      maxFd = MAX(dataSocket, maxFd);
-    }
-
-    r = select(maxFd + 1, &fdin, 0, 0, &tv);
-
-    if (r > 0) {
-      if (m_receive_socket != INVALID_SOCKET && FD_ISSET(m_receive_socket, &fdin)) {
+      if (sockfd == m_receive_socket) {
         rx_len = sizeof(rx_addr);
         r = recvfrom(m_receive_socket, (char *)data, sizeof(data), 0, (struct sockaddr *)&rx_addr, &rx_len);
         if (r > 0) {
-          break;
+          shutdown = true;
         }
-      }
-
-      if (dataSocket != INVALID_SOCKET && FD_ISSET(dataSocket, &fdin)) {
+      } else if (sockfd == dataSocket) {
+#ifdef __linux__
+        r = ReceiveDataBatch(dataSocket);  // Also needed for the kernel drop counter
+#else
         rx_len = sizeof(rx_addr);
         r = recvfrom(dataSocket, (char *)data, sizeof(data), 0, (struct sockaddr *)&rx_addr, &rx_len);
         if (r > 0) {
-          ProcessFrame(data, r);
-          no_data_timeout = -15;
-          no_spoke_timeout = -5;
+          ProcessFrame(data, r, wxGetUTCTimeMillis());
+        }
+#endif
+        if (r > 0) {
+          now = wxGetUTCTimeMillis();
+          if (radar_deadline < now + DATA_WATCHDOG_MILLIS) {
+            radar_deadline = now + DATA_WATCHDOG_MILLIS;
+          }
+          spoke_deadline = now + SPOKE_WATCHDOG_MILLIS;
         } else {
-          closesocket(dataSocket);
-          dataSocket = INVALID_SOCKET;
+          CloseWatchedSocket(&waiter, &dataSocket);
           wxLogError(wxT("BR24radar_pi: %s at %u.%u.%u.%u illegal frame"), m_ri->m_name.c_str(), a[0], a[1], a[2], a[3]);
         }
-      }
-
-      if (commandSocket != INVALID_SOCKET && FD_ISSET(commandSocket, &fdin)) {
+      } else if (sockfd == commandSocket) {
         rx_len = sizeof(rx_addr);
         r = recvfrom(commandSocket, (char *)data, sizeof(data), 0, (struct sockaddr *)&rx_addr, &rx_len);
         if (r > 0 && rx_addr.addr.ss_family == AF_INET) {
@@ -542,15 +736,12 @@ void *br24Receive::Entry(void) {
           addr.Printf(wxT("%u.%u.%u.%u"), a[0], a[1], a[2], a[3]);
           IF_LOG_AT(LOGLEVEL_RECEIVE, logBinaryData(wxString::Format(wxT("%s sent command"), addr.c_str()), data, r));
           ProcessCommand(addr, data, r);
-          no_data_timeout = SECONDS_SELECT(-15);
+          radar_deadline = wxGetUTCTimeMillis() + REPORT_WATCHDOG_MILLIS;
         } else {
-          closesocket(commandSocket);
-          commandSocket = INVALID_SOCKET;
+          CloseWatchedSocket(&waiter, &commandSocket);
           wxLogError(wxT("BR24radar_pi: %s at %u.%u.%u.%u illegal command"), m_ri->m_name.c_str(), a[0], a[1], a[2], a[3]);
         }
-      }
-
-      if (reportSocket != INVALID_SOCKET && FD_ISSET(reportSocket, &fdin)) {
+      } else if (sockfd == reportSocket) {
         rx_len = sizeof(rx_addr);
         r = recvfrom(reportSocket, (char *)data, sizeof(data), 0, (struct sockaddr *)&rx_addr, &rx_len);
         if (r > 0) {
@@ -572,50 +763,44 @@ void *br24Receive::Entry(void) {
               }
             }
             m_ri->m_radar_timeout = time(0) + WATCHDOG_TIMEOUT;
-            no_data_timeout = SECONDS_SELECT(-15);
+            radar_deadline = wxGetUTCTimeMillis() + REPORT_WATCHDOG_MILLIS;
           }
         } else {
           wxLogError(wxT("BR24radar_pi: %s at %u.%u.%u.%u illegal report"), m_ri->m_name.c_str(), a[0], a[1], a[2], a[3]);
-          closesocket(reportSocket);
-          reportSocket = INVALID_SOCKET;
+          CloseWatchedSocket(&waiter, &reportSocket);
         }
       }
+    }
+    if (shutdown) {
+      break;
+    }
 
-    } else if (m_pi->m_settings.emulator_on) {
-      EmulateFakeBuffer();
-    } else {  // no data received -> select timeout
-
-      if (no_data_timeout >= SECONDS_SELECT(2)) {
-        no_data_timeout = 0;
+    now = wxGetUTCTimeMillis();
+    if (m_pi->m_settings.emulator_on) {
+      if (now >= emulator_deadline) {
+        EmulateFakeBuffer();
+        emulator_deadline = now + MILLIS_PER_SELECT;
+      }
+    } else {
+      if (now >= radar_deadline) {
+        radar_deadline = now + RECEIVE_IDLE_MILLIS;
         if (reportSocket != INVALID_SOCKET) {
-          closesocket(reportSocket);
-          reportSocket = INVALID_SOCKET;
+          CloseWatchedSocket(&waiter, &reportSocket);
           m_ri->m_state.Update(RADAR_OFF);
           m_mcast_addr = 0;
           radar_addr = 0;
         }
-      } else {
-        no_data_timeout++;
       }
-
-      if (no_spoke_timeout >= SECONDS_SELECT(2)) {
-        no_spoke_timeout = 0;
+      if (now >= spoke_deadline) {
+        spoke_deadline = now + RECEIVE_IDLE_MILLIS;
         m_ri->ResetRadarImage();
-      } else {
-        no_spoke_timeout++;
       }
     }
 
     if (reportSocket == INVALID_SOCKET) {
       // If we closed the reportSocket then close the command and data socket
-      if (dataSocket != INVALID_SOCKET) {
-        closesocket(dataSocket);
-        dataSocket = INVALID_SOCKET;
-      }
-      if (commandSocket != INVALID_SOCKET) {
-        closesocket(commandSocket);
-        commandSocket = INVALID_SOCKET;
-      }
+      CloseWatchedSocket(&waiter, &dataSocket);
+      CloseWatchedSocket(&waiter, &commandSocket);
     }
 
   }  // endless loop until thread destroy
@@ -33,11 +33,16 @@
 #define _BR24RECEIVE_H_
 
 #include "RadarInfo.h"
+#include "pcaputil.h"
 #include "pi_common.h"
 #include "socketutil.h"
 
 PLUGIN_BEGIN_NAMESPACE
 
+#define RECEIVE_BATCH (16)  // Frames read per recvmmsg() call
+
+struct radar_frame_pkt;
+
 class br24Receive : public wxThread {
  public:
   br24Receive(br24radar_pi *pi, RadarInfo *ri) : wxThread(wxTHREAD_JOINABLE), m_pi(pi), m_ri(ri) {
@@ -47,6 +52,8 @@ class br24Receive : public wxThread {
     m_radar_status = 0;
     m_new_ip_addr = false;
     m_next_rotation = 0;
+    m_batch = 0;
+    m_dropped = 0;
 
     if (m_pi->m_settings.mcast_address.length()) {
       int b[4];
@@ -78,7 +85,11 @@ class br24Receive : public wxThread {
     LOG_RECEIVE(wxT("BR24radar_pi: %s receive thread created"), m_ri->m_name.c_str());
   };
 
-  ~br24Receive() {}
+  ~br24Receive() {
+    if (m_batch) {
+      free(m_batch);
+    }
+  }
 
   void *Entry(void);
   void Shutdown(void);
@@ -91,11 +102,15 @@ class br24Receive : public wxThread {
  private:
   void logBinaryData(const wxString &what, const UINT8 *data, int size);
 
-  void ProcessFrame(const UINT8 *data, int len);
+  void ProcessFrame(const UINT8 *data, int len, wxLongLong time_rec);
   bool ProcessReport(const UINT8 *data, int len);
   void ProcessCommand(wxString &addr, const UINT8 *data, int len);
 
   void EmulateFakeBuffer(void);
+  bool ReplayCapture(void);
+#ifdef __linux__
+  int ReceiveDataBatch(SOCKET socket);
+#endif
   SOCKET PickNextEthernetCard();
   SOCKET GetNewReportSocket();
   SOCKET GetNewDataSocket();
@@ -114,6 +129,9 @@ class br24Receive : public wxThread {
   int m_next_spoke;     // emulator next spoke
   int m_next_rotation;  // slowly rotate emulator
   char m_radar_status;
+
+  radar_frame_pkt *m_batch;  // RECEIVE_BATCH frame buffers for ReceiveDataBatch()
+  UINT32 m_dropped;          // Last SO_RXQ_OVFL value seen on the data socket
 };
 
 PLUGIN_END_NAMESPACE
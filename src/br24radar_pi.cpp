@@ -840,10 +840,11 @@ void br24radar_pi::Notify(void) {
     wxString t;
     for (size_t r = 0; r < RADARS; r++) {
       if (m_radar[r]->m_state.value != RADAR_OFF) {
-        t << wxString::Format(wxT("%s\npackets %d/%d\nspokes %d/%d/%d\n"), m_radar[r]->m_name.c_str(),
+        t << wxString::Format(wxT("%s\npackets %d/%d/%d\nspokes %d/%d/%d/%d\n"), m_radar[r]->m_name.c_str(),
                               m_radar[r]->m_statistics.packets, m_radar[r]->m_statistics.broken_packets,
-                              m_radar[r]->m_statistics.spokes, m_radar[r]->m_statistics.broken_spokes,
-                              m_radar[r]->m_statistics.missing_spokes);
+                              m_radar[r]->m_statistics.dropped_packets, m_radar[r]->m_statistics.spokes,
+                              m_radar[r]->m_statistics.broken_spokes, m_radar[r]->m_statistics.missing_spokes,
+                              m_radar[r]->m_statistics.dropped_spokes);
       }
     }
     if (JsonAIS != wxEmptyString) t = JsonAIS;  // ARPA AIS debug info
@@ -902,8 +903,10 @@ void br24radar_pi::Notify(void) {
   for (int r = 0; r < RADARS; r++) {
     m_radar[r]->UpdateControlState(false);
     m_radar[r]->m_statistics.broken_packets = 0;
+    m_radar[r]->m_statistics.dropped_packets = 0;
     m_radar[r]->m_statistics.broken_spokes = 0;
     m_radar[r]->m_statistics.missing_spokes = 0;
+    m_radar[r]->m_statistics.dropped_spokes = 0;
     m_radar[r]->m_statistics.packets = 0;
     m_radar[r]->m_statistics.spokes = 0;
   }
@@ -1109,6 +1112,8 @@ bool br24radar_pi::LoadConfig(void) {
     }
 
     pConf->Read(wxT("AlertAudioFile"), &m_settings.alert_audio_file, m_shareLocn + wxT("alarm.wav"));
+    pConf->Read(wxT("ArpaMaxTargets"), &m_settings.arpa_max_targets, MAX_NUMBER_OF_TARGETS);
+    pConf->Read(wxT("ArpaThreads"), &m_settings.arpa_threads, 0);
     pConf->Read(wxT("ChartOverlay"), &m_settings.chart_overlay, 0);
     pConf->Read(wxT("ColourStrong"), &s, "rgb(255,0,0)");
     m_settings.strong_colour = wxColour(s);
@@ -1132,7 +1137,11 @@ bool br24radar_pi::LoadConfig(void) {
     pConf->Read(wxT("RangeUnits"), &v, 0);
     m_settings.range_units = (RangeUnits)wxMax(wxMin(v, 1), 0);
     m_settings.range_unit_meters = (m_settings.range_units == RANGE_METRIC) ? 1000 : 1852;
+    pConf->Read(wxT("ReceiveBatch"), &m_settings.receive_batch, false);
+    pConf->Read(wxT("ReceiveBuffer"), &m_settings.receive_buffer, 1024 * 1024);
     pConf->Read(wxT("Refreshrate"), &m_settings.refreshrate, 3);
+    pConf->Read(wxT("ReplayFile"), &m_settings.replay_file, wxT(""));
+    pConf->Read(wxT("ReplaySpeed"), &m_settings.replay_speed, 1.0);
     pConf->Read(wxT("ReverseZoom"), &m_settings.reverse_zoom, false);
     pConf->Read(wxT("ScanMaxAge"), &m_settings.max_age, 6);
     pConf->Read(wxT("Show"), &m_settings.show, true);
@@ -1152,6 +1161,7 @@ bool br24radar_pi::LoadConfig(void) {
 
     m_settings.max_age = wxMax(wxMin(m_settings.max_age, MAX_AGE), MIN_AGE);
     m_settings.refreshrate = wxMax(wxMin(m_settings.refreshrate, 5), 1);
+    m_settings.replay_speed = wxMax(m_settings.replay_speed, 0.0);
 
     SaveConfig();
     return true;
@@ -1169,6 +1179,8 @@ bool br24radar_pi::SaveConfig(void) {
     pConf->Write(wxT("AlarmPosX"), m_settings.alarm_pos.x);
     pConf->Write(wxT("AlarmPosY"), m_settings.alarm_pos.y);
     pConf->Write(wxT("AlertAudioFile"), m_settings.alert_audio_file);
+    pConf->Write(wxT("ArpaMaxTargets"), m_settings.arpa_max_targets);
+    pConf->Write(wxT("ArpaThreads"), m_settings.arpa_threads);
     pConf->Write(wxT("ChartOverlay"), m_settings.chart_overlay);
     pConf->Write(wxT("DrawingMethod"), m_settings.drawing_method);
     pConf->Write(wxT("EmulatorOn"), m_settings.emulator_on);
@@ -1185,7 +1197,11 @@ bool br24radar_pi::SaveConfig(void) {
     pConf->Write(wxT("PassHeadingToOCPN"), m_settings.pass_heading_to_opencpn);
     pConf->Write(wxT("RadarInterface"), m_settings.mcast_address);
     pConf->Write(wxT("RangeUnits"), (int)m_settings.range_units);
+    pConf->Write(wxT("ReceiveBatch"), m_settings.receive_batch);
+    pConf->Write(wxT("ReceiveBuffer"), m_settings.receive_buffer);
     pConf->Write(wxT("Refreshrate"), m_settings.refreshrate);
+    pConf->Write(wxT("ReplayFile"), m_settings.replay_file);
+    pConf->Write(wxT("ReplaySpeed"), m_settings.replay_speed);
     pConf->Write(wxT("ReverseZoom"), m_settings.reverse_zoom);
     pConf->Write(wxT("RunTimeOnIdle"), m_settings.idle_run_time);
     pConf->Write(wxT("ScanMaxAge"), m_settings.max_age);
@@ -59,6 +59,7 @@ class RadarInfo;
 class br24ControlsDialog;
 class br24MessageBox;
 class br24OptionsDialog;
+class br24Process;
 class br24Receive;
 class br24Transmit;
 class br24radar_pi;
@@ -136,9 +137,11 @@ enum RadarState { RADAR_OFF, RADAR_STANDBY, RADAR_TRANSMIT, RADAR_WAKING_UP };
 struct receive_statistics {
   int packets;
   int broken_packets;
+  int dropped_packets;  // Dropped by the OS because the socket receive buffer was full
   int spokes;
   int broken_spokes;
   int missing_spokes;
+  int dropped_spokes;  // Received but not processed because the process thread fell behind
 };
 
 // WARNING
@@ -298,6 +301,10 @@ struct PersistentSettings {
   bool enable_cog_heading;          // Allow COG as heading. Should be taken out back and shot.
   bool enable_dual_radar;           // Should the dual radar be enabled for 4G?
   bool emulator_on;                 // Emulator, useful when debugging without radar
+  wxString replay_file;             // pcap file to replay instead of listening to the network, for testing
+  double replay_speed;              // 0 = as fast as possible, 1 = original timing, 2 = twice as fast, etc.
+  bool receive_batch;               // Linux: read data frames with recvmmsg() and kernel receive timestamps
+  int receive_buffer;               // Requested receive buffer size in bytes for the data socket
   int drawing_method;               // VertexBuffer, Shader, etc.
   bool ignore_radar_heading;        // For testing purposes
   bool reverse_zoom;                // false = normal, true = reverse
@@ -308,6 +315,8 @@ struct PersistentSettings {
   int main_bang_size;               // Pixels at center to ignore
   int type_detection_method;        // 0 = default, 1 = ignore reports
   int AISatARPAoffset;              // Rectangle side where to search AIS targets at ARPA position
+  int arpa_max_targets;             // Most ARPA and MARPA targets per radar
+  int arpa_threads;                 // Threads that refresh ARPA targets in parallel, 0 or 1 = serial
   wxPoint control_pos[RADARS];      // Saved position of control menu windows
   wxPoint window_pos[RADARS];       // Saved position of radar windows, when floating and not docked
   wxPoint alarm_pos;                // Saved position of alarm window
@@ -172,16 +172,9 @@ PolarToCartesianLookupTable* GetPolarToCartesianLookupTable() {
       wxAbort();
     }
 
-    // initialise polar_to_cart_y[arc + 1][radius] arrays
     for (int arc = 0; arc < LINES_PER_ROTATION + 1; arc++) {
-      GLfloat sine = sinf((GLfloat)arc * PI * 2 / LINES_PER_ROTATION);
-      GLfloat cosine = cosf((GLfloat)arc * PI * 2 / LINES_PER_ROTATION);
-      for (int radius = 0; radius < RETURNS_PER_LINE + 1; radius++) {
-        lookupTable->x[arc][radius] = (GLfloat)radius * cosine;
-        lookupTable->y[arc][radius] = (GLfloat)radius * sine;
-        lookupTable->intx[arc][radius] = (int)lookupTable->x[arc][radius];
-        lookupTable->inty[arc][radius] = (int)lookupTable->y[arc][radius];
-      }
+      lookupTable->sine[arc] = sinf((GLfloat)arc * PI * 2 / LINES_PER_ROTATION);
+      lookupTable->cosine[arc] = cosf((GLfloat)arc * PI * 2 / LINES_PER_ROTATION);
     }
   }
   return lookupTable;
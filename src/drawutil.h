@@ -41,11 +41,16 @@ extern void DrawOutlineArc(double r1, double r2, double a1, double a2, bool stip
 extern void DrawFilledArc(double r1, double r2, double a1, double a2);
 extern void CheckOpenGLError(const wxString& after);
 
+// Polar to cartesian conversion with a sine and cosine per angle (16 kB) instead of a table entry
+// per return, so it stays in the L1 cache. The results are the same as those of a full table.
 struct PolarToCartesianLookupTable {
-  GLfloat x[LINES_PER_ROTATION + 1][RETURNS_PER_LINE + 1];
-  GLfloat y[LINES_PER_ROTATION + 1][RETURNS_PER_LINE + 1];
-  int intx[LINES_PER_ROTATION + 1][RETURNS_PER_LINE + 1];
-  int inty[LINES_PER_ROTATION + 1][RETURNS_PER_LINE + 1];
+  GLfloat sine[LINES_PER_ROTATION + 1];
+  GLfloat cosine[LINES_PER_ROTATION + 1];
+
+  GLfloat X(int arc, int radius) const { return (GLfloat)radius * cosine[arc]; }
+  GLfloat Y(int arc, int radius) const { return (GLfloat)radius * sine[arc]; }
+  int IntX(int arc, int radius) const { return (int)X(arc, radius); }
+  int IntY(int arc, int radius) const { return (int)Y(arc, radius); }
 };
 
 extern PolarToCartesianLookupTable* GetPolarToCartesianLookupTable();
@@ -0,0 +1,560 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "pcaputil.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+#define PCAP_MAGIC_MICROS (0xa1b2c3d4)
+#define PCAP_MAGIC_NANOS (0xa1b23c4d)
+
+#define PCAPNG_SECTION_HEADER (0x0a0d0d0a)
+#define PCAPNG_INTERFACE_DESCRIPTION (1)
+#define PCAPNG_PACKET (2)  // obsolete, but still written by some tools
+#define PCAPNG_SIMPLE_PACKET (3)
+#define PCAPNG_ENHANCED_PACKET (6)
+#define PCAPNG_BYTE_ORDER_MAGIC (0x1a2b3c4d)
+#define PCAPNG_OPTION_END (0)
+#define PCAPNG_OPTION_IF_TSRESOL (9)
+
+#define LINKTYPE_NULL (0)
+#define LINKTYPE_ETHERNET (1)
+#define LINKTYPE_RAW_OPENBSD (12)
+#define LINKTYPE_RAW (101)
+#define LINKTYPE_LOOP (108)
+#define LINKTYPE_LINUX_SLL (113)
+#define LINKTYPE_IPV4 (228)
+
+#define ETHERTYPE_IPV4 (0x0800)
+#define ETHERTYPE_VLAN (0x8100)
+
+#define IP_PROTO_UDP (17)
+#define IP_FLAG_MORE_FRAGMENTS (0x2000)
+#define IP_FRAGMENT_OFFSET (0x1fff)
+
+#define UDP_HEADER_LEN (8)
+
+#pragma pack(push, 1)
+
+struct pcap_file_header {
+  UINT32 magic;
+  UINT16 version_major;
+  UINT16 version_minor;
+  UINT32 thiszone;
+  UINT32 sigfigs;
+  UINT32 snaplen;
+  UINT32 linktype;
+};
+
+struct pcap_record_header {
+  UINT32 ts_sec;
+  UINT32 ts_frac;  // micro- or nanoseconds, depending on magic
+  UINT32 incl_len;
+  UINT32 orig_len;
+};
+
+struct pcapng_block_header {
+  UINT32 type;
+  UINT32 total_len;  // including this header and the trailing copy of total_len
+};
+
+#pragma pack(pop)
+
+// Network order accessors
+#define GET16(p) ((UINT16)(((p)[0] << 8) | (p)[1]))
+
+PcapReader::PcapReader() {
+  m_file = 0;
+  m_zlib = 0;
+  m_stream = 0;
+  m_pcapng = false;
+  m_swapped = false;
+  m_nanoseconds = false;
+  m_linktype = 0;
+  m_interfaces = 0;
+  m_record = 0;
+  m_reassembly = 0;
+  m_age = 0;
+}
+
+PcapReader::~PcapReader() { Close(); }
+
+void PcapReader::Close() {
+  if (m_zlib) {
+    delete m_zlib;
+    m_zlib = 0;
+  }
+  if (m_file) {
+    delete m_file;
+    m_file = 0;
+  }
+  m_stream = 0;
+  if (m_record) {
+    free(m_record);
+    m_record = 0;
+  }
+  if (m_reassembly) {
+    free(m_reassembly);
+    m_reassembly = 0;
+  }
+}
+
+UINT32 PcapReader::Swap32(UINT32 v) {
+  if (!m_swapped) {
+    return v;
+  }
+  return ((v & 0xff) << 24) | ((v & 0xff00) << 8) | ((v >> 8) & 0xff00) | (v >> 24);
+}
+
+UINT16 PcapReader::Swap16(UINT16 v) {
+  if (!m_swapped) {
+    return v;
+  }
+  return (UINT16)((v << 8) | (v >> 8));
+}
+
+bool PcapReader::ReadBytes(void *buf, size_t len) {
+  if (!m_stream) {
+    return false;
+  }
+  m_stream->Read(buf, len);
+  return m_stream->LastRead() == len;
+}
+
+bool PcapReader::SkipBytes(size_t len) {
+  while (len > 0) {
+    size_t n = wxMin(len, (size_t)PCAP_MAX_RECORD);
+    if (!ReadBytes(m_record, n)) {
+      return false;
+    }
+    len -= n;
+  }
+  return true;
+}
+
+bool PcapReader::Open(const wxString &filename, wxString &error_message) {
+  pcap_file_header hdr;
+  UINT8 gzip_magic[2];
+
+  Close();
+  error_message = wxT("");
+  m_pcapng = false;
+  m_swapped = false;
+  m_nanoseconds = false;
+  m_interfaces = 0;
+
+  m_record = (UINT8 *)malloc(PCAP_MAX_RECORD);
+  m_reassembly = (Reassembly *)malloc(PCAP_REASSEMBLY_SLOTS * sizeof(Reassembly));
+  if (!m_record || !m_reassembly) {
+    error_message << _("Out of memory");
+    goto fail;
+  }
+  for (int i = 0; i < PCAP_REASSEMBLY_SLOTS; i++) {
+    m_reassembly[i].in_use = false;
+  }
+  m_age = 0;
+
+  m_file = new wxFileInputStream(filename);
+  if (!m_file->IsOk()) {
+    error_message << _("Cannot open");
+    goto fail;
+  }
+
+  // Auto-detect gzip by its magic, not by the file name
+  m_file->Read(gzip_magic, sizeof(gzip_magic));
+  m_file->SeekI(0);
+  if (m_file->LastRead() == sizeof(gzip_magic) && gzip_magic[0] == 0x1f && gzip_magic[1] == 0x8b) {
+    m_zlib = new wxZlibInputStream(*m_file, wxZLIB_GZIP);
+    m_stream = m_zlib;
+  } else {
+    m_stream = m_file;
+  }
+
+  if (!ReadBytes(&hdr, sizeof(hdr))) {
+    error_message << _("File too short");
+    goto fail;
+  }
+
+  if (hdr.magic == PCAPNG_SECTION_HEADER) {
+    // The section header starts with block type, length and byte order magic, followed by
+    // the version and section length that we don't need.
+    UINT32 words[3];
+    memcpy(words, &hdr, sizeof(words));
+    if (words[2] != PCAPNG_BYTE_ORDER_MAGIC) {
+      m_swapped = true;
+      if (Swap32(words[2]) != PCAPNG_BYTE_ORDER_MAGIC) {
+        error_message << _("Not a pcapng file");
+        goto fail;
+      }
+    }
+    UINT32 total_len = Swap32(words[1]);
+    if (total_len < sizeof(hdr) + sizeof(UINT32) || !SkipBytes(total_len - sizeof(hdr))) {
+      error_message << _("File too short");
+      goto fail;
+    }
+    m_pcapng = true;
+    return true;
+  }
+
+  switch (hdr.magic) {
+    case PCAP_MAGIC_MICROS:
+      break;
+    case PCAP_MAGIC_NANOS:
+      m_nanoseconds = true;
+      break;
+    default:
+      m_swapped = true;
+      if (Swap32(hdr.magic) == PCAP_MAGIC_MICROS) {
+        break;
+      }
+      if (Swap32(hdr.magic) == PCAP_MAGIC_NANOS) {
+        m_nanoseconds = true;
+        break;
+      }
+      error_message << _("Not a pcap file");
+      goto fail;
+  }
+  m_linktype = Swap32(hdr.linktype);
+
+  // Hurrah! Success!
+  return true;
+
+fail:
+  error_message << wxT(" ") << filename;
+  Close();
+  return false;
+}
+
+void PcapReader::ParseInterfaceBlock(const UINT8 *body, UINT32 len) {
+  UINT16 v16;
+
+  if (m_interfaces >= PCAP_MAX_INTERFACES || len < 8) {
+    m_interfaces++;  // Keep the numbering right, packets on this interface are ignored
+    return;
+  }
+  Interface *i = &m_interface[m_interfaces++];
+
+  memcpy(&v16, body, sizeof(v16));
+  i->linktype = Swap16(v16);
+  i->tsresol = 6;
+
+  // Skip linktype, reserved and snaplen and walk the options
+  UINT32 pos = 8;
+  while (pos + 4 <= len) {
+    memcpy(&v16, body + pos, sizeof(v16));
+    UINT16 code = Swap16(v16);
+    memcpy(&v16, body + pos + 2, sizeof(v16));
+    UINT16 option_len = Swap16(v16);
+    pos += 4;
+    if (code == PCAPNG_OPTION_END || pos + option_len > len) {
+      break;
+    }
+    if (code == PCAPNG_OPTION_IF_TSRESOL && option_len >= 1) {
+      i->tsresol = body[pos];
+    }
+    pos += (option_len + 3) & ~3;
+  }
+}
+
+/*
+ * Read pcapng blocks until the next packet block, which is left in m_record.
+ */
+bool PcapReader::ReadPcapngBlock(UINT32 *linktype, wxLongLong_t *micros, UINT32 *len, bool *is_packet) {
+  pcapng_block_header block;
+  UINT32 words[5];
+
+  *is_packet = false;
+  if (!ReadBytes(&block, sizeof(block))) {
+    return false;
+  }
+
+  if (block.type == PCAPNG_SECTION_HEADER) {
+    // A new section may have a different byte order and starts its own interface list
+    if (!ReadBytes(words, sizeof(UINT32))) {
+      return false;
+    }
+    m_swapped = words[0] != PCAPNG_BYTE_ORDER_MAGIC;
+    m_interfaces = 0;
+    UINT32 total_len = Swap32(block.total_len);
+    if (total_len < sizeof(block) + 2 * sizeof(UINT32)) {
+      return false;
+    }
+    return SkipBytes(total_len - sizeof(block) - sizeof(UINT32));
+  }
+
+  UINT32 type = Swap32(block.type);
+  UINT32 total_len = Swap32(block.total_len);
+  if (total_len < sizeof(block) + sizeof(UINT32) || total_len > PCAP_MAX_RECORD) {
+    wxLogError(wxT("BR24radar_pi: pcapng block length %u is invalid, file is corrupt"), total_len);
+    return false;
+  }
+  UINT32 body_len = total_len - sizeof(block) - sizeof(UINT32);
+  if (!ReadBytes(m_record, body_len) || !ReadBytes(words, sizeof(UINT32))) {
+    return false;
+  }
+
+  UINT32 interface_id = 0;
+  UINT32 ts_high = 0, ts_low = 0;
+  UINT32 data_offset;
+
+  switch (type) {
+    case PCAPNG_INTERFACE_DESCRIPTION:
+      ParseInterfaceBlock(m_record, body_len);
+      return true;
+
+    case PCAPNG_ENHANCED_PACKET:
+    case PCAPNG_PACKET:
+      if (body_len < 20) {
+        return true;
+      }
+      memcpy(words, m_record, sizeof(words));
+      // Obsolete packet block has a 16 bit interface id followed by a 16 bit drop count
+      interface_id = (type == PCAPNG_PACKET) ? Swap16(((UINT16 *)words)[0]) : Swap32(words[0]);
+      ts_high = Swap32(words[1]);
+      ts_low = Swap32(words[2]);
+      *len = Swap32(words[3]);
+      data_offset = 20;
+      break;
+
+    case PCAPNG_SIMPLE_PACKET:
+      // No timestamp, the caller keeps the previous one
+      if (body_len < 4) {
+        return true;
+      }
+      memcpy(words, m_record, sizeof(UINT32));
+      *len = wxMin(Swap32(words[0]), body_len - 4);
+      data_offset = 4;
+      *micros = -1;
+      break;
+
+    default:
+      return true;
+  }
+
+  if (interface_id >= (UINT32)m_interfaces || interface_id >= PCAP_MAX_INTERFACES || *len > body_len - data_offset) {
+    return true;
+  }
+  Interface *i = &m_interface[interface_id];
+  *linktype = i->linktype;
+  memmove(m_record, m_record + data_offset, *len);
+
+  if (type != PCAPNG_SIMPLE_PACKET) {
+    wxLongLong_t units = ((wxLongLong_t)ts_high << 32) | ts_low;
+    if (i->tsresol & 0x80) {
+      *micros = (wxLongLong_t)((double)units * 1000000.0 / (double)((wxLongLong_t)1 << (i->tsresol & 0x7f)));
+    } else {
+      int exp = i->tsresol;
+      for (; exp > 6; exp--) {
+        units /= 10;
+      }
+      for (; exp < 6; exp++) {
+        units *= 10;
+      }
+      *micros = units;
+    }
+  }
+  *is_packet = true;
+  return true;
+}
+
+bool PcapReader::ReadRecord(UINT32 *linktype, wxLongLong_t *micros, UINT32 *len) {
+  if (m_pcapng) {
+    bool is_packet = false;
+    while (!is_packet) {
+      if (!ReadPcapngBlock(linktype, micros, len, &is_packet)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  pcap_record_header rec;
+  if (!ReadBytes(&rec, sizeof(rec))) {
+    return false;
+  }
+  *len = Swap32(rec.incl_len);
+  if (*len > PCAP_MAX_RECORD) {
+    wxLogError(wxT("BR24radar_pi: pcap record length %u is invalid, file is corrupt"), *len);
+    return false;
+  }
+  UINT32 ts_frac = Swap32(rec.ts_frac);
+  *micros = (wxLongLong_t)Swap32(rec.ts_sec) * 1000000 + (m_nanoseconds ? ts_frac / 1000 : ts_frac);
+  *linktype = m_linktype;
+  return ReadBytes(m_record, *len);
+}
+
+/*
+ * Add one IP fragment to the reassembly slots. Returns the complete IP payload
+ * (UDP header + data) when this fragment completes a datagram, otherwise 0.
+ * Fragments are assumed not to overlap, which holds for anything the radar sends.
+ */
+const UINT8 *PcapReader::ReassembleFragment(const UINT8 *ip, int ip_header_len, int ip_len, int *datagram_len) {
+  UINT32 src, dst;
+  UINT16 id = GET16(ip + 4);
+  UINT16 frag = GET16(ip + 6);
+  int offset = (frag & IP_FRAGMENT_OFFSET) * 8;
+  int len = ip_len - ip_header_len;
+  Reassembly *slot = 0;
+  Reassembly *oldest = 0;
+
+  memcpy(&src, ip + 12, sizeof(src));
+  memcpy(&dst, ip + 16, sizeof(dst));
+
+  if (offset + len > PCAP_MAX_DATAGRAM) {
+    return 0;
+  }
+
+  m_age++;
+  for (int i = 0; i < PCAP_REASSEMBLY_SLOTS; i++) {
+    Reassembly *r = &m_reassembly[i];
+    if (r->in_use && r->src == src && r->dst == dst && r->id == id) {
+      slot = r;
+      break;
+    }
+    if (!oldest || !r->in_use || (oldest->in_use && r->age < oldest->age)) {
+      oldest = r;
+    }
+  }
+  if (!slot) {
+    // Start a new datagram, dropping the stalest incomplete one if needed
+    slot = oldest;
+    slot->in_use = true;
+    slot->src = src;
+    slot->dst = dst;
+    slot->id = id;
+    slot->received = 0;
+    slot->total = -1;
+  }
+  slot->age = m_age;
+
+  memcpy(slot->data + offset, ip + ip_header_len, len);
+  slot->received += len;
+  if ((frag & IP_FLAG_MORE_FRAGMENTS) == 0) {
+    slot->total = offset + len;
+  }
+
+  if (slot->total >= 0 && slot->received >= slot->total) {
+    slot->in_use = false;
+    *datagram_len = slot->total;
+    return slot->data;
+  }
+  return 0;
+}
+
+bool PcapReader::NextDatagram(PcapDatagram *datagram) {
+  UINT32 linktype;
+  UINT32 record_len;
+  wxLongLong_t micros = -1;
+
+  while (ReadRecord(&linktype, &micros, &record_len)) {
+    // Strip the link layer header
+    const UINT8 *p = m_record;
+    int len = (int)record_len;
+    UINT16 ethertype = ETHERTYPE_IPV4;
+
+    switch (linktype) {
+      case LINKTYPE_ETHERNET:
+        if (len < 14) {
+          continue;
+        }
+        ethertype = GET16(p + 12);
+        p += 14;
+        len -= 14;
+        if (ethertype == ETHERTYPE_VLAN && len >= 4) {
+          ethertype = GET16(p + 2);
+          p += 4;
+          len -= 4;
+        }
+        break;
+      case LINKTYPE_LINUX_SLL:
+        if (len < 16) {
+          continue;
+        }
+        ethertype = GET16(p + 14);
+        p += 16;
+        len -= 16;
+        break;
+      case LINKTYPE_NULL:
+      case LINKTYPE_LOOP:
+        p += 4;
+        len -= 4;
+        break;
+      case LINKTYPE_RAW_OPENBSD:
+      case LINKTYPE_RAW:
+      case LINKTYPE_IPV4:
+        break;
+      default:
+        continue;
+    }
+    if (ethertype != ETHERTYPE_IPV4 || len < 20 || (p[0] >> 4) != 4) {
+      continue;
+    }
+
+    // IPv4
+    int ip_header_len = (p[0] & 0x0f) * 4;
+    int ip_len = GET16(p + 2);
+    if (ip_header_len < 20 || ip_len < ip_header_len || ip_len > len || p[9] != IP_PROTO_UDP) {
+      continue;
+    }
+
+    const UINT8 *udp;
+    int udp_len;
+    UINT16 frag = GET16(p + 6);
+    if (frag & (IP_FLAG_MORE_FRAGMENTS | IP_FRAGMENT_OFFSET)) {
+      udp = ReassembleFragment(p, ip_header_len, ip_len, &udp_len);
+      if (!udp) {
+        continue;
+      }
+    } else {
+      udp = p + ip_header_len;
+      udp_len = ip_len - ip_header_len;
+    }
+
+    if (udp_len < UDP_HEADER_LEN || GET16(udp + 4) > udp_len || GET16(udp + 4) < UDP_HEADER_LEN) {
+      continue;
+    }
+
+    if (micros >= 0) {
+      datagram->time = micros;
+    }
+    memcpy(datagram->src_addr, p + 12, sizeof(datagram->src_addr));
+    memcpy(datagram->dst_addr, p + 16, sizeof(datagram->dst_addr));
+    datagram->src_port = GET16(udp);
+    datagram->dst_port = GET16(udp + 2);
+    datagram->data = udp + UDP_HEADER_LEN;
+    datagram->len = GET16(udp + 4) - UDP_HEADER_LEN;
+    return true;
+  }
+
+  return false;
+}
+
+PLUGIN_END_NAMESPACE
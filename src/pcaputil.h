@@ -0,0 +1,117 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _PCAPUTIL_H_
+#define _PCAPUTIL_H_
+
+#include "pi_common.h"
+
+#include <wx/wfstream.h>
+#include <wx/zstream.h>
+
+PLUGIN_BEGIN_NAMESPACE
+
+/*
+ * Reader for (optionally gzipped) pcap and pcapng capture files, such as the ones in example/.
+ * It only returns UDP over IPv4 datagrams; fragmented datagrams are reassembled,
+ * as the radar frames on the data port are larger than one ethernet frame.
+ */
+
+#define PCAP_MAX_RECORD (262144)
+#define PCAP_MAX_DATAGRAM (65535)
+#define PCAP_MAX_INTERFACES (8)
+#define PCAP_REASSEMBLY_SLOTS (4)
+
+struct PcapDatagram {
+  wxLongLong time;  // Capture time in microseconds since the epoch
+  UINT8 src_addr[4];
+  UINT8 dst_addr[4];
+  UINT16 src_port;
+  UINT16 dst_port;
+  const UINT8 *data;  // UDP payload, valid until the next call to NextDatagram()
+  int len;
+};
+
+class PcapReader {
+ public:
+  PcapReader();
+  ~PcapReader();
+
+  bool Open(const wxString &filename, wxString &error_message);
+  void Close();
+
+  // Returns false at end of file or when the file is corrupt
+  bool NextDatagram(PcapDatagram *datagram);
+
+ private:
+  struct Reassembly {
+    bool in_use;
+    UINT32 src, dst;
+    UINT16 id;
+    int received;  // Payload bytes received so far
+    int total;     // Total payload length, -1 until the last fragment is seen
+    int age;
+    UINT8 data[PCAP_MAX_DATAGRAM];
+  };
+
+  struct Interface {
+    UINT32 linktype;
+    UINT8 tsresol;  // pcapng if_tsresol: power of 10, or power of 2 when bit 7 is set
+  };
+
+  bool ReadBytes(void *buf, size_t len);
+  bool SkipBytes(size_t len);
+  UINT32 Swap32(UINT32 v);
+  UINT16 Swap16(UINT16 v);
+  bool ReadRecord(UINT32 *linktype, wxLongLong_t *micros, UINT32 *len);
+  bool ReadPcapngBlock(UINT32 *linktype, wxLongLong_t *micros, UINT32 *len, bool *is_packet);
+  void ParseInterfaceBlock(const UINT8 *body, UINT32 len);
+  const UINT8 *ReassembleFragment(const UINT8 *ip, int ip_header_len, int ip_len, int *datagram_len);
+
+  wxFileInputStream *m_file;
+  wxZlibInputStream *m_zlib;
+  wxInputStream *m_stream;
+
+  bool m_pcapng;
+  bool m_swapped;      // File was written on a machine with different endianness
+  bool m_nanoseconds;  // pcap timestamps are in nanoseconds instead of microseconds
+  UINT32 m_linktype;   // pcap only, pcapng has a link type per interface
+  Interface m_interface[PCAP_MAX_INTERFACES];
+  int m_interfaces;
+
+  UINT8 *m_record;  // Current captured frame
+  Reassembly *m_reassembly;
+  int m_age;
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _PCAPUTIL_H_ */
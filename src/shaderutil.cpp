@@ -49,11 +49,10 @@ typedef __GLXextFuncPtr FunctionPointer;
 
 #define SHADER_FUNCTION_LIST(proc, name) proc name;
 #include "shaderutil.inc"
+#include "bufferutil.inc"
+#include "framebufferutil.inc"
 #undef SHADER_FUNCTION_LIST
 
-GLboolean ShadersSupported(void) {
-  GLboolean ok = 1;
-
 #define SHADER_FUNCTION_LIST(proc, name)    \
   {                                         \
     union {                                 \
@@ -64,12 +63,33 @@ GLboolean ShadersSupported(void) {
     if (!u.p) ok = 0;                       \
     name = u.f;                             \
   }
+
+GLboolean ShadersSupported(void) {
+  GLboolean ok = 1;
+
 #include "shaderutil.inc"
-#undef SHADER_FUNCTION_LIST
 
   return ok;
 }
 
+GLboolean BuffersSupported(void) {
+  GLboolean ok = 1;
+
+#include "bufferutil.inc"
+
+  return ok;
+}
+
+GLboolean FramebuffersSupported(void) {
+  GLboolean ok = 1;
+
+#include "framebufferutil.inc"
+
+  return ok;
+}
+
+#undef SHADER_FUNCTION_LIST
+
 bool CompileShaderText(GLuint *shader, GLenum shaderType, const char *text) {
   GLint stat;
 
@@ -42,11 +42,17 @@ extern GLdouble GetShaderLinkTime(void);
 
 extern void SetUniformValues(GLuint program, struct uniform_info uniforms[]);
 
+extern GLboolean BuffersSupported(void);
+
+extern GLboolean FramebuffersSupported(void);
+
 /*
- * These pointers are only valid after calling ShadersSupported.
+ * These pointers are only valid after calling ShadersSupported, BuffersSupported or FramebuffersSupported.
  */
 #define SHADER_FUNCTION_LIST(proc, name) extern proc name;
 #include "shaderutil.inc"
+#include "bufferutil.inc"
+#include "framebufferutil.inc"
 #undef SHADER_FUNCTION_LIST
 
 PLUGIN_END_NAMESPACE
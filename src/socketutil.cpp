@@ -32,6 +32,11 @@
 
 #include "socketutil.h"
 
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 PLUGIN_BEGIN_NAMESPACE
 
 int br24_inet_aton(const char *cp, struct in_addr *addr) {
@@ -155,7 +160,12 @@ bool socketReady(SOCKET sockfd, int timeout) {
   return r > 0;
 }
 
-SOCKET startUDPMulticastReceiveSocket(struct sockaddr_in *addr, UINT16 port, const char *mcast_address, wxString &error_message) {
+/*
+ * When receive_buffer > 0 the socket asks for a receive buffer of that many bytes (the OS may
+ * give less) and, on Linux, for the count of datagrams dropped because the buffer was full.
+ */
+SOCKET startUDPMulticastReceiveSocket(struct sockaddr_in *addr, UINT16 port, const char *mcast_address, wxString &error_message,
+                                      int receive_buffer) {
   SOCKET rx_socket;
   struct sockaddr_in adr;
   int one = 1;
@@ -189,6 +199,14 @@ SOCKET startUDPMulticastReceiveSocket(struct sockaddr_in *addr, UINT16 port, con
     goto fail;
   }
 
+  if (receive_buffer > 0) {
+    // Not fatal, the socket just keeps its default buffer
+    setsockopt(rx_socket, SOL_SOCKET, SO_RCVBUF, (const char *)&receive_buffer, sizeof(receive_buffer));
+#ifdef SO_RXQ_OVFL
+    setsockopt(rx_socket, SOL_SOCKET, SO_RXQ_OVFL, (const char *)&one, sizeof(one));
+#endif
+  }
+
   // Subscribe rx_socket to a multicast group
   struct ip_mreq mreq;
   mreq.imr_interface = addr->sin_addr;
@@ -331,4 +349,144 @@ void freeifaddrs(struct ifaddrs *ifa) { free(ifa); }
 
 #endif
 
+SocketWaiter::SocketWaiter() {
+  m_count = 0;
+#ifdef __linux__
+  m_armed = 0;
+  m_epoll = epoll_create1(EPOLL_CLOEXEC);
+  m_timer = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (m_epoll >= 0 && m_timer >= 0) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_timer;
+    if (!epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_timer, &ev)) {
+      return;
+    }
+  }
+  wxLogError(wxT("BR24radar_pi: Unable to use epoll, falling back to select"));
+  if (m_epoll >= 0) {
+    close(m_epoll);
+    m_epoll = -1;
+  }
+  if (m_timer >= 0) {
+    close(m_timer);
+    m_timer = -1;
+  }
+#endif
+}
+
+SocketWaiter::~SocketWaiter() {
+#ifdef __linux__
+  if (m_epoll >= 0) {
+    close(m_epoll);
+  }
+  if (m_timer >= 0) {
+    close(m_timer);
+  }
+#endif
+}
+
+void SocketWaiter::Add(SOCKET sockfd) {
+  if (sockfd == INVALID_SOCKET || m_count >= SOCKET_WAITER_MAX) {
+    return;
+  }
+  m_sockets[m_count++] = sockfd;
+#ifdef __linux__
+  if (m_epoll >= 0) {
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = sockfd;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, sockfd, &ev);
+  }
+#endif
+}
+
+void SocketWaiter::Remove(SOCKET sockfd) {
+  for (int i = 0; i < m_count; i++) {
+    if (m_sockets[i] == sockfd) {
+      m_sockets[i] = m_sockets[--m_count];
+#ifdef __linux__
+      if (m_epoll >= 0) {
+        struct epoll_event ev;  // Ignored, but kernels before 2.6.9 need it
+
+        epoll_ctl(m_epoll, EPOLL_CTL_DEL, sockfd, &ev);
+      }
+#endif
+      return;
+    }
+  }
+}
+
+int SocketWaiter::Wait(wxLongLong deadline, SOCKET *ready, int max_ready) {
+  int n = 0;
+  int r;
+
+  if (deadline != 0 && deadline <= wxGetUTCTimeMillis()) {
+    return 0;
+  }
+
+#ifdef __linux__
+  if (m_epoll >= 0) {
+    struct epoll_event events[SOCKET_WAITER_MAX + 1];
+
+    if (deadline != m_armed) {
+      struct itimerspec its;
+
+      memset(&its, 0, sizeof(its));  // All zero disarms the timer
+      if (deadline != 0) {
+        its.it_value.tv_sec = (time_t)(deadline / MILLISECONDS_PER_SECOND).GetValue();
+        its.it_value.tv_nsec = (long)(deadline % MILLISECONDS_PER_SECOND).GetValue() * 1000000;
+      }
+      timerfd_settime(m_timer, TFD_TIMER_ABSTIME, &its, 0);
+      m_armed = deadline;
+    }
+
+    r = epoll_wait(m_epoll, events, ARRAY_SIZE(events), -1);
+    for (int i = 0; i < r; i++) {
+      if (events[i].data.fd == m_timer) {
+        uint64_t expirations;
+
+        if (read(m_timer, &expirations, sizeof(expirations)) > 0) {
+          m_armed = 0;
+        }
+      } else if (n < max_ready) {
+        ready[n++] = events[i].data.fd;
+      }
+    }
+    return n;
+  }
+#endif
+
+  fd_set fdin;
+  struct timeval tv;
+  struct timeval *timeout = 0;
+  SOCKET max_fd = 0;
+
+  FD_ZERO(&fdin);
+  for (int i = 0; i < m_count; i++) {
+    FD_SET(m_sockets[i], &fdin);
+    max_fd = MAX(m_sockets[i], max_fd);
+  }
+  if (deadline != 0) {
+    long millis = (long)(deadline - wxGetUTCTimeMillis()).GetValue();
+
+    millis = MAX(millis, 0);
+    tv.tv_sec = millis / MILLISECONDS_PER_SECOND;
+    tv.tv_usec = (millis % MILLISECONDS_PER_SECOND) * MILLISECONDS_PER_SECOND;
+    timeout = &tv;
+  }
+
+  r = select(max_fd + 1, &fdin, 0, 0, timeout);
+  for (int i = 0; r > 0 && i < m_count && n < max_ready; i++) {
+    if (FD_ISSET(m_sockets[i], &fdin)) {
+      ready[n++] = m_sockets[i];
+    }
+  }
+  return n;
+}
+
 PLUGIN_END_NAMESPACE
@@ -45,10 +45,39 @@ extern bool socketReady(SOCKET sockfd, int timeout);
 
 extern int br24_inet_aton(const char *cp, struct in_addr *addr);
 extern SOCKET startUDPMulticastReceiveSocket(struct sockaddr_in *addr, UINT16 port, const char *mcast_address,
-                                             wxString &error_message);
+                                             wxString &error_message, int receive_buffer = 0);
 extern SOCKET GetLocalhostServerTCPSocket();
 extern SOCKET GetLocalhostSendTCPSocket(SOCKET receive_socket);
 
+/*
+ * Waits until one of a set of sockets is readable or a deadline has passed.
+ * On Linux this uses epoll with a timerfd for the deadline, elsewhere select().
+ * Sockets must be removed before they are closed.
+ */
+#define SOCKET_WAITER_MAX (8)
+
+class SocketWaiter {
+ public:
+  SocketWaiter();
+  ~SocketWaiter();
+
+  void Add(SOCKET sockfd);
+  void Remove(SOCKET sockfd);
+
+  // Deadline is in wxGetUTCTimeMillis() time, 0 = none. Returns the number of readable sockets put in ready,
+  // 0 when the deadline has passed.
+  int Wait(wxLongLong deadline, SOCKET *ready, int max_ready);
+
+ private:
+  SOCKET m_sockets[SOCKET_WAITER_MAX];
+  int m_count;
+#ifdef __linux__
+  int m_epoll;
+  int m_timer;
+  wxLongLong m_armed;  // Deadline the timer is set for, 0 = not set
+#endif
+};
+
 #ifndef __WXMSW__
 
 // Mac and Linux have ifaddrs.
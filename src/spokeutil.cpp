@@ -0,0 +1,905 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#include "spokeutil.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SPOKE_SIMD_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SPOKE_TARGET_SSE2
+#define SPOKE_TARGET_AVX2
+#else
+#define SPOKE_TARGET_SSE2 __attribute__((target("sse2")))
+#define SPOKE_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SPOKE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+PLUGIN_BEGIN_NAMESPACE
+
+static void ShiftHistoryScalar(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold) {
+  for (size_t radius = 0; radius < len; radius++) {
+    hist[radius] = (hist[radius] << 1) & 63;  // shift left history byte 1 bit, clear leftmost 2 bits to 00 for ARPA
+    if (data[radius] >= threshold) {
+      // and add 1 if above threshold and set the left 2 bits, used for ARPA
+      hist[radius] |= 192;
+    }
+  }
+}
+
+static void MultiSweepFilterScalar(UINT8 *data, const UINT8 *hist, size_t len) {
+  for (size_t radius = 0; radius < len; radius++) {
+    if (!HISTORY_FILTER_ALLOW(hist[radius])) {
+      data[radius] = 0;
+    }
+  }
+}
+
+static inline void UpdateTrail(TrailRevolutionsAge *trail, UINT8 *data, UINT8 threshold, const UINT8 *trail_colour) {
+  if (*data >= threshold) {
+    *trail = 1;
+  } else {
+    if (*trail > 0 && *trail < (TRAIL_MAX_REVOLUTIONS)) {
+      (*trail)++;
+    }
+    if (trail_colour) {
+      *data = trail_colour[*trail];
+    }
+  }
+}
+
+static void RelativeTrailsScalar(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                                 const UINT8 *trail_colour) {
+  for (size_t radius = 0; radius < len; radius++) {
+    UpdateTrail(trail + radius, data + radius, threshold, trail_colour);
+  }
+}
+
+/*
+ * The vector versions do 16 (SSE2, NEON) or 32 (AVX2) returns at a time and leave the tail to
+ * the scalar loop. There is no unsigned byte compare before AVX-512, so data >= threshold is
+ * computed as max(data, threshold) == data. HISTORY_FILTER_ALLOW(h) is true when at least two
+ * of the three low bits are set, which is bit 0 of (h & (h >> 1)) | (h & (h >> 2)) | ((h >> 1) & (h >> 2)).
+ * The 16 bit shifts move bits across bytes, but only into bits 6 and 7, which are masked off.
+ *
+ * The trail age goes up by one where 0 < age < TRAIL_MAX_REVOLUTIONS by subtracting the all ones
+ * compare mask. AVX2 looks up the trail colour 16 table bytes at a time with PSHUFB, using
+ * age - 16 * row plus 0x70 with unsigned saturation as index: that is 0x70..0x7F for ages in
+ * the row, and has bit 7 set (PSHUFB returns 0) for all others. SSE2 has no byte shuffle so
+ * it looks up the colours one by one.
+ */
+#ifdef SPOKE_SIMD_X86
+SPOKE_TARGET_SSE2 static void ShiftHistorySSE2(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold) {
+  const __m128i thres = _mm_set1_epi8((char)threshold);
+  const __m128i mask = _mm_set1_epi8(63);
+  const __m128i arpa = _mm_set1_epi8((char)192);
+  size_t radius = 0;
+
+  for (; radius + 16 <= len; radius += 16) {
+    __m128i h = _mm_loadu_si128((const __m128i *)(hist + radius));
+    __m128i d = _mm_loadu_si128((const __m128i *)(data + radius));
+    __m128i above = _mm_cmpeq_epi8(_mm_max_epu8(d, thres), d);
+
+    h = _mm_and_si128(_mm_add_epi8(h, h), mask);
+    h = _mm_or_si128(h, _mm_and_si128(above, arpa));
+    _mm_storeu_si128((__m128i *)(hist + radius), h);
+  }
+  ShiftHistoryScalar(hist + radius, data + radius, len - radius, threshold);
+}
+
+SPOKE_TARGET_SSE2 static void MultiSweepFilterSSE2(UINT8 *data, const UINT8 *hist, size_t len) {
+  const __m128i one = _mm_set1_epi8(1);
+  size_t radius = 0;
+
+  for (; radius + 16 <= len; radius += 16) {
+    __m128i h = _mm_loadu_si128((const __m128i *)(hist + radius));
+    __m128i d = _mm_loadu_si128((const __m128i *)(data + radius));
+    __m128i h1 = _mm_srli_epi16(h, 1);
+    __m128i h2 = _mm_srli_epi16(h, 2);
+    __m128i two = _mm_or_si128(_mm_and_si128(h, _mm_or_si128(h1, h2)), _mm_and_si128(h1, h2));
+    __m128i allow = _mm_cmpeq_epi8(_mm_and_si128(two, one), one);
+
+    _mm_storeu_si128((__m128i *)(data + radius), _mm_and_si128(d, allow));
+  }
+  MultiSweepFilterScalar(data + radius, hist + radius, len - radius);
+}
+
+SPOKE_TARGET_SSE2 static void RelativeTrailsSSE2(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                                                 const UINT8 *trail_colour) {
+  const __m128i thres = _mm_set1_epi8((char)threshold);
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i oldest = _mm_set1_epi8((char)((TRAIL_MAX_REVOLUTIONS)-1));
+  size_t radius = 0;
+
+  for (; radius + 16 <= len; radius += 16) {
+    __m128i age = _mm_loadu_si128((const __m128i *)(trail + radius));
+    __m128i d = _mm_loadu_si128((const __m128i *)(data + radius));
+    __m128i hit = _mm_cmpeq_epi8(_mm_max_epu8(d, thres), d);
+    __m128i grow = _mm_andnot_si128(_mm_cmpeq_epi8(age, zero), _mm_cmpeq_epi8(_mm_min_epu8(age, oldest), age));
+
+    age = _mm_sub_epi8(age, grow);
+    age = _mm_or_si128(_mm_andnot_si128(hit, age), _mm_and_si128(hit, one));
+    _mm_storeu_si128((__m128i *)(trail + radius), age);
+    if (trail_colour) {
+      int hits = _mm_movemask_epi8(hit);
+
+      for (int i = 0; i < 16; i++) {
+        if (!(hits & (1 << i))) {
+          data[radius + i] = trail_colour[trail[radius + i]];
+        }
+      }
+    }
+  }
+  RelativeTrailsScalar(trail + radius, data + radius, len - radius, threshold, trail_colour);
+}
+
+SPOKE_TARGET_AVX2 static void ShiftHistoryAVX2(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold) {
+  const __m256i thres = _mm256_set1_epi8((char)threshold);
+  const __m256i mask = _mm256_set1_epi8(63);
+  const __m256i arpa = _mm256_set1_epi8((char)192);
+  size_t radius = 0;
+
+  for (; radius + 32 <= len; radius += 32) {
+    __m256i h = _mm256_loadu_si256((const __m256i *)(hist + radius));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(data + radius));
+    __m256i above = _mm256_cmpeq_epi8(_mm256_max_epu8(d, thres), d);
+
+    h = _mm256_and_si256(_mm256_add_epi8(h, h), mask);
+    h = _mm256_or_si256(h, _mm256_and_si256(above, arpa));
+    _mm256_storeu_si256((__m256i *)(hist + radius), h);
+  }
+  ShiftHistoryScalar(hist + radius, data + radius, len - radius, threshold);
+}
+
+SPOKE_TARGET_AVX2 static void MultiSweepFilterAVX2(UINT8 *data, const UINT8 *hist, size_t len) {
+  const __m256i one = _mm256_set1_epi8(1);
+  size_t radius = 0;
+
+  for (; radius + 32 <= len; radius += 32) {
+    __m256i h = _mm256_loadu_si256((const __m256i *)(hist + radius));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(data + radius));
+    __m256i h1 = _mm256_srli_epi16(h, 1);
+    __m256i h2 = _mm256_srli_epi16(h, 2);
+    __m256i two = _mm256_or_si256(_mm256_and_si256(h, _mm256_or_si256(h1, h2)), _mm256_and_si256(h1, h2));
+    __m256i allow = _mm256_cmpeq_epi8(_mm256_and_si256(two, one), one);
+
+    _mm256_storeu_si256((__m256i *)(data + radius), _mm256_and_si256(d, allow));
+  }
+  MultiSweepFilterScalar(data + radius, hist + radius, len - radius);
+}
+
+SPOKE_TARGET_AVX2 static void RelativeTrailsAVX2(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                                                 const UINT8 *trail_colour) {
+  const __m256i thres = _mm256_set1_epi8((char)threshold);
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi8(1);
+  const __m256i bias = _mm256_set1_epi8(0x70);
+  const __m256i oldest = _mm256_set1_epi8((char)((TRAIL_MAX_REVOLUTIONS)-1));
+  __m256i row[TRAIL_COLOURS / 16];
+  size_t radius = 0;
+
+  if (trail_colour) {
+    for (int r = 0; r < TRAIL_COLOURS / 16; r++) {
+      row[r] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(trail_colour + r * 16)));
+    }
+  }
+
+  for (; radius + 32 <= len; radius += 32) {
+    __m256i age = _mm256_loadu_si256((const __m256i *)(trail + radius));
+    __m256i d = _mm256_loadu_si256((const __m256i *)(data + radius));
+    __m256i hit = _mm256_cmpeq_epi8(_mm256_max_epu8(d, thres), d);
+    __m256i grow = _mm256_andnot_si256(_mm256_cmpeq_epi8(age, zero), _mm256_cmpeq_epi8(_mm256_min_epu8(age, oldest), age));
+
+    age = _mm256_sub_epi8(age, grow);
+    age = _mm256_blendv_epi8(age, one, hit);
+    _mm256_storeu_si256((__m256i *)(trail + radius), age);
+    if (trail_colour) {
+      __m256i index = _mm256_adds_epu8(age, bias);
+      __m256i colour = _mm256_shuffle_epi8(row[0], index);
+
+      for (int r = 1; r < TRAIL_COLOURS / 16; r++) {
+        index = _mm256_adds_epu8(_mm256_sub_epi8(age, _mm256_set1_epi8((char)(r * 16))), bias);
+        colour = _mm256_or_si256(colour, _mm256_shuffle_epi8(row[r], index));
+      }
+      _mm256_storeu_si256((__m256i *)(data + radius), _mm256_blendv_epi8(colour, d, hit));
+    }
+  }
+  RelativeTrailsScalar(trail + radius, data + radius, len - radius, threshold, trail_colour);
+}
+
+#ifdef _MSC_VER
+static bool CpuHasSSE2() {
+  int info[4];
+
+  __cpuid(info, 1);
+  return (info[3] & (1 << 26)) != 0;
+}
+
+static bool CpuHasAVX2() {
+  int info[4];
+
+  __cpuid(info, 0);
+  if (info[0] < 7) {
+    return false;
+  }
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) {  // OSXSAVE and AVX
+    return false;
+  }
+  if ((_xgetbv(0) & 6) != 6) {  // OS saves the YMM registers
+    return false;
+  }
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+}
+#else
+static bool CpuHasSSE2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("sse2");
+}
+
+static bool CpuHasAVX2() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
+#ifdef SPOKE_SIMD_NEON
+static void ShiftHistoryNEON(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold) {
+  const uint8x16_t thres = vdupq_n_u8(threshold);
+  const uint8x16_t mask = vdupq_n_u8(63);
+  const uint8x16_t arpa = vdupq_n_u8(192);
+  size_t radius = 0;
+
+  for (; radius + 16 <= len; radius += 16) {
+    uint8x16_t h = vld1q_u8(hist + radius);
+    uint8x16_t d = vld1q_u8(data + radius);
+
+    h = vandq_u8(vshlq_n_u8(h, 1), mask);
+    h = vorrq_u8(h, vandq_u8(vcgeq_u8(d, thres), arpa));
+    vst1q_u8(hist + radius, h);
+  }
+  ShiftHistoryScalar(hist + radius, data + radius, len - radius, threshold);
+}
+
+static void MultiSweepFilterNEON(UINT8 *data, const UINT8 *hist, size_t len) {
+  const uint8x16_t one = vdupq_n_u8(1);
+  size_t radius = 0;
+
+  for (; radius + 16 <= len; radius += 16) {
+    uint8x16_t h = vld1q_u8(hist + radius);
+    uint8x16_t d = vld1q_u8(data + radius);
+    uint8x16_t h1 = vshrq_n_u8(h, 1);
+    uint8x16_t h2 = vshrq_n_u8(h, 2);
+    uint8x16_t two = vorrq_u8(vandq_u8(h, vorrq_u8(h1, h2)), vandq_u8(h1, h2));
+
+    vst1q_u8(data + radius, vandq_u8(d, vtstq_u8(two, one)));
+  }
+  MultiSweepFilterScalar(data + radius, hist + radius, len - radius);
+}
+static void RelativeTrailsNEON(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                               const UINT8 *trail_colour) {
+  const uint8x16_t thres = vdupq_n_u8(threshold);
+  const uint8x16_t one = vdupq_n_u8(1);
+  const uint8x16_t oldest = vdupq_n_u8((TRAIL_MAX_REVOLUTIONS)-1);
+  size_t radius = 0;
+#ifdef __aarch64__
+  // Four 64 byte tables; TBX leaves lanes whose index is out of range unchanged
+  uint8x16x4_t table[TRAIL_COLOURS / 64];
+
+  if (trail_colour) {
+    for (int t = 0; t < TRAIL_COLOURS / 64; t++) {
+      for (int q = 0; q < 4; q++) {
+        table[t].val[q] = vld1q_u8(trail_colour + t * 64 + q * 16);
+      }
+    }
+  }
+#endif
+
+  for (; radius + 16 <= len; radius += 16) {
+    uint8x16_t age = vld1q_u8(trail + radius);
+    uint8x16_t d = vld1q_u8(data + radius);
+    uint8x16_t hit = vcgeq_u8(d, thres);
+    uint8x16_t grow = vandq_u8(vtstq_u8(age, age), vcleq_u8(age, oldest));
+
+    age = vsubq_u8(age, grow);
+    age = vbslq_u8(hit, one, age);
+    vst1q_u8(trail + radius, age);
+    if (trail_colour) {
+#ifdef __aarch64__
+      uint8x16_t colour = vqtbl4q_u8(table[0], age);
+
+      for (int t = 1; t < TRAIL_COLOURS / 64; t++) {
+        colour = vqtbx4q_u8(colour, table[t], vsubq_u8(age, vdupq_n_u8(t * 64)));
+      }
+      vst1q_u8(data + radius, vbslq_u8(hit, d, colour));
+#else
+      for (int i = 0; i < 16; i++) {
+        if (data[radius + i] < threshold) {
+          data[radius + i] = trail_colour[trail[radius + i]];
+        }
+      }
+#endif
+    }
+  }
+  RelativeTrailsScalar(trail + radius, data + radius, len - radius, threshold, trail_colour);
+}
+
+#endif
+
+typedef void (*ShiftHistoryFunc)(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold);
+typedef void (*MultiSweepFilterFunc)(UINT8 *data, const UINT8 *hist, size_t len);
+typedef void (*RelativeTrailsFunc)(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                                   const UINT8 *trail_colour);
+
+// Selected while the plugin library is loaded, before any thread can call the kernels
+static ShiftHistoryFunc s_shift_history = ShiftHistoryScalar;
+static MultiSweepFilterFunc s_multi_sweep_filter = MultiSweepFilterScalar;
+static RelativeTrailsFunc s_relative_trails = RelativeTrailsScalar;
+
+static bool SpokeKernelsSupported(SpokeKernels kernels) {
+  switch (kernels) {
+    case SPOKE_KERNELS_SCALAR:
+      return true;
+#ifdef SPOKE_SIMD_X86
+    case SPOKE_KERNELS_SSE2:
+      return CpuHasSSE2();
+    case SPOKE_KERNELS_AVX2:
+      return CpuHasAVX2();
+#endif
+#ifdef SPOKE_SIMD_NEON
+    case SPOKE_KERNELS_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+SpokeKernels SpokeBestKernels() {
+  static const SpokeKernels preference[] = {SPOKE_KERNELS_AVX2, SPOKE_KERNELS_SSE2, SPOKE_KERNELS_NEON};
+
+  for (size_t i = 0; i < ARRAY_SIZE(preference); i++) {
+    if (SpokeKernelsSupported(preference[i])) {
+      return preference[i];
+    }
+  }
+  return SPOKE_KERNELS_SCALAR;
+}
+
+bool SpokeSelectKernels(SpokeKernels kernels) {
+  if (!SpokeKernelsSupported(kernels)) {
+    return false;
+  }
+  switch (kernels) {
+#ifdef SPOKE_SIMD_X86
+    case SPOKE_KERNELS_SSE2:
+      s_shift_history = ShiftHistorySSE2;
+      s_multi_sweep_filter = MultiSweepFilterSSE2;
+      s_relative_trails = RelativeTrailsSSE2;
+      break;
+    case SPOKE_KERNELS_AVX2:
+      s_shift_history = ShiftHistoryAVX2;
+      s_multi_sweep_filter = MultiSweepFilterAVX2;
+      s_relative_trails = RelativeTrailsAVX2;
+      break;
+#endif
+#ifdef SPOKE_SIMD_NEON
+    case SPOKE_KERNELS_NEON:
+      s_shift_history = ShiftHistoryNEON;
+      s_multi_sweep_filter = MultiSweepFilterNEON;
+      s_relative_trails = RelativeTrailsNEON;
+      break;
+#endif
+    default:
+      s_shift_history = ShiftHistoryScalar;
+      s_multi_sweep_filter = MultiSweepFilterScalar;
+      s_relative_trails = RelativeTrailsScalar;
+      break;
+  }
+  return true;
+}
+
+static bool s_kernels_selected = SpokeSelectKernels(SpokeBestKernels());
+
+const char *SpokeKernelsName(SpokeKernels kernels) {
+  static const char *name[SPOKE_KERNELS_COUNT] = {"scalar", "SSE2", "AVX2", "NEON"};
+
+  return kernels < SPOKE_KERNELS_COUNT ? name[kernels] : "?";
+}
+
+void SpokeShiftHistory(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold) {
+  s_shift_history(hist, data, len, threshold);
+}
+
+void SpokeMultiSweepFilter(UINT8 *data, const UINT8 *hist, size_t len) { s_multi_sweep_filter(data, hist, len); }
+
+int SpokeCountReturns(const UINT8 *data, const UINT8 *hist, size_t r_begin, size_t r_end, UINT8 threshold,
+                      bool multi_sweep_filter) {
+  int count = 0;
+
+  for (size_t r = r_begin; r < r_end; r++) {
+    if ((!multi_sweep_filter || HISTORY_FILTER_ALLOW(hist[r])) && data[r] >= threshold) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void SpokeUpdateRelativeTrails(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                               const UINT8 *trail_colour) {
+  s_relative_trails(trail, data, len, threshold, trail_colour);
+}
+
+void SpokeUpdateTrueTrails(TrailRevolutionsAge *trails, const PolarToCartesianLookupTable *lookup, SpokeBearing bearing,
+                           int lat, int lon, UINT8 *data, size_t len, UINT8 threshold, const UINT8 *trail_colour) {
+  for (size_t radius = 0; radius < len; radius++) {
+    TrailRevolutionsAge *trail = trails + TrailIndex(lat + lookup->IntX(bearing, radius), lon + lookup->IntY(bearing, radius));
+
+    UpdateTrail(trail, data + radius, threshold, trail_colour);
+  }
+}
+
+#define ADD_VERTEX_POINT(angle, radius)            \
+  {                                                \
+    points[count].x = lookup->X(angle, radius);    \
+    points[count].y = lookup->Y(angle, radius);    \
+    points[count].red = red;                       \
+    points[count].green = green;                   \
+    points[count].blue = blue;                     \
+    points[count].alpha = alpha;                   \
+    count++;                                       \
+  }
+
+size_t SpokeToVertices(SpokeVertex *points, SpokeBearing angle, const UINT8 *data, size_t len, const BlobColour *colour_map,
+                       const wxColour *colour_map_rgb, GLubyte alpha, const PolarToCartesianLookupTable *lookup) {
+  int arc1 = MOD_ROTATION2048(angle);
+  int arc2 = MOD_ROTATION2048(angle + 1);
+  size_t count = 0;
+  size_t radius = 0;
+
+  while (radius < len) {
+    BlobColour colour = colour_map[data[radius]];
+
+    if (colour == BLOB_NONE) {
+      radius++;
+      continue;
+    }
+
+    // Find the end of the run of returns with this colour
+    size_t r1 = radius;
+    do {
+      radius++;
+    } while (radius < len && colour_map[data[radius]] == colour);
+    size_t r2 = radius;
+
+    GLubyte red = colour_map_rgb[colour].Red();
+    GLubyte green = colour_map_rgb[colour].Green();
+    GLubyte blue = colour_map_rgb[colour].Blue();
+
+    // First triangle
+    ADD_VERTEX_POINT(arc1, r1);
+    ADD_VERTEX_POINT(arc1, r2);
+    ADD_VERTEX_POINT(arc2, r1);
+
+    // Second triangle
+    ADD_VERTEX_POINT(arc2, r1);
+    ADD_VERTEX_POINT(arc1, r2);
+    ADD_VERTEX_POINT(arc2, r2);
+  }
+  return count;
+}
+
+#define ADD_COMPACT_POINT(angle, radius)                                \
+  {                                                                     \
+    points[count].arc = (GLushort)(angle);                              \
+    points[count].radius_colour = (GLushort)((radius) + radius_colour); \
+    count++;                                                            \
+  }
+
+size_t SpokeToCompactVertices(SpokeCompactVertex *points, SpokeBearing angle, const UINT8 *data, size_t len,
+                              const BlobColour *colour_map) {
+  int arc1 = MOD_ROTATION2048(angle);
+  int arc2 = MOD_ROTATION2048(angle + 1);
+  size_t count = 0;
+  size_t radius = 0;
+
+  while (radius < len) {
+    BlobColour colour = colour_map[data[radius]];
+
+    if (colour == BLOB_NONE) {
+      radius++;
+      continue;
+    }
+
+    size_t r1 = radius;
+    do {
+      radius++;
+    } while (radius < len && colour_map[data[radius]] == colour);
+    size_t r2 = radius;
+
+    size_t radius_colour = SPOKE_COMPACT_RADIUS * colour;
+
+    ADD_COMPACT_POINT(arc1, r1);
+    ADD_COMPACT_POINT(arc1, r2);
+    ADD_COMPACT_POINT(arc2, r2);
+    ADD_COMPACT_POINT(arc2, r1);
+  }
+  return count;
+}
+
+void SpokeToRGBA(UINT8 *rgba, const UINT8 *data, size_t len, const BlobColour *colour_map, const wxColour *colour_map_rgb,
+                 GLubyte alpha) {
+  for (size_t r = 0; r < len; r++) {
+    BlobColour colour = colour_map[data[r]];
+
+    rgba[0] = colour_map_rgb[colour].Red();
+    rgba[1] = colour_map_rgb[colour].Green();
+    rgba[2] = colour_map_rgb[colour].Blue();
+    rgba[3] = colour != BLOB_NONE ? alpha : 0;
+    rgba += 4;
+  }
+}
+
+void SpokeBlobs::Reset() {
+  m_run_count[0] = 0;
+  m_run_count[1] = 0;
+  m_current = 0;
+  m_open_count = 0;
+  m_open_free_count = SPOKE_BLOBS_OPEN;
+  for (int i = 0; i < SPOKE_BLOBS_OPEN; i++) {
+    m_open_free[i] = SPOKE_BLOBS_OPEN - 1 - i;
+  }
+  for (int i = 0; i < SPOKE_BLOBS_TABLE; i++) {
+    m_table[i].next = i + 1 < SPOKE_BLOBS_TABLE ? i + 1 : -1;
+  }
+  m_table_free = 0;
+  for (int i = 0; i < LINES_PER_ROTATION; i++) {
+    m_first[i] = -1;
+  }
+  m_last_angle = -1;
+  m_sweep = 0;
+}
+
+int SpokeBlobs::NewOpen() {
+  if (m_open_free_count == 0) {
+    return -1;
+  }
+  int label = m_open_free[--m_open_free_count];
+  m_open_used[m_open_count++] = label;
+
+  OpenBlob &blob = m_open[label];
+  blob.parent = label;
+  blob.first = m_sweep;
+  blob.last = m_sweep;
+  blob.min_r = RETURNS_PER_LINE;
+  blob.max_r = -1;
+  blob.start_r = RETURNS_PER_LINE;
+  blob.area = 0;
+  blob.sum_angle = 0.;
+  blob.sum_r = 0.;
+  return label;
+}
+
+int SpokeBlobs::Root(int label) {
+  int root = label;
+
+  while (m_open[root].parent != root) {
+    root = m_open[root].parent;
+  }
+  while (m_open[label].parent != root) {  // Path compression
+    int parent = m_open[label].parent;
+    m_open[label].parent = root;
+    label = parent;
+  }
+  return root;
+}
+
+// Join two roots and return the new root, which is the one that started first.
+int SpokeBlobs::Join(int a, int b) {
+  UINT32 age_a = m_sweep - m_open[a].first;
+  UINT32 age_b = m_sweep - m_open[b].first;
+
+  if (age_b > age_a || (age_b == age_a && m_open[b].start_r < m_open[a].start_r)) {
+    int t = a;
+    a = b;
+    b = t;
+  }
+  OpenBlob &root = m_open[a];
+  OpenBlob &child = m_open[b];
+
+  child.parent = a;
+  root.sum_angle += child.sum_angle + (double)(child.first - root.first) * child.area;
+  root.sum_r += child.sum_r;
+  root.area += child.area;
+  if (m_sweep - child.last < m_sweep - root.last) {
+    root.last = child.last;
+  }
+  root.min_r = wxMin(root.min_r, child.min_r);
+  root.max_r = wxMax(root.max_r, child.max_r);
+  if (child.first == root.first) {
+    root.start_r = wxMin(root.start_r, child.start_r);
+  }
+  return a;
+}
+
+// Move a finished root to the table, when it is large enough and there is room.
+void SpokeBlobs::FinishOpen(int label) {
+  const OpenBlob &open = m_open[label];
+
+  if (open.area < SPOKE_BLOB_MIN_AREA || m_table_free < 0) {
+    return;
+  }
+  int i = m_table_free;
+  SpokeBlob &blob = m_table[i];
+  m_table_free = blob.next;
+
+  blob.min_angle = MOD_ROTATION2048(m_last_angle - (int)((m_sweep - open.first) % LINES_PER_ROTATION));
+  blob.max_angle = blob.min_angle + (int)(open.last - open.first);
+  blob.min_r = open.min_r;
+  blob.max_r = open.max_r;
+  blob.start_r = open.start_r;
+  blob.area = open.area;
+  blob.centroid_angle = blob.min_angle + open.sum_angle / open.area;
+  blob.centroid_r = open.sum_r / open.area;
+  blob.next = m_first[blob.min_angle];
+  m_first[blob.min_angle] = i;
+}
+
+void SpokeBlobs::FinishAll() {
+  for (int i = 0; i < m_open_count; i++) {
+    int label = m_open_used[i];
+    if (m_open[label].parent == label) {
+      FinishOpen(label);
+    }
+    m_open_free[m_open_free_count++] = label;
+  }
+  m_open_count = 0;
+  m_run_count[m_current] = 0;
+}
+
+// Forget the blobs that started on this spoke one rotation ago.
+void SpokeBlobs::ClearSpoke(int angle) {
+  int i = m_first[angle];
+
+  while (i >= 0) {
+    int next = m_table[i].next;
+    m_table[i].next = m_table_free;
+    m_table_free = i;
+    i = next;
+  }
+  m_first[angle] = -1;
+}
+
+void SpokeBlobs::AddSpoke(SpokeBearing angle, const UINT8 *hist, size_t len, UINT8 mask) {
+  angle = MOD_ROTATION2048(angle);
+
+  if (m_last_angle >= 0 && angle == MOD_ROTATION2048(m_last_angle + 1)) {
+    ClearSpoke(angle);
+  } else {
+    // Not the next spoke, so nothing can be joined with the previous one
+    FinishAll();
+    if (m_last_angle >= 0 && angle != m_last_angle) {
+      for (int a = MOD_ROTATION2048(m_last_angle + 1); a != angle; a = MOD_ROTATION2048(a + 1)) {
+        ClearSpoke(a);
+      }
+    }
+    if (angle != m_last_angle) {
+      ClearSpoke(angle);
+    }
+    m_sweep++;
+  }
+  m_sweep++;
+  m_last_angle = angle;
+
+  const Run *prev = m_runs[m_current];
+  int prev_count = m_run_count[m_current];
+  m_current = 1 - m_current;
+  Run *runs = m_runs[m_current];
+  int count = 0;
+
+  // Same radius limits as ArpaTarget::Pix, which skips the range ring
+  int end = (int)wxMin(len, RETURNS_PER_LINE - 1);
+  for (int r = 2; r < end; r++) {
+    if (hist[r] & mask) {
+      runs[count].first = r;
+      while (r + 1 < end && (hist[r + 1] & mask)) {
+        r++;
+      }
+      runs[count].last = r;
+      count++;
+    }
+  }
+  m_run_count[m_current] = count;
+
+  int p = 0;
+  for (int i = 0; i < count; i++) {
+    Run &run = runs[i];
+    int label = -1;
+
+    while (p < prev_count && prev[p].last < run.first) {
+      p++;
+    }
+    for (int q = p; q < prev_count && prev[q].first <= run.last; q++) {
+      if (prev[q].label < 0) {
+        continue;
+      }
+      int root = Root(prev[q].label);
+      label = label < 0 ? root : (root == label ? label : Join(label, root));
+    }
+    if (label < 0) {
+      label = NewOpen();
+    }
+    run.label = label;
+    if (label >= 0) {
+      OpenBlob &blob = m_open[label];
+      int n = run.last - run.first + 1;
+
+      blob.last = m_sweep;
+      blob.min_r = wxMin(blob.min_r, run.first);
+      blob.max_r = wxMax(blob.max_r, run.last);
+      if (blob.first == m_sweep) {
+        blob.start_r = wxMin(blob.start_r, run.first);
+      }
+      blob.area += n;
+      blob.sum_angle += (double)(m_sweep - blob.first) * n;
+      blob.sum_r += (double)(run.first + run.last) * n / 2.;
+    }
+  }
+
+  // Point the runs at their roots, then finish the roots that this spoke did not reach and
+  // release all labels that are no longer used.
+  for (int i = 0; i < count; i++) {
+    if (runs[i].label >= 0) {
+      runs[i].label = Root(runs[i].label);
+      m_open[runs[i].label].last = m_sweep;
+    }
+  }
+  int kept = 0;
+  for (int i = 0; i < m_open_count; i++) {
+    int label = m_open_used[i];
+    if (m_open[label].parent == label && m_open[label].last == m_sweep) {
+      m_open_used[kept++] = label;
+      continue;
+    }
+    if (m_open[label].parent == label) {
+      FinishOpen(label);
+    }
+    m_open_free[m_open_free_count++] = label;
+  }
+  m_open_count = kept;
+}
+
+int SpokeBlobs::Find(int first_angle, int last_angle, int min_r, int max_r, SpokeBlob *found, int max_found) const {
+  int n = 0;
+  int spokes = wxMin(last_angle - first_angle + 1, LINES_PER_ROTATION);
+
+  for (int a = 0; a < spokes; a++) {
+    for (int i = m_first[MOD_ROTATION2048(first_angle + a)]; i >= 0; i = m_table[i].next) {
+      const SpokeBlob &blob = m_table[i];
+      if (blob.max_r < min_r || blob.min_r > max_r) {
+        continue;
+      }
+      if (n == max_found) {
+        return n;
+      }
+      found[n++] = blob;
+    }
+  }
+  return n;
+}
+
+bool SpokeBlobs::IsOpen(int first_angle, int last_angle) const {
+  if (m_last_angle < 0) {
+    return false;
+  }
+  // Open blobs started this many spokes before the last one
+  int newest = MOD_ROTATION2048(m_last_angle - last_angle);
+  int oldest = newest + wxMin(last_angle - first_angle, LINES_PER_ROTATION - 1);
+
+  for (int i = 0; i < m_open_count; i++) {
+    UINT32 age = m_sweep - m_open[m_open_used[i]].first;
+    if (age >= (UINT32)newest && age <= (UINT32)oldest) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void OccupancyPlane::Reset() {
+  memset(m_claimed, 0, sizeof(m_claimed));
+  for (int a = 0; a < LINES_PER_ROTATION; a++) {
+    for (int w = 0; w < OCCUPANCY_WORDS; w++) {
+      OCCUPANCY_STORE_WORD(&m_returns[a][w], 0u);
+    }
+    OCCUPANCY_STORE(&m_page[a], (UINT8)0);
+  }
+}
+
+void OccupancyPlane::SetSpoke(SpokeBearing angle, const UINT8 *hist, size_t len, UINT8 mask) {
+  UINT32 *returns = m_returns[angle];
+  int page = m_page[angle] ^ 1;
+  int end = (int)wxMin(len, RETURNS_PER_LINE - 1);
+
+  memset(m_claimed[page][angle], 0, sizeof(m_claimed[page][angle]));
+  for (int w = 0; w < OCCUPANCY_WORDS; w++) {
+    int first = w * OCCUPANCY_WORD_BITS;
+    int last = wxMin(first + OCCUPANCY_WORD_BITS, end);
+    UINT32 word = 0;
+
+    for (int r = wxMax(first, 2); r < last; r++) {
+      if (hist[r] & mask) {
+        word |= 1u << (r - first);
+      }
+    }
+    OCCUPANCY_STORE_WORD(&returns[w], word);
+  }
+  OCCUPANCY_STORE(&m_page[angle], (UINT8)page);
+}
+
+void OccupancyPlane::Claim(int min_angle, int max_angle, int min_r, int max_r) {
+  min_r = wxMax(min_r, 0);
+  max_r = wxMin(max_r, RETURNS_PER_LINE - 1);
+  if (min_r > max_r) {
+    return;
+  }
+  if (max_angle - min_angle >= LINES_PER_ROTATION) {
+    max_angle = min_angle + LINES_PER_ROTATION - 1;
+  }
+
+  int first_word = min_r / OCCUPANCY_WORD_BITS;
+  int last_word = max_r / OCCUPANCY_WORD_BITS;
+  UINT32 mask[OCCUPANCY_WORDS];
+
+  for (int w = first_word; w <= last_word; w++) {
+    int first = wxMax(min_r - w * OCCUPANCY_WORD_BITS, 0);
+    int last = wxMin(max_r - w * OCCUPANCY_WORD_BITS, OCCUPANCY_WORD_BITS - 1);
+
+    mask[w] = (0xffffffffu >> (OCCUPANCY_WORD_BITS - 1 - last)) & (0xffffffffu << first);
+  }
+  for (int a = min_angle; a <= max_angle; a++) {
+    int angle = MOD_ROTATION2048(a);
+    UINT32 *claimed = m_claimed[OCCUPANCY_LOAD(&m_page[angle])][angle];
+
+    for (int w = first_word; w <= last_word; w++) {
+      claimed[w] |= mask[w];
+    }
+  }
+}
+
+PLUGIN_END_NAMESPACE
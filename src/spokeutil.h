@@ -0,0 +1,265 @@
+/******************************************************************************
+ *
+ * Project:  OpenCPN
+ * Purpose:  Navico BR24 Radar Plugin
+ * Author:   David Register
+ *           Dave Cowell
+ *           Kees Verruijt
+ *           Douwe Fokkema
+ *           Sean D'Epagnier
+ ***************************************************************************
+ *   Copyright (C) 2010 by David S. Register              bdbcat@yahoo.com *
+ *   Copyright (C) 2012-2013 by Dave Cowell                                *
+ *   Copyright (C) 2012-2016 by Kees Verruijt         canboat@verruijt.net *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, write to the                         *
+ *   Free Software Foundation, Inc.,                                       *
+ *   59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.             *
+ ***************************************************************************
+ */
+
+#ifndef _SPOKEUTIL_H_
+#define _SPOKEUTIL_H_
+
+#include "drawutil.h"
+
+PLUGIN_BEGIN_NAMESPACE
+
+/*
+ * The per-spoke work done by RadarInfo, GuardZone and the RadarDraw classes for every
+ * received spoke. These do not need a radar, a canvas or a lock, so spoke-bench can
+ * time them on their own.
+ */
+
+#define SPOKE_VERTEX_PER_QUAD (6)  // Two triangles per blob
+
+struct SpokeVertex {
+  GLfloat x;
+  GLfloat y;
+  GLubyte red;
+  GLubyte green;
+  GLubyte blue;
+  GLubyte alpha;
+};
+
+#define SPOKE_COMPACT_VERTEX_PER_QUAD (4)  // One GL_QUADS quad per blob
+#define SPOKE_COMPACT_RADIUS (1024)        // radius_colour = radius + SPOKE_COMPACT_RADIUS * colour
+
+// A corner of a blob for the vertex shader in RadarDrawVertex, which looks up the position and the
+// colour on the GPU. A blob takes 16 bytes instead of the 72 of six SpokeVertex.
+struct SpokeCompactVertex {
+  GLushort arc;
+  GLushort radius_colour;
+};
+
+// Instruction sets that SpokeShiftHistory, SpokeMultiSweepFilter and SpokeUpdateRelativeTrails can be run with.
+enum SpokeKernels { SPOKE_KERNELS_SCALAR, SPOKE_KERNELS_SSE2, SPOKE_KERNELS_AVX2, SPOKE_KERNELS_NEON, SPOKE_KERNELS_COUNT };
+
+// The fastest set this CPU supports, which is what is used unless SpokeSelectKernels() is called.
+extern SpokeKernels SpokeBestKernels();
+
+// Use this set from now on. Returns false, and changes nothing, when the CPU does not support it.
+extern bool SpokeSelectKernels(SpokeKernels kernels);
+
+extern const char *SpokeKernelsName(SpokeKernels kernels);
+
+// Shift the history byte of every return left and add this sweep; bits 6 and 7 are kept for ARPA.
+extern void SpokeShiftHistory(UINT8 *hist, const UINT8 *data, size_t len, UINT8 threshold);
+
+// Zero every return that HISTORY_FILTER_ALLOW rejects.
+extern void SpokeMultiSweepFilter(UINT8 *data, const UINT8 *hist, size_t len);
+
+// Number of returns in [r_begin, r_end) at or above threshold.
+extern int SpokeCountReturns(const UINT8 *data, const UINT8 *hist, size_t r_begin, size_t r_end, UINT8 threshold,
+                             bool multi_sweep_filter);
+
+// Age the trail of each return, or restart it when the return is at or above threshold.
+// When trail_colour is not NULL the returns below threshold are replaced by their trail colour,
+// from a table of TRAIL_COLOURS BlobColour values.
+extern void SpokeUpdateRelativeTrails(TrailRevolutionsAge *trail, UINT8 *data, size_t len, UINT8 threshold,
+                                      const UINT8 *trail_colour);
+
+// Same, but for the north up true trails image (see TrailIndex), with the radar at (lat, lon)
+// and the spoke at this bearing.
+extern void SpokeUpdateTrueTrails(TrailRevolutionsAge *trails, const PolarToCartesianLookupTable *lookup, SpokeBearing bearing,
+                                  int lat, int lon, UINT8 *data, size_t len, UINT8 threshold, const UINT8 *trail_colour);
+
+// Convert the line into quads for runs of equal colour. Returns the number of vertices written,
+// points must have room for len * SPOKE_VERTEX_PER_QUAD vertices.
+extern size_t SpokeToVertices(SpokeVertex *points, SpokeBearing angle, const UINT8 *data, size_t len,
+                              const BlobColour *colour_map, const wxColour *colour_map_rgb, GLubyte alpha,
+                              const PolarToCartesianLookupTable *lookup);
+
+// The same quads as SpokeToVertices as SpokeCompactVertex corners, in the order GL_QUADS wants them.
+// points must have room for len * SPOKE_COMPACT_VERTEX_PER_QUAD vertices.
+extern size_t SpokeToCompactVertices(SpokeCompactVertex *points, SpokeBearing angle, const UINT8 *data, size_t len,
+                                     const BlobColour *colour_map);
+
+// Convert the line into len RGBA texels.
+extern void SpokeToRGBA(UINT8 *rgba, const UINT8 *data, size_t len, const BlobColour *colour_map,
+                        const wxColour *colour_map_rgb, GLubyte alpha);
+
+/*
+ * Connected groups (4-neighbours) of returns that have a bit of mask set in the history, found with one
+ * pass over the spokes as they arrive. Each spoke is split in runs of adjacent returns, which are joined
+ * with the overlapping runs of the previous spoke using union-find. A blob is finished when a spoke
+ * has no run connected to it, and stays in the table until the sweep reaches its first spoke again.
+ * This way ARPA reads the blobs of the last rotation instead of walking the history pixel by pixel.
+ */
+#define SPOKE_BLOBS_OPEN (RETURNS_PER_LINE)  // Blobs still growing; at most one per run of two spokes
+#define SPOKE_BLOBS_TABLE (4096)             // Finished blobs of the last rotation
+#define SPOKE_BLOB_MIN_AREA (3)              // Smaller blobs are not kept, they are not targets
+
+struct SpokeBlob {
+  int min_angle;  // First spoke, 0 .. LINES_PER_ROTATION - 1
+  int max_angle;  // Last spoke, LINES_PER_ROTATION or more when the blob crosses north
+  int min_r;
+  int max_r;
+  int start_r;  // Lowest radius on the first spoke; (min_angle, start_r) is on the contour
+  int area;     // Number of returns
+  double centroid_angle;  // Not reduced modulo LINES_PER_ROTATION either
+  double centroid_r;
+  int next;  // Next blob that starts on the same spoke, -1 for none
+};
+
+class SpokeBlobs {
+ public:
+  SpokeBlobs() { Reset(); }
+
+  void Reset();
+
+  // Label one spoke. Must be called for the spokes in the order they are received; when a spoke is skipped
+  // the open blobs are finished, as they cannot be joined across it.
+  void AddSpoke(SpokeBearing angle, const UINT8 *hist, size_t len, UINT8 mask);
+
+  // Copy at most max_found finished blobs that start on a spoke from first_angle to last_angle (which may
+  // be outside 0 .. LINES_PER_ROTATION - 1) and overlap min_r .. max_r. Returns the number copied.
+  int Find(int first_angle, int last_angle, int min_r, int max_r, SpokeBlob *found, int max_found) const;
+
+  // Whether a blob that starts on a spoke from first_angle to last_angle may still be growing, so that Find
+  // does not return it yet.
+  bool IsOpen(int first_angle, int last_angle) const;
+
+ private:
+  struct Run {
+    int first;
+    int last;
+    int label;  // Index in m_open, -1 when there was no room
+  };
+
+  struct OpenBlob {
+    int parent;  // Union-find parent, itself for a root
+    UINT32 first;  // Sweep counter (see m_sweep) of the first spoke
+    UINT32 last;
+    int min_r;
+    int max_r;
+    int start_r;
+    int area;
+    double sum_angle;  // Relative to first
+    double sum_r;
+  };
+
+  int NewOpen();
+  int Root(int label);
+  int Join(int a, int b);
+  void FinishOpen(int label);
+  void FinishAll();
+  void ClearSpoke(int angle);
+
+  Run m_runs[2][RETURNS_PER_LINE / 2 + 1];
+  int m_run_count[2];
+  int m_current;  // Index of the runs of the last spoke in m_runs
+
+  OpenBlob m_open[SPOKE_BLOBS_OPEN];
+  int m_open_used[SPOKE_BLOBS_OPEN];  // Labels in use
+  int m_open_count;
+  int m_open_free[SPOKE_BLOBS_OPEN];
+  int m_open_free_count;
+
+  SpokeBlob m_table[SPOKE_BLOBS_TABLE];
+  int m_table_free;                    // First unused entry, linked by next
+  int m_first[LINES_PER_ROTATION];     // First blob that starts on this spoke, linked by next
+  int m_last_angle;                    // -1 before the first spoke
+  UINT32 m_sweep;                      // Incremented for every spoke, compare only differences as it wraps
+};
+
+/*
+ * Bit-packed copy of the returns of the last sweep for ARPA, one bit per return, plus a mask of the
+ * returns that ARPA has claimed for a target. The spoke path rewrites a spoke of returns and gives it a
+ * cleared claimed mask; ARPA only sets claimed bits. The claimed mask is double-buffered per spoke: the
+ * spoke path clears the page that is not in use and then flips m_page, so it never writes a word that
+ * ARPA may be writing and neither side needs a lock. The flip is a release store and ARPA reads m_page
+ * with an acquire load, so ARPA never sees the new page before it is cleared. The words of m_returns are
+ * stored and loaded whole but without ordering: ARPA may see a spoke's old or new returns, as it could
+ * with a lock, but never a torn word.
+ */
+#define OCCUPANCY_WORD_BITS (32)
+#define OCCUPANCY_WORDS (RETURNS_PER_LINE / OCCUPANCY_WORD_BITS)  // Words per spoke
+
+#ifdef __GNUC__
+#define OCCUPANCY_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define OCCUPANCY_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define OCCUPANCY_LOAD_WORD(p) __atomic_load_n(p, __ATOMIC_RELAXED)
+#define OCCUPANCY_STORE_WORD(p, v) __atomic_store_n(p, v, __ATOMIC_RELAXED)
+#else
+// MSVC gives volatile loads acquire and volatile stores release semantics, and aligned words are atomic
+#define OCCUPANCY_LOAD(p) (*(volatile UINT8 *)(p))
+#define OCCUPANCY_STORE(p, v) (*(volatile UINT8 *)(p) = (v))
+#define OCCUPANCY_LOAD_WORD(p) (*(volatile UINT32 *)(p))
+#define OCCUPANCY_STORE_WORD(p, v) (*(volatile UINT32 *)(p) = (v))
+#endif
+
+class OccupancyPlane {
+ public:
+  OccupancyPlane() { Reset(); }
+
+  void Reset();
+
+  // Store the returns of one spoke that have a bit of mask set in the history, and release its claims.
+  // The first two and the last return are left out, like the range ring used to be.
+  void SetSpoke(SpokeBearing angle, const UINT8 *hist, size_t len, UINT8 mask);
+
+  // Whether there is a return at angle (any value), r; claimed or not.
+  bool IsReturn(int angle, int r) const {
+    if (r < 0 || r >= RETURNS_PER_LINE) {
+      return false;
+    }
+    return (OCCUPANCY_LOAD_WORD(&m_returns[MOD_ROTATION2048(angle)][r / OCCUPANCY_WORD_BITS]) &
+            (1u << (r % OCCUPANCY_WORD_BITS))) != 0;
+  }
+
+  // Whether there is a return at angle, r that is not claimed by a target yet.
+  bool IsFree(int angle, int r) const {
+    if (r < 0 || r >= RETURNS_PER_LINE) {
+      return false;
+    }
+    angle = MOD_ROTATION2048(angle);
+    UINT32 bit = 1u << (r % OCCUPANCY_WORD_BITS);
+    int w = r / OCCUPANCY_WORD_BITS;
+    return (OCCUPANCY_LOAD_WORD(&m_returns[angle][w]) & ~m_claimed[OCCUPANCY_LOAD(&m_page[angle])][angle][w] & bit) != 0;
+  }
+
+  // Claim all returns from min_angle to max_angle and from min_r to max_r, inclusive, so that they are
+  // not found again in the same sweep. Angles may be outside 0 .. LINES_PER_ROTATION - 1.
+  void Claim(int min_angle, int max_angle, int min_r, int max_r);
+
+ private:
+  UINT32 m_returns[LINES_PER_ROTATION][OCCUPANCY_WORDS];  // Only accessed with OCCUPANCY_LOAD_WORD and _STORE_WORD
+  UINT32 m_claimed[2][LINES_PER_ROTATION][OCCUPANCY_WORDS];
+  UINT8 m_page[LINES_PER_ROTATION];  // Page of m_claimed in use for this spoke, see OCCUPANCY_LOAD
+};
+
+PLUGIN_END_NAMESPACE
+
+#endif /* _SPOKEUTIL_H_ */